@@ -0,0 +1,93 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file bench.h
+ *
+ * @brief The harness shared by the pipeExec microbenchmarks
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @class benchSuite
+ *
+ * @brief Collects the results of the benchmarks and writes them as JSON
+ */
+class benchSuite
+{
+public:
+  using param = std::pair<std::string, long>;
+
+  /**
+   * @brief The result of one benchmark run
+   */
+  struct result
+  {
+    std::string name;          /**< The name of the benchmark */
+    std::vector<param> params; /**< The parameters of the run */
+    uint64_t operations;       /**< The operations done */
+    double seconds;            /**< The wall time of the run */
+  };
+
+  // Only the benchmarks whose name contains the filter are run
+  benchSuite(std::string = "", double = 1.0);
+
+  // True if the benchmark has to be run
+  bool Enabled(const std::string &) const;
+
+  // Scales the number of operations of a run
+  uint64_t Scale(uint64_t) const;
+
+  // Stores the result of a run and prints it
+  void Report(const std::string &, const std::vector<param> &, uint64_t, double);
+
+  // Writes all the results as JSON
+  void WriteJson(FILE *) const;
+
+private:
+  std::string filter_;          /**< Substring of the names to run */
+  double scale_;                /**< Multiplies the operations of every run */
+  std::vector<result> results_; /**< The results collected */
+};
+
+/**
+ * @brief Seconds elapsed since the given time
+ */
+inline double ElapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The groups of benchmarks
+void QueueBenchmarks(benchSuite &);
+void DataBenchmarks(benchSuite &);
+void TopologyBenchmarks(benchSuite &);
@@ -0,0 +1,251 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file bench_data.cpp
+ *
+ * @brief Benchmarks of the extra data, the allocation and the sharing of
+ * pipeData and of the pipeMapper
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "bench.h"
+#include "pipeData.h"
+#include "pipeDataPool.h"
+#include "pipeMapper.h"
+#include "pipeWire.h"
+
+/**
+ * @brief Keeps the compiler from removing a result that is never used
+ */
+static void KeepAlive(void *value)
+{
+  asm volatile("" : : "r"(value) : "memory");
+}
+
+/**
+ * @brief Looks up the last key of a packet carrying the given number of keys
+ *
+ * @details The last key is the worst case of the linear search, and the miss
+ * walks every key as well.
+ */
+static void DataLookup(benchSuite &suite, int keys, bool hit)
+{
+  const uint64_t lookups = suite.Scale(2000000);
+  pipeData data(nullptr);
+  int values[64];
+
+  for (int k = 0; k < keys; ++k)
+    data.setDataKey("key_" + std::to_string(k), &values[k]);
+
+  std::string key = hit ? "key_" + std::to_string(keys - 1) : "missing";
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < lookups; ++i)
+    KeepAlive(data.GetExtraData(key));
+
+  suite.Report(hit ? "data_lookup_hit" : "data_lookup_miss", {{"keys", keys}}, lookups, ElapsedSeconds(start));
+}
+
+/**
+ * @brief Looks up every node of a square mapper by address, by name and by
+ * route handle
+ */
+static void MapperLookup(benchSuite &suite, int side, const char *how)
+{
+  const uint64_t lookups = suite.Scale(1000000);
+  pipeMapper map(2, side, side);
+  std::vector<pipeMapper::nodeId> ids;
+  std::vector<std::string> names;
+  std::vector<pipeMapper::route> routes;
+  std::string by(how);
+  bool by_name = by == "name", by_route = by == "route";
+  int node;
+
+  for (int x = 0; x < side; ++x)
+  {
+    for (int y = 0; y < side; ++y)
+    {
+      names.push_back("node_" + std::to_string(x) + "_" + std::to_string(y));
+      ids.push_back(map.addNode(&node, names.back(), pipeMapper::nodeId(x, y, 0)));
+      routes.push_back(map.Route(names.back()));
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < lookups; ++i)
+  {
+    if (by_name)
+      KeepAlive(map.getPipeNode(names[i % names.size()]));
+    else if (by_route)
+      KeepAlive(map.getRouteNode(routes[i % routes.size()]));
+    else
+      KeepAlive(map.getPipeNode(ids[i % ids.size()]));
+  }
+
+  suite.Report("mapper_lookup_" + by, {{"nodes", side * side}}, lookups, ElapsedSeconds(start));
+}
+
+/**
+ * @brief Creates packets with a key and releases them, from the heap or from
+ * a pool
+ */
+static void DataAllocation(benchSuite &suite, bool pooled)
+{
+  const uint64_t packets = suite.Scale(1000000);
+  pipeDataPool pool(16);
+  int value;
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < packets; ++i)
+  {
+    auto data = pooled ? pool.Acquire(&value) : new pipeData(&value);
+    data->setDataKey("id", &value);
+    data->Release();
+  }
+
+  suite.Report(pooled ? "data_pool_acquire" : "data_new_delete", {}, packets, ElapsedSeconds(start));
+}
+
+/**
+ * @brief Shares a packet carrying some keys with several branches
+ */
+static void DataShare(benchSuite &suite, int branches)
+{
+  const uint64_t broadcasts = suite.Scale(500000);
+  pipeDataPool pool(64);
+  auto data = pool.Acquire(nullptr);
+  std::vector<pipeData *> views(branches);
+  int values[8];
+
+  for (int k = 0; k < 8; ++k)
+    data->setDataKey("key_" + std::to_string(k), &values[k]);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < broadcasts; ++i)
+  {
+    for (auto &view : views)
+      view = data->Share();
+    for (auto view : views)
+      view->Release();
+  }
+
+  suite.Report("data_share", {{"branches", branches}, {"keys", 8}}, broadcasts, ElapsedSeconds(start));
+  data->Release();
+}
+
+/**
+ * @brief Encodes a packet carrying some keys to the wire format, or decodes
+ * its frame
+ *
+ * @details The payload is 64 bytes and every key a double, all read in
+ * place by the decoder.
+ */
+static void DataWire(benchSuite &suite, int keys, bool decode)
+{
+  const uint64_t packets = suite.Scale(500000);
+  struct block
+  {
+    char bytes[64];
+  } payload = {};
+  double values[32] = {};
+  pipeWire wire;
+  pipeData data(&payload);
+  std::string frame;
+
+  wire.Pod<block>(1);
+  wire.Pod<double>(2);
+  wire.payload(1);
+  for (int k = 0; k < keys; ++k)
+  {
+    wire.Key("key_" + std::to_string(k), 2);
+    data.setDataKey("key_" + std::to_string(k), &values[k]);
+  }
+  wire.Serialize(&data, frame);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < packets; ++i)
+  {
+    if (decode)
+    {
+      auto copy = wire.Deserialize(frame.data(), frame.size());
+      KeepAlive(copy);
+      delete copy;
+    }
+    else
+    {
+      frame.clear();
+      wire.Serialize(&data, frame);
+      KeepAlive(&frame[0]);
+    }
+  }
+
+  suite.Report(decode ? "data_wire_decode" : "data_wire_encode", {{"keys", keys}, {"bytes", (long)frame.size()}},
+               packets, ElapsedSeconds(start));
+}
+
+/**
+ * @brief Runs the data benchmarks
+ */
+void DataBenchmarks(benchSuite &suite)
+{
+  for (bool hit : {true, false})
+  {
+    if (suite.Enabled(hit ? "data_lookup_hit" : "data_lookup_miss"))
+    {
+      for (int keys : {1, 8, 32})
+        DataLookup(suite, keys, hit);
+    }
+  }
+
+  for (bool pooled : {false, true})
+  {
+    if (suite.Enabled(pooled ? "data_pool_acquire" : "data_new_delete"))
+      DataAllocation(suite, pooled);
+  }
+
+  if (suite.Enabled("data_share"))
+  {
+    for (int branches : {2, 4, 8})
+      DataShare(suite, branches);
+  }
+
+  for (bool decode : {false, true})
+  {
+    if (suite.Enabled(decode ? "data_wire_decode" : "data_wire_encode"))
+    {
+      for (int keys : {0, 4, 16})
+        DataWire(suite, keys, decode);
+    }
+  }
+
+  for (const char *how : {"id", "name", "route"})
+  {
+    if (suite.Enabled(std::string("mapper_lookup_") + how))
+    {
+      for (int side : {2, 8, 32})
+        MapperLookup(suite, side, how);
+    }
+  }
+}
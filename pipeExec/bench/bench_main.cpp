@@ -0,0 +1,164 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file bench_main.cpp
+ *
+ * @brief The entry point of the pipeExec microbenchmarks
+ *
+ * @details Usage: pipeExec_bench [--filter substring] [--scale factor]
+ * [--out file.json]. Every run is printed as it finishes and all of them are
+ * written as JSON at the end, to stdout when no file is given.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param filter Only the benchmarks whose name contains it are run
+ * @param scale Multiplies the operations of every run
+ */
+benchSuite::benchSuite(std::string filter, double scale) : filter_(filter), scale_(scale) {}
+
+/**
+ * @brief Checks if a benchmark has to be run
+ *
+ * @param name The name of the benchmark
+ *
+ * @return True if the name contains the filter
+ */
+bool benchSuite::Enabled(const std::string &name) const
+{
+  return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+/**
+ * @brief Scales the number of operations of a run
+ *
+ * @param operations The operations at scale 1
+ *
+ * @return The operations to do, at least one
+ */
+uint64_t benchSuite::Scale(uint64_t operations) const
+{
+  uint64_t scaled = (uint64_t)(operations * scale_);
+
+  return scaled > 0 ? scaled : 1;
+}
+
+/**
+ * @brief Stores the result of a run and prints it
+ *
+ * @param name The name of the benchmark
+ * @param params The parameters of the run
+ * @param operations The operations done
+ * @param seconds The wall time of the run
+ */
+void benchSuite::Report(const std::string &name, const std::vector<param> &params, uint64_t operations, double seconds)
+{
+  std::string label = name;
+
+  for (auto &p : params)
+    label += "/" + p.first + ":" + std::to_string(p.second);
+
+  fprintf(stderr, "%-48s %12.0f ops/s %10.1f ns/op\n", label.c_str(), operations / seconds, seconds * 1e9 / operations);
+  results_.push_back({name, params, operations, seconds});
+}
+
+/**
+ * @brief Writes all the results as JSON
+ *
+ * @param out The file to write to
+ */
+void benchSuite::WriteJson(FILE *out) const
+{
+  char date[32];
+  time_t now = time(nullptr);
+
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+  fprintf(out, "{\n  \"context\": {\"date\": \"%s\", \"hardware_threads\": %u, \"scale\": %g},\n", date,
+          std::thread::hardware_concurrency(), scale_);
+  fprintf(out, "  \"benchmarks\": [");
+  for (size_t i = 0; i < results_.size(); ++i)
+  {
+    auto &r = results_[i];
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"params\": {", i ? "," : "", r.name.c_str());
+    for (size_t p = 0; p < r.params.size(); ++p)
+      fprintf(out, "%s\"%s\": %ld", p ? ", " : "", r.params[p].first.c_str(), r.params[p].second);
+    fprintf(out, "}, \"iterations\": %lu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"ns_per_op\": %.2f}",
+            (unsigned long)r.operations, r.seconds, r.operations / r.seconds, r.seconds * 1e9 / r.operations);
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+  std::string filter;
+  double scale = 1.0;
+  const char *out_file = nullptr;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+      filter = argv[++i];
+    else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+      scale = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc)
+      out_file = argv[++i];
+    else
+    {
+      fprintf(stderr, "Usage: %s [--filter substring] [--scale factor] [--out file.json]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  benchSuite suite(filter, scale);
+
+  QueueBenchmarks(suite);
+  DataBenchmarks(suite);
+  TopologyBenchmarks(suite);
+
+  FILE *out = out_file ? fopen(out_file, "w") : stdout;
+  if (out == nullptr)
+  {
+    perror(out_file);
+    return 1;
+  }
+  suite.WriteJson(out);
+  if (out != stdout)
+    fclose(out);
+
+  // The topologies never stop their threads, so leave without unwinding them
+  fflush(stdout);
+  _exit(0);
+}
@@ -0,0 +1,205 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file bench_queue.cpp
+ *
+ * @brief Benchmarks of the pipeQueue and the Semaphore
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "bench.h"
+#include "pipeQueue.h"
+#include "pipeSpill.h"
+
+#include <cstring>
+#include <deque>
+#include <thread>
+
+/**
+ * @brief Producers push into a queue while consumers pop from it
+ *
+ * @details Every producer pushes the same share of the items and every
+ * consumer pops its share, so all the threads finish together.
+ */
+static void QueuePushPop(benchSuite &suite, int producers, int consumers, int capacity)
+{
+  const uint64_t items = suite.Scale(400000) / (producers * consumers) * (producers * consumers);
+  pipeQueue queue(capacity);
+  std::vector<std::thread> threads;
+  int token;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int p = 0; p < producers; ++p)
+  {
+    threads.emplace_back([&]() {
+      for (uint64_t i = 0; i < items / producers; ++i)
+        queue.Push(&token);
+    });
+  }
+  for (int c = 0; c < consumers; ++c)
+  {
+    threads.emplace_back([&]() {
+      for (uint64_t i = 0; i < items / consumers; ++i)
+        queue.Pop();
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+
+  suite.Report("queue_push_pop", {{"producers", producers}, {"consumers", consumers}, {"capacity", capacity}}, items,
+               ElapsedSeconds(start));
+}
+
+/**
+ * @brief One producer spreads its pushes over the lanes of a queue while one
+ * consumer pops them
+ */
+static void QueueLanes(benchSuite &suite, int lanes)
+{
+  const uint64_t items = suite.Scale(400000);
+  pipeQueue queue(1024);
+  int token;
+
+  queue.lanes(lanes);
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    for (uint64_t i = 0; i < items; ++i)
+      queue.Push(&token, (int)(i % lanes));
+  });
+  for (uint64_t i = 0; i < items; ++i)
+    queue.Pop();
+  producer.join();
+
+  suite.Report("queue_lanes", {{"lanes", lanes}}, items, ElapsedSeconds(start));
+}
+
+/**
+ * @brief One producer pushes bursts far larger than a small queue while one
+ * consumer pops them, with and without a spill
+ *
+ * @details Without the spill the producer waits for the consumer, with it
+ * the bursts go to the segment file and come back in order.
+ */
+static void QueueSpill(benchSuite &suite, bool spilled, int payload)
+{
+  const uint64_t items = suite.Scale(100000);
+  pipeQueue queue(64);
+  std::deque<pipeData> packets;
+  pipeSpill spill(
+      "/tmp/pipeExec_bench.spill",
+      [payload](pipeData *data, std::string &out) {
+        uint64_t index = data->sequence();
+        out.append((const char *)&index, sizeof(index));
+        out.append(payload, 'x');
+      },
+      [&packets](const char *bytes, size_t) {
+        uint64_t index;
+        memcpy(&index, bytes, sizeof(index));
+        packets[index - 1].Retain();
+        return &packets[index - 1];
+      });
+
+  // The packets live in the deque, releasing them must not delete them
+  for (uint64_t i = 0; i < items; ++i)
+  {
+    packets.emplace_back(nullptr);
+    packets.back().release_hook([](pipeData *, void *) {}, nullptr);
+  }
+
+  if (spilled)
+    queue.spill(&spill);
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    for (uint64_t i = 0; i < items; ++i)
+    {
+      packets[i].sequence(i + 1);
+      queue.Push(&packets[i]);
+    }
+  });
+  for (uint64_t i = 0; i < items; ++i)
+    queue.Pop();
+  producer.join();
+
+  suite.Report("queue_spill", {{"spill", spilled ? 1 : 0}, {"payload", payload}}, items, ElapsedSeconds(start));
+}
+
+/**
+ * @brief Two threads hand a token back and forth with a pair of semaphores
+ *
+ * @details Every operation is a full round trip, so it measures the wake up
+ * latency of the Semaphore rather than its throughput.
+ */
+static void SemaphorePingPong(benchSuite &suite)
+{
+  const uint64_t rounds = suite.Scale(100000);
+  Semaphore ping(0), pong(0);
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread partner([&]() {
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+      ping.Wait();
+      pong.Signal();
+    }
+  });
+  for (uint64_t i = 0; i < rounds; ++i)
+  {
+    ping.Signal();
+    pong.Wait();
+  }
+  partner.join();
+
+  suite.Report("semaphore_ping_pong", {}, rounds, ElapsedSeconds(start));
+}
+
+/**
+ * @brief Runs the queue benchmarks
+ */
+void QueueBenchmarks(benchSuite &suite)
+{
+  if (suite.Enabled("queue_push_pop"))
+  {
+    for (int capacity : {16, 1024})
+      for (int producers : {1, 2, 4})
+        for (int consumers : {1, 2, 4})
+          QueuePushPop(suite, producers, consumers, capacity);
+  }
+
+  if (suite.Enabled("queue_lanes"))
+  {
+    for (int lanes : {1, 2, 8})
+      QueueLanes(suite, lanes);
+  }
+
+  if (suite.Enabled("queue_spill"))
+  {
+    for (bool spilled : {false, true})
+      for (int payload : {64, 4096})
+        QueueSpill(suite, spilled, payload);
+  }
+
+  if (suite.Enabled("semaphore_ping_pong"))
+    SemaphorePingPong(suite);
+}
@@ -0,0 +1,372 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file bench_topology.cpp
+ *
+ * @brief End to end throughput of Pipeline, Mesh, Cube and Dag with NullUnit
+ * nodes, of the Resequencer after a node with many instances, of the
+ * dispatch policies of the distributer with uneven rows and of a node waiting
+ * on every packet, blocking, async or, built with PIPEEXEC_COROUTINES, as a
+ * coroutine
+ *
+ * @details The packets are preallocated in a pool. A feeder thread takes them
+ * from the pool and sends them into the topology while the benchmark thread
+ * pops them from the output and gives them back to the pool, so only the cost
+ * of the framework is measured. The topologies can not be stopped, so they are
+ * left running when the benchmark finishes.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "bench.h"
+#include "async_sleeper.h"
+#include "dag.h"
+#include "distributer.h"
+#include "distributerCube.h"
+#include "null_unit.h"
+#include "resequencer.h"
+#include "sleeper.h"
+
+#include <functional>
+#include <thread>
+
+#ifdef PIPEEXEC_COROUTINES
+#include "coroutine_unit.h"
+#endif
+
+static const int kPoolSize = 256; /**< Packets in flight at most */
+static const int kQueueSize = 64; /**< Size of the queues of the nodes */
+
+/**
+ * @brief Feeds the packets of the pool through a topology and times it
+ *
+ * @param send Sends a packet into the topology
+ * @param output The queue the packets leave the topology through
+ * @param packets The number of packets to send
+ * @param received Called with every packet that leaves the topology
+ *
+ * @return The seconds taken
+ */
+static double Drive(const std::function<void(pipeData *)> &send, pipeQueue *output, uint64_t packets,
+                    const std::function<void(pipeData *)> &received = nullptr)
+{
+  pipeQueue pool(kPoolSize);
+
+  for (int i = 0; i < kPoolSize; ++i)
+    pool.Push(new pipeData(nullptr));
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread feeder([&]() {
+    for (uint64_t i = 0; i < packets; ++i)
+      send((pipeData *)pool.Pop());
+  });
+  for (uint64_t i = 0; i < packets; ++i)
+  {
+    auto data = (pipeData *)output->Pop();
+    if (received)
+      received(data);
+    pool.Push(data);
+  }
+  double seconds = ElapsedSeconds(start);
+  feeder.join();
+
+  // The queue frees what it holds with free(), so empty it first
+  for (int i = 0; i < kPoolSize; ++i)
+    delete (pipeData *)pool.Pop();
+
+  return seconds;
+}
+
+/**
+ * @brief A Pipeline of NullUnit stages
+ */
+static void PipelineThroughput(benchSuite &suite, int stages, int instances)
+{
+  auto in = new pipeQueue(kQueueSize);
+  auto out = new pipeQueue(kPoolSize);
+  auto pipe = new Pipeline(new NullUnit, in, out, instances, nullptr);
+
+  for (int s = 1; s < stages; ++s)
+    pipe->AddProcessingUnit(new NullUnit, instances, nullptr, kQueueSize);
+  pipe->RunPipe();
+
+  uint64_t packets = suite.Scale(200000);
+  double seconds = Drive([in](pipeData *data) { in->Push(data); }, out, packets);
+
+  suite.Report("pipeline_throughput", {{"stages", stages}, {"instances", instances}}, packets, seconds);
+}
+
+/**
+ * @brief A Mesh of rows of NullUnit stages fed by a distributer
+ */
+static void MeshThroughput(benchSuite &suite, unsigned int rows, unsigned int stages)
+{
+  auto mesh = new Mesh(rows, stages, kQueueSize);
+  std::vector<unsigned int> inputs;
+
+  for (unsigned int x = 0; x < rows; ++x)
+  {
+    inputs.push_back(x);
+    for (unsigned int y = 0; y < stages; ++y)
+      mesh->AddProcessingUnit(new NullUnit, 1, x, y);
+  }
+  auto dist = new distributer(mesh, new pipeQueue(kQueueSize), inputs);
+  mesh->RunMesh();
+
+  uint64_t packets = suite.Scale(200000);
+  double seconds = Drive([dist](pipeData *data) { dist->send(data); }, mesh->out_queue(), packets);
+
+  suite.Report("mesh_throughput", {{"rows", rows}, {"stages", stages}}, packets, seconds);
+}
+
+/**
+ * @brief A Cube of rows of NullUnit stages fed by a distributerCube
+ */
+static void CubeThroughput(benchSuite &suite, unsigned int side, unsigned int stages)
+{
+  auto cube = new Cube(side, side, stages, kQueueSize);
+  std::vector<distributerCube::inputMesh> inputs;
+
+  for (unsigned int x = 0; x < side; ++x)
+  {
+    for (unsigned int y = 0; y < side; ++y)
+    {
+      inputs.push_back({x, y});
+      for (unsigned int z = 0; z < stages; ++z)
+        cube->AddProcessingUnit(new NullUnit, 1, x, y, z);
+    }
+  }
+  auto dist = new distributerCube(cube, new pipeQueue(kQueueSize), inputs);
+  cube->RunCube();
+
+  uint64_t packets = suite.Scale(200000);
+  double seconds = Drive([dist](pipeData *data) { dist->send(data); }, cube->out_queue(), packets);
+
+  suite.Report("cube_throughput", {{"side", side}, {"stages", stages}}, packets, seconds);
+}
+
+/**
+ * @brief A Mesh whose first row is much slower than the others, fed with the
+ * given dispatch policy
+ */
+static void DispatchThroughput(benchSuite &suite, const char *name, dispatcher::policy policy)
+{
+  static int slow_ticks = 8, fast_ticks = 1;
+  const unsigned int rows = 4;
+  auto mesh = new Mesh(rows, 1, 8);
+  std::vector<unsigned int> inputs;
+
+  for (unsigned int x = 0; x < rows; ++x)
+  {
+    inputs.push_back(x);
+    mesh->AddProcessingUnit(new Sleeper(std::chrono::microseconds(100)), 1, x, 0, x == 0 ? &slow_ticks : &fast_ticks);
+  }
+  auto dist = new distributer(mesh, new pipeQueue(kQueueSize), inputs, policy);
+  mesh->RunMesh();
+
+  uint64_t packets = suite.Scale(4000);
+  double seconds = Drive([dist](pipeData *data) { dist->send(data); }, mesh->out_queue(), packets);
+
+  suite.Report(name, {{"rows", rows}, {"slow_row_share_pct", (long)(dist->dispatch().sent(0) * 100 / packets)}}, packets,
+               seconds);
+}
+
+/**
+ * @brief A Dag broadcasting every packet to some branches joined at the end
+ */
+static void DagThroughput(benchSuite &suite, int branches)
+{
+  auto dag = new Dag(kQueueSize);
+
+  dag->AddProcessingUnit(new NullUnit, 1, "source");
+  dag->AddProcessingUnit(new NullUnit, 1, "join", nullptr, branches > 1);
+  for (int b = 0; b < branches; ++b)
+  {
+    auto name = "branch_" + std::to_string(b);
+    dag->AddProcessingUnit(new NullUnit, 1, name);
+    dag->AddEdge("source", name);
+    dag->AddEdge(name, "join");
+  }
+  dag->RunDag();
+
+  uint64_t packets = suite.Scale(100000);
+  double seconds = Drive([dag](pipeData *data) { dag->send(data); }, dag->out_queue(), packets);
+
+  suite.Report("dag_throughput", {{"branches", branches}}, packets, seconds);
+}
+
+/**
+ * @brief A node with many instances followed, or not, by a Resequencer
+ */
+static void ResequencerThroughput(benchSuite &suite, int instances, bool resequence)
+{
+  auto in = new pipeQueue(kQueueSize);
+  auto out = new pipeQueue(kPoolSize);
+  auto pipe = new Pipeline(new NullUnit, in, out, instances, nullptr);
+  auto resequencer = new Resequencer(kPoolSize);
+
+  if (resequence)
+    pipe->AddProcessingUnit(resequencer, 1, nullptr, kQueueSize);
+  pipe->RunPipe();
+
+  uint64_t packets = suite.Scale(200000);
+  uint64_t last = 0;
+  long out_of_order = 0;
+  double seconds = Drive(
+      [in, resequencer](pipeData *data) {
+        resequencer->Stamp(data);
+        in->Push(data);
+      },
+      out, packets,
+      [&](pipeData *data) {
+        if (data->sequence() < last)
+          ++out_of_order;
+        last = data->sequence();
+      });
+
+  suite.Report(resequence ? "resequencer_throughput" : "unordered_throughput",
+               {{"instances", instances}, {"out_of_order", out_of_order}}, packets, seconds);
+}
+
+/**
+ * @brief A node waiting 1 ms on every packet, as a Sleeper blocking its
+ * instances or as an AsyncSleeper keeping the packets in flight
+ */
+static void SleeperThroughput(benchSuite &suite, bool async, int instances)
+{
+  static int ticks = 10;
+  auto in = new pipeQueue(kQueueSize);
+  auto out = new pipeQueue(kPoolSize);
+  auto tick = std::chrono::microseconds(100);
+  ProcessingUnitInterface *unit = async ? (ProcessingUnitInterface *)new AsyncSleeper(tick, kPoolSize) : new Sleeper(tick);
+  auto pipe = new Pipeline(unit, in, out, instances, &ticks);
+  pipe->RunPipe();
+
+  uint64_t packets = suite.Scale(async ? 20000 : 2000);
+  double seconds = Drive([in](pipeData *data) { in->Push(data); }, out, packets);
+
+  suite.Report(async ? "sleeper_async" : "sleeper_blocking", {{"instances", instances}}, packets, seconds);
+}
+
+#ifdef PIPEEXEC_COROUTINES
+/**
+ * @brief Waits 1 ms on every packet with co_await
+ */
+class CoroutineSleeper : public CoroutineUnit
+{
+public:
+  CoroutineSleeper() : CoroutineUnit(kPoolSize) {}
+
+  ProcessingUnitInterface *Clone() override { return new CoroutineSleeper; }
+
+protected:
+  pipeTask Process(pipeData *) override
+  {
+    co_await Sleep(std::chrono::milliseconds(1));
+    co_return true;
+  }
+};
+
+/**
+ * @brief The node of SleeperThroughput with a coroutine unit
+ */
+static void CoroutineThroughput(benchSuite &suite, int instances)
+{
+  auto in = new pipeQueue(kQueueSize);
+  auto out = new pipeQueue(kPoolSize);
+  auto pipe = new Pipeline(new CoroutineSleeper, in, out, instances, nullptr);
+  pipe->RunPipe();
+
+  uint64_t packets = suite.Scale(20000);
+  double seconds = Drive([in](pipeData *data) { in->Push(data); }, out, packets);
+
+  suite.Report("sleeper_coroutine", {{"instances", instances}}, packets, seconds);
+}
+#endif
+
+/**
+ * @brief Runs the topology benchmarks
+ */
+void TopologyBenchmarks(benchSuite &suite)
+{
+  if (suite.Enabled("pipeline_throughput"))
+  {
+    for (int stages : {1, 4, 8})
+      PipelineThroughput(suite, stages, 1);
+    PipelineThroughput(suite, 4, 2);
+  }
+
+  if (suite.Enabled("mesh_throughput"))
+  {
+    MeshThroughput(suite, 1, 4);
+    MeshThroughput(suite, 2, 4);
+    MeshThroughput(suite, 4, 2);
+  }
+
+  if (suite.Enabled("cube_throughput"))
+  {
+    CubeThroughput(suite, 1, 4);
+    CubeThroughput(suite, 2, 2);
+  }
+
+  if (suite.Enabled("dag_throughput"))
+  {
+    for (int branches : {1, 2, 4})
+      DagThroughput(suite, branches);
+  }
+
+  for (bool resequence : {false, true})
+  {
+    if (suite.Enabled(resequence ? "resequencer_throughput" : "unordered_throughput"))
+    {
+      for (int instances : {1, 8, 32})
+        ResequencerThroughput(suite, instances, resequence);
+    }
+  }
+
+  const std::pair<const char *, dispatcher::policy> policies[] = {
+      {"dispatch_round_robin", dispatcher::kRoundRobin}, {"dispatch_least_loaded", dispatcher::kLeastLoaded},
+      {"dispatch_power_of_two", dispatcher::kPowerOfTwo}, {"dispatch_weighted", dispatcher::kWeighted},
+      {"dispatch_try_next", dispatcher::kTryNext}};
+
+  for (auto &p : policies)
+  {
+    if (suite.Enabled(p.first))
+      DispatchThroughput(suite, p.first, p.second);
+  }
+
+  if (suite.Enabled("sleeper_blocking"))
+  {
+    for (int instances : {1, 8, 32})
+      SleeperThroughput(suite, false, instances);
+  }
+
+  if (suite.Enabled("sleeper_async"))
+    SleeperThroughput(suite, true, 1);
+
+#ifdef PIPEEXEC_COROUTINES
+  if (suite.Enabled("sleeper_coroutine"))
+    CoroutineThroughput(suite, 1);
+#endif
+}
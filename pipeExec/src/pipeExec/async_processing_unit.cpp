@@ -0,0 +1,232 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file async_processing_unit.cpp
+ *
+ * @brief The source file for the AsyncProcessingUnit class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "async_processing_unit.h"
+
+#include <stdexcept>
+#include <vector>
+
+static const std::chrono::microseconds kPollPeriod(100); /**< How often a full unit polls */
+
+/**
+ * @brief Constructor
+ *
+ * @param maxInFlight The most packets an instance keeps in flight
+ * @param ordered True to route the packets in the order they were run, false
+ * to route every one as soon as it completes
+ *
+ * @throws std::invalid_argument if the limit is 0
+ */
+AsyncProcessingUnit::AsyncProcessingUnit(unsigned int maxInFlight, bool ordered)
+    : max_in_flight_(maxInFlight), ordered_(ordered), first_ticket_(0), next_ticket_(0), draining_(false),
+      in_flight_(0), completed_(0)
+{
+  if (maxInFlight == 0)
+  {
+    throw std::invalid_argument("An async unit needs room for a packet.");
+  }
+}
+
+AsyncProcessingUnit::~AsyncProcessingUnit() {}
+
+/**
+ * @brief Sets the most packets in flight
+ *
+ * @param maxInFlight The limit, it applies to the packets run from now on
+ *
+ * @throws std::invalid_argument if the limit is 0
+ */
+void AsyncProcessingUnit::max_in_flight(unsigned int maxInFlight)
+{
+  if (maxInFlight == 0)
+  {
+    throw std::invalid_argument("An async unit needs room for a packet.");
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_in_flight_ = maxInFlight;
+}
+
+/**
+ * @brief Waits, polling, until fewer packets than the given are in flight
+ *
+ * @param limit 1 to wait for every packet
+ */
+void AsyncProcessingUnit::WaitFor(unsigned int limit)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (in_flight_ >= limit)
+  {
+    lock.unlock();
+    Poll();
+    lock.lock();
+    room_.wait_for(lock, kPollPeriod, [this, limit]() { return in_flight_ < limit; });
+  }
+}
+
+/**
+ * @brief Holds the packet and starts it
+ *
+ * @param data The packet
+ */
+void AsyncProcessingUnit::Run(pipeData::dataPacket data)
+{
+  auto pData = (pipeData *)data;
+
+  Hold(data);
+  WaitFor(max_in_flight_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ordered_)
+    {
+      tickets_[pData] = next_ticket_++;
+      flights_.push_back({pData, false, true});
+    }
+    ++in_flight_;
+  }
+
+  Start(pData);
+  Poll();
+}
+
+/**
+ * @brief Reaps the completions while no packet comes
+ */
+void AsyncProcessingUnit::Tick() { Poll(); }
+
+/**
+ * @brief Waits for every packet in flight to be routed
+ *
+ * @param data The packet of the last Run, unused
+ */
+void AsyncProcessingUnit::End(pipeData::dataPacket /* data */) { WaitFor(1); }
+
+/**
+ * @brief Finishes a packet started
+ *
+ * @details Can be called from any thread, also from Start itself. An ordered
+ * unit keeps the packet until the ones run before it are done; the thread
+ * that completes the first of them routes all that are ready.
+ *
+ * @param data The packet
+ * @param forward True to route it, false to release it
+ *
+ * @throws std::logic_error if the packet is not in flight in this instance
+ */
+void AsyncProcessingUnit::Complete(pipeData *data, bool forward)
+{
+  if (ordered_)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto ticket = tickets_.find(data);
+      if (ticket == tickets_.end())
+      {
+        throw std::logic_error("The packet completed is not in flight.");
+      }
+      flights_[ticket->second - first_ticket_] = {data, true, forward};
+      tickets_.erase(ticket);
+
+      // The thread routing already will see it
+      if (draining_)
+      {
+        return;
+      }
+      draining_ = true;
+    }
+    Drain();
+    return;
+  }
+
+  if (forward)
+  {
+    Emit(data);
+  }
+  else
+  {
+    data->Release();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --in_flight_;
+  }
+  completed_.fetch_add(1, std::memory_order_relaxed);
+  room_.notify_all();
+}
+
+/**
+ * @brief Routes the packets done that were run before any not done
+ *
+ * @details Routing can block on a full queue, so it is done without the lock
+ * and only by one thread at a time, which keeps the order.
+ */
+void AsyncProcessingUnit::Drain()
+{
+  std::vector<flight> ready;
+
+  while (true)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (!flights_.empty() && flights_.front().done)
+      {
+        ready.push_back(flights_.front());
+        flights_.pop_front();
+        ++first_ticket_;
+      }
+      if (ready.empty())
+      {
+        draining_ = false;
+        return;
+      }
+    }
+
+    for (auto &it : ready)
+    {
+      if (it.forward)
+      {
+        Emit(it.data);
+      }
+      else
+      {
+        it.data->Release();
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      in_flight_ -= ready.size();
+    }
+    completed_.fetch_add(ready.size(), std::memory_order_relaxed);
+    room_.notify_all();
+    ready.clear();
+  }
+}
@@ -0,0 +1,126 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file async_processing_unit.h
+ *
+ * @brief The header file for the AsyncProcessingUnit class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "processing_unit_interface.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * @class AsyncProcessingUnit
+ *
+ * @brief A processing unit whose packets complete after Run has returned
+ *
+ * @details Run holds the packet and hands it to Start, which begins the work
+ * and returns at once. The work ends with Complete, from any thread, e.g. the
+ * callback of a client library. So one instance keeps many packets in flight
+ * instead of one thread blocked per packet. When the limit of packets in
+ * flight is reached, Run waits for a completion, which holds the node back as
+ * a slow unit would.
+ *
+ * The completed packets are routed by the node as any other, in the order
+ * they were run unless the unit is unordered. Units with a completion queue
+ * of their own, e.g. a pipeUring, reap it in Poll, which the instance calls
+ * after every Start, while it waits for room and on the housekeeping ticks of
+ * the node.
+ *
+ * Every instance has its own packets in flight; End waits for them.
+ */
+class AsyncProcessingUnit : public ProcessingUnitInterface
+{
+public:
+  // Constructor. The most packets in flight and whether they leave in order
+  AsyncProcessingUnit(unsigned int = 256, bool = true);
+
+  virtual ~AsyncProcessingUnit();
+
+  // Holds the packet and starts it, waiting for room first
+  void Run(pipeData::dataPacket) override;
+
+  // Reaps the completions while the node is idle
+  void Tick() override;
+
+  // Waits for the packets in flight
+  void End(pipeData::dataPacket = nullptr) override;
+
+  // Finishes a packet. False drops it instead of routing it
+  void Complete(pipeData *, bool = true);
+
+  // Getter. Returns the packets in flight
+  unsigned int in_flight() const { return in_flight_.load(); };
+
+  // Getter. Returns the packets completed
+  uint64_t completed() const { return completed_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the most packets in flight
+  unsigned int max_in_flight() const { return max_in_flight_; };
+
+  // Setter. Sets the most packets in flight
+  void max_in_flight(unsigned int);
+
+protected:
+  // Begins the work of a packet, which has to end with Complete
+  virtual void Start(pipeData *) = 0;
+
+  // Reaps the completion queue of the unit, if it has one
+  virtual void Poll() { return; };
+
+private:
+  /**
+   * @brief A packet started
+   */
+  struct flight
+  {
+    pipeData *data;  /**< The packet */
+    bool done;       /**< Complete was called */
+    bool forward;    /**< It is routed, not dropped */
+  };
+
+  void WaitFor(unsigned int);
+  void Drain();
+
+  unsigned int max_in_flight_;     /**< The most packets in flight */
+  bool ordered_;                   /**< Packets leave in the order they ran */
+  std::mutex mutex_;               /**< Guards the packets in flight */
+  std::condition_variable room_;   /**< Signaled when packets leave */
+  std::deque<flight> flights_;     /**< The packets in the order they ran */
+  std::unordered_map<pipeData *, uint64_t> tickets_; /**< The place of every packet */
+  uint64_t first_ticket_;          /**< The ticket of the first in flights_ */
+  uint64_t next_ticket_;           /**< The ticket of the next one run */
+  bool draining_;                  /**< A thread is routing the packets done */
+  std::atomic<unsigned int> in_flight_; /**< Packets started and not gone */
+  std::atomic<uint64_t> completed_;     /**< Packets gone */
+};
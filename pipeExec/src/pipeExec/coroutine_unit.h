@@ -0,0 +1,361 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file coroutine_unit.h
+ *
+ * @brief The header file for the CoroutineUnit class, which needs C++20
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine_unit.h needs the C++20 coroutines, build with -std=c++20"
+#endif
+
+#include "async_processing_unit.h"
+#include "pipe_node.h"
+#include "pipeQueue.h"
+#include "pipeUring.h"
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <queue>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+class CoroutineUnit;
+
+/**
+ * @class pipeTask
+ *
+ * @brief What the Process coroutine of a CoroutineUnit returns
+ *
+ * @details The coroutine starts suspended and is resumed by its unit. When it
+ * ends its packet completes: co_return true routes it, co_return false drops
+ * it, and so does an exception leaving the coroutine, counted in failed().
+ */
+class pipeTask
+{
+public:
+  /**
+   * @brief The promise of the coroutine, with the packet it processes
+   */
+  struct promise_type
+  {
+    CoroutineUnit *unit = nullptr; /**< The instance running it */
+    pipeData *data = nullptr;      /**< The packet */
+    bool forward = true;           /**< The packet is routed at the end */
+    bool failed = false;           /**< It ended with an exception */
+
+    /**
+     * @brief Completes the packet once the coroutine is done with it
+     */
+    struct finish
+    {
+      bool await_ready() noexcept { return false; };
+      void await_suspend(std::coroutine_handle<promise_type>) noexcept;
+      void await_resume() noexcept {};
+    };
+
+    pipeTask get_return_object() { return pipeTask(std::coroutine_handle<promise_type>::from_promise(*this)); };
+    std::suspend_always initial_suspend() noexcept { return {}; };
+    finish final_suspend() noexcept { return {}; };
+    void return_value(bool route) { forward = route; };
+    void unhandled_exception() { forward = false, failed = true; };
+  };
+
+  // Takes the coroutine, which the unit then runs and destroys
+  explicit pipeTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {};
+
+  // Getter. Returns the coroutine
+  std::coroutine_handle<promise_type> handle() const { return handle_; };
+
+private:
+  std::coroutine_handle<promise_type> handle_; /**< The coroutine */
+};
+
+/**
+ * @class CoroutineUnit
+ *
+ * @brief An async unit whose packets are processed by a coroutine
+ *
+ * @details Process is a coroutine that can co_await a time, a push to a queue
+ * that may be full and the reads and writes of files, written as straight
+ * code instead of a state machine. Every instance resumes its coroutines on
+ * its own worker thread, in Poll: after every packet it starts, while it
+ * waits for room for more and on the housekeeping ticks of the node, so they
+ * share no state with other threads. A node without housekeeping is given the
+ * resume tick, so the coroutines go on while no packet comes; it is also the
+ * resolution of the sleeps then.
+ *
+ * The reads and writes go through an io_uring of the instance, or are done at
+ * once when there is none. It is header only, so only the units using it are
+ * built with C++20; the other units are not affected.
+ */
+class CoroutineUnit : public AsyncProcessingUnit
+{
+public:
+  // Constructor. The most packets in flight, their order and the resume tick
+  CoroutineUnit(unsigned int maxInFlight = 256, bool ordered = true,
+                std::chrono::microseconds resumeTick = std::chrono::microseconds(200))
+      : AsyncProcessingUnit(maxInFlight, ordered), resume_tick_(resumeTick), ring_(nullptr), no_ring_(false),
+        io_waiting_(0), failed_(0) {};
+
+  // Destructor. Destroys the coroutines still waiting, their packets are lost.
+  // The reads and writes in flight are waited for first, as they fill the
+  // buffers of their coroutines
+  ~CoroutineUnit()
+  {
+    uint64_t user;
+    int result;
+    while (io_waiting_ > 0 && ring_->Wait(user, result))
+    {
+      io_waiting_--;
+      ((ioAwait *)user)->handle.destroy();
+    }
+    while (!timers_.empty())
+    {
+      timers_.top().second.destroy();
+      timers_.pop();
+    }
+    for (auto &push : pushes_)
+    {
+      push.handle.destroy();
+    }
+    delete ring_;
+  };
+
+  // Getter. Returns the packets dropped by an exception
+  uint64_t failed() const { return failed_; };
+
+  // Ends the packet of a coroutine done, called by its promise
+  void Finish(pipeData *data, bool forward, bool failed)
+  {
+    failed_ += failed;
+    Complete(data, forward);
+  };
+
+protected:
+  // Processes a packet. co_return true to route it, false to drop it
+  virtual pipeTask Process(pipeData *) = 0;
+
+  /**
+   * @brief Waits until a point in time
+   */
+  struct sleepAwait
+  {
+    CoroutineUnit *unit;                            /**< The instance */
+    std::chrono::steady_clock::time_point due;      /**< When to go on */
+
+    bool await_ready() const { return due <= std::chrono::steady_clock::now(); };
+    void await_suspend(std::coroutine_handle<> handle) { unit->timers_.push({due, handle}); };
+    void await_resume() {};
+  };
+
+  /**
+   * @brief Waits for room in a queue and pushes
+   */
+  struct pushAwait
+  {
+    CoroutineUnit *unit; /**< The instance */
+    pipeQueue *queue;    /**< Where to push */
+    void *data;          /**< What */
+    int priority;        /**< To which lane */
+    std::coroutine_handle<> handle; /**< The coroutine waiting */
+
+    bool await_ready() { return unit->pushes_.empty() && queue->TryPush(data, priority); };
+    void await_suspend(std::coroutine_handle<> waiting)
+    {
+      handle = waiting;
+      unit->pushes_.push_back(*this);
+    };
+    void await_resume() {};
+  };
+
+  /**
+   * @brief Waits for a read or a write. Gives its result, -errno if it failed
+   */
+  struct ioAwait
+  {
+    CoroutineUnit *unit; /**< The instance */
+    bool write;          /**< A write, not a read */
+    int fd;              /**< The file */
+    void *buffer;        /**< The bytes */
+    size_t size;         /**< How many */
+    uint64_t offset;     /**< Where in the file */
+    int result = 0;      /**< The bytes read or written */
+    std::coroutine_handle<> handle; /**< The coroutine waiting */
+
+    bool await_ready() { return false; };
+    bool await_suspend(std::coroutine_handle<> waiting)
+    {
+      handle = waiting;
+      if (unit->Submit(this))
+        return true;
+
+      // No io_uring, or no room in it: done at once
+      ssize_t done = write ? pwrite(fd, buffer, size, offset) : pread(fd, buffer, size, offset);
+      result = done < 0 ? -errno : (int)done;
+      return false;
+    };
+    int await_resume() { return result; };
+  };
+
+  // Waits for some time
+  sleepAwait Sleep(std::chrono::nanoseconds time)
+  {
+    return {this, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(time)};
+  };
+
+  // Waits for room in a queue and pushes a packet to it
+  pushAwait Push(pipeQueue *queue, void *data, int priority = 0) { return {this, queue, data, priority, nullptr}; };
+
+  // Writes to a file
+  ioAwait Write(int fd, const void *buffer, size_t size, uint64_t offset)
+  {
+    return {this, true, fd, const_cast<void *>(buffer), size, offset, 0, {}};
+  };
+
+  // Reads from a file
+  ioAwait Read(int fd, void *buffer, size_t size, uint64_t offset) { return {this, false, fd, buffer, size, offset, 0, {}}; };
+
+  /**
+   * @brief Runs the coroutine of a packet until it first waits
+   *
+   * @param data The packet
+   */
+  void Start(pipeData *data) final
+  {
+    auto node = data->getNodeData();
+    if (node != nullptr && node->housekeeping().count() == 0)
+      node->housekeeping(resume_tick_);
+
+    auto handle = Process(data).handle();
+    handle.promise().unit = this;
+    handle.promise().data = data;
+    handle.resume();
+  };
+
+  /**
+   * @brief Resumes the coroutines whose time has come, whose push has room
+   * and whose read or write is done
+   */
+  void Poll() override
+  {
+    auto now = std::chrono::steady_clock::now();
+    while (!timers_.empty() && timers_.top().first <= now)
+    {
+      auto handle = timers_.top().second;
+      timers_.pop();
+      handle.resume();
+    }
+
+    // In the order they waited, so the packets keep their order in the queues
+    while (!pushes_.empty() && pushes_.front().queue->TryPush(pushes_.front().data, pushes_.front().priority))
+    {
+      auto handle = pushes_.front().handle;
+      pushes_.pop_front();
+      handle.resume();
+    }
+
+    uint64_t user;
+    int result;
+    while (ring_ != nullptr && ring_->Peek(user, result))
+    {
+      io_waiting_--;
+      auto io = (ioAwait *)user;
+      io->result = result;
+      io->handle.resume();
+    }
+  };
+
+private:
+  using timer = std::pair<std::chrono::steady_clock::time_point, std::coroutine_handle<>>;
+
+  /**
+   * @brief Puts the soonest timer on top
+   */
+  struct later
+  {
+    bool operator()(const timer &a, const timer &b) const { return a.first > b.first; };
+  };
+
+  /**
+   * @brief Hands a read or a write to the io_uring, set up the first time
+   *
+   * @return False if there is no io_uring or it is full
+   */
+  bool Submit(ioAwait *io)
+  {
+    if (ring_ == nullptr && !no_ring_)
+    {
+      try
+      {
+        ring_ = new pipeUring(max_in_flight());
+      }
+      catch (const std::runtime_error &)
+      {
+        no_ring_ = true;
+      }
+    }
+    if (ring_ == nullptr)
+      return false;
+
+    bool prepared = io->write ? ring_->Write(io->fd, io->buffer, io->size, io->offset, -1, (uint64_t)io)
+                              : ring_->Read(io->fd, io->buffer, io->size, io->offset, (uint64_t)io);
+    if (!prepared || ring_->Submit() < 0)
+      return false;
+    io_waiting_++;
+    return true;
+  };
+
+  std::chrono::microseconds resume_tick_;                           /**< The housekeeping given to the node */
+  std::priority_queue<timer, std::vector<timer>, later> timers_;    /**< The coroutines sleeping */
+  std::deque<pushAwait> pushes_;                                    /**< The coroutines waiting for room */
+  pipeUring *ring_;                                                 /**< The reads and writes, nullptr until used */
+  bool no_ring_;                                                    /**< io_uring is not available */
+  unsigned int io_waiting_;                                         /**< The coroutines waiting for the io_uring */
+  uint64_t failed_;                                                 /**< Packets dropped by an exception */
+};
+
+/**
+ * @brief Destroys the coroutine and completes its packet
+ *
+ * @param handle The coroutine done
+ */
+inline void pipeTask::promise_type::finish::await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+{
+  auto &promise = handle.promise();
+  auto unit = promise.unit;
+  auto data = promise.data;
+  bool forward = promise.forward, failed = promise.failed;
+
+  handle.destroy();
+  unit->Finish(data, forward, failed);
+}
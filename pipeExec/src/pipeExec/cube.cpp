@@ -1,8 +1,8 @@
 #include "cube.h"
+#include "pipeLogger.h"
 
 #include <cstdio>
 #include <string>
-#include <iostream>
 
 /**
  * @brief Default destructor for the Cube.
@@ -71,6 +71,13 @@ Cube::Cube(unsigned int xRange, unsigned int yRange, unsigned int zRange, unsign
   zRange_ = zRange;
 
   out_queue(new pipeQueue(queueSize));
+
+  // Closed without an exit, every packet makes a single lap
+  closed_ = closed;
+  if (closed_)
+  {
+    loop(1u);
+  }
 }
 
 /**
@@ -87,12 +94,15 @@ Cube::Cube(unsigned int xRange, unsigned int yRange, unsigned int zRange, unsign
  * @param minInstances the minimum number of instances that can be left when dinamicaly decreasing.
  * @param x the x coordinate of the node
  * @param y the y coordinate of the node
+ * @param z the z coordinate of the node
+ * @param name the name the node is found with, e.g. by deadlines and pipeMapper::Route, besides "[x:y:z]"
  *
  * @returns a pointer to the node.
  *
  * @throws std::invalid_argument
  */
-PipeNode *Cube::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, unsigned int x, unsigned int y, unsigned int z, pipeData::dataPacket initData, int maxInstances, int minInstances, unsigned int queueSize)
+PipeNode *Cube::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, unsigned int x, unsigned int y, unsigned int z, pipeData::dataPacket initData, int maxInstances, int minInstances, unsigned int queueSize,
+                                  std::string name)
 {
 
   if (x > xRange_ || y > yRange_ || z > zRange_)
@@ -101,6 +111,10 @@ PipeNode *Cube::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instanc
   }
 
   auto node = (PipeNode *)threeDimPipe->getPipeNode(pipeMapper::nodeId(x, y, z));
+  if (name != "")
+  {
+    threeDimPipe->nameNode(node->getNodeAddress(), name);
+  }
 
   node->extra_args(initData);
   if (node->processing_unit() != nullptr)
@@ -120,6 +134,101 @@ PipeNode *Cube::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instanc
   return node;
 }
 
+/**
+ * @brief Sends a packet to the node that follows the one that ran it
+ *
+ * @details Used when Run returns and by the units that hold packets and
+ * release them later through PipeNode::Forward.
+ *
+ * @param node The node that ran the packet
+ * @param pData The packet
+ * @param map The map of the nodes
+ * @param outQueue The output queue of the topology
+ * @param loopExit When a packet leaves a closed topology, nullptr if open
+ */
+static void RouteData(PipeNode *node, pipeData *pData, pipeMapper *map, pipeQueue *outQueue, const std::function<bool(pipeData *)> *loopExit)
+{
+  // A route handle set by the unit takes the packet one hop
+  auto route = pData->route();
+  if (route != pipeMapper::kNoRoute)
+  {
+    pData->route(pipeMapper::kNoRoute);
+    if (route == pipeMapper::kWriteOut)
+    {
+      outQueue->Push(pData, pData->priority());
+    }
+    else
+    {
+      ((PipeNode *)map->getRouteNode(route))->in_data_queue()->Push(pData, pData->priority());
+    }
+    return;
+  }
+
+  // The named address also takes the packet one hop. Route is cheaper
+  auto namedNode = (std::string *)pData->GetExtraData("_#NAMED_ADDRESS#_");
+  if (namedNode != nullptr)
+  {
+    pData->resetExtraData("_#NAMED_ADDRESS#_", nullptr);
+    // If the address is WRITE_OUT then write to the output queue
+    if (*namedNode == "_#WRITE_OUT#_")
+    {
+      outQueue->Push(pData, pData->priority());
+    }
+    else
+    {
+      // If no, get the node associated with the address
+      ((PipeNode *)map->getPipeNode(*namedNode))->in_data_queue()->Push(pData, pData->priority());
+    }
+    return;
+  }
+
+  // If the address is NEXT_ADDRESS, you get a nodeId else you get nullptr
+  auto nextNodeId = (pipeMapper::nodeId *)pData->GetExtraData("_#NEXT_ADDRESS#_");
+
+  if (nextNodeId != nullptr)
+  {
+    // Check that the node exists
+    if (map->nodeExists(*nextNodeId))
+    {
+      // Get the node assiated with the address
+      auto next_node = (PipeNode *)map->getPipeNode((pipeMapper::nodeId)*nextNodeId);
+      next_node->in_data_queue()->Push(pData, pData->priority());
+    }
+  }
+  else
+  {
+    // If not address given, just go to the next node
+    auto id = node->getNodeAddress();
+    if (node->last_node() && loopExit != nullptr)
+    {
+      // Closed: go round again from the first node until the exit holds
+      pData->passes(pData->passes() + 1);
+      if ((*loopExit)(pData))
+      {
+        outQueue->Push(pData, pData->priority());
+      }
+      else
+      {
+        id.z = 0;
+        auto first_node = (PipeNode *)map->getPipeNode(id);
+        first_node->in_data_queue()->PushReserved(pData);
+      }
+    }
+    else if (node->last_node())
+    {
+      outQueue->Push(pData, pData->priority());
+    }
+    else
+    {
+      id.z += 1;
+//           std::cout << "NODE id.x = " << id.x << " id.y = " << id.y << " id.z = " << id.z << std::endl;
+      auto next_node = (PipeNode *)map->getPipeNode(id);
+//      std::cout << "NODE " << next_node->node_id() << " DATA PUSHED " << std::endl;
+      next_node->in_data_queue()->Push(pData, pData->priority());
+    }
+  }
+}
+
 /**
  * @brief The function that all threads execute to run their processing unit.
  * @details This function gets the data from the input MemoryManager, executes
@@ -133,10 +242,11 @@ PipeNode *Cube::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instanc
  * cloning instances of the processing unit.
  *
  */
-void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pipeQueue *outQueue)
+void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pipeQueue *outQueue, const std::function<bool(pipeData *)> *loopExit)
 {
 
   ProcessingUnitInterface *processing_unit = node->processing_unit();
+  ProcessingUnitInterface *node_unit = processing_unit; // What the instance was made from
 
   // std::cout << __func__ << " : " << __LINE__ << std::endl;
   if (n_id != 0)
@@ -151,6 +261,10 @@ void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pip
 
   mtx.unlock();
 
+  // Opens the hardware counters of this instance when asked for
+  perfCounters counters(node->hw_counters());
+  perfCounters::values before, after;
+
   // std::cout << __func__ << " : " << __LINE__ << std::endl;
   //  Starts the data at the processing unit, the user must be aware of the arg
   processing_unit->Init(node->extra_args());
@@ -162,7 +276,7 @@ void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pip
     do
     {
       // std::cout << "NODE " << node->node_id() << " RUNNING INST " << n_id << " OF " << node->number_of_instances() << std::endl;
-      auto data = node->in_data_queue()->Pop();
+      auto data = node->Take();
       auto pnode = (PipeNode *)map->getPipeNode(node->getPrevAddress());
       if (pnode != node)
       {
@@ -174,32 +288,34 @@ void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pip
           switch (cmd)
           {
           case PipeNode::nodeCmd::NO_OP:
-            std::cout << "Null command received nothing done - cmd = " << cmd << std::endl;
+            PIPE_DEBUG("Null command received nothing done - cmd = %d", cmd);
             break;
           case PipeNode::nodeCmd::ADD_THR:
-            std::cout << "Increment processing unit instances - cmd = " << cmd << std::endl;
+            PIPE_DEBUG("Increment processing unit instances - cmd = %d", cmd);
             if (node->max_instances() == 0 || node->max_instances() > node->number_of_instances())
             {
               mtx.lock();
-              std::cout << "NODE " << node->node_id() << " LAUNCH NEW INSTANCE " << std::endl;
-              node->PushThread(new std::thread(RunCubeNode, node, node->number_of_instances(), std::ref(mtx), std::ref(map), std::ref(outQueue)));
+              PIPE_INFO("NODE %d LAUNCH NEW INSTANCE", node->node_id());
+              node->PushThread(new std::thread(RunCubeNode, node, node->number_of_instances(), std::ref(mtx), std::ref(map), std::ref(outQueue), loopExit));
               node->number_of_instances(node->number_of_instances() + 1);
+              node->stats().scale_up.fetch_add(1, std::memory_order_relaxed);
             }
             break;
           case PipeNode::nodeCmd::END_THR:
-            std::cout << "Decrement processing unit instances - cmd = " << cmd << std::endl;
+            PIPE_DEBUG("Decrement processing unit instances - cmd = %d", cmd);
             if (node->min_instances() == 0 || node->min_instances() < node->number_of_instances())
             {
               if (node->number_of_instances() > 1)
               {
-                std::cout << "NODE " << node->node_id() << " REMOVING INSTANCE " << std::endl;
+                PIPE_INFO("NODE %d REMOVING INSTANCE", node->node_id());
                 terminate = true;
                 node->number_of_instances(node->number_of_instances() - 1);
+                node->stats().scale_down.fetch_add(1, std::memory_order_relaxed);
               }
             }
             break;
           default:
-            std::cout << "Command id " << cmd << "not implemented." << std::endl;
+            PIPE_WARNING("Command id %d not implemented.", cmd);
           }
           cmd = pnode->getCmd();
         }
@@ -209,72 +325,62 @@ void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pip
 
       // std::cout << "NODE " << node->node_id() << " RUNNING INST " << n_id << " OF " << node->number_of_instances() << std::endl;
 
-      if (node->processing_unit() != processing_unit)
+      // The unit of the node was replaced, the clones run copies of the new one
+      if (node->processing_unit() != node_unit)
       {
         processing_unit->End(data);
-        processing_unit = node->processing_unit();
+        if (processing_unit != node_unit)
+          delete processing_unit;
+        node_unit = node->processing_unit();
+        processing_unit = n_id != 0 ? node_unit->Clone() : node_unit;
+        // A unit that can not be cloned is shared as it was before
+        if (processing_unit == nullptr)
+          processing_unit = node_unit;
         processing_unit->Init(node->extra_args());
       }
 
+      // Woken up without a packet, to end or to do the housekeeping
+      if (data == nullptr)
+      {
+        if (node->cancelled())
+          terminate = true;
+        else
+          processing_unit->Tick();
+        if (terminate)
+          processing_unit->End(data);
+        continue;
+      }
+
       auto pData = (pipeData *)data;
       pData->setNodeData(node);
 
+      // Packets past their deadline are shed before wasting a Run
+      if (node->Shed(pData))
+      {
+        if (terminate)
+          processing_unit->End(data);
+        continue;
+      }
+
       // std::cout << "NODE " << node->node_id() << " START RUN " << std::endl;
       //  Runs the processing_unit
+      if (counters.available())
+        counters.Read(before);
+      auto run_start = std::chrono::steady_clock::now();
       processing_unit->Run(data);
-      // std::cout << "NODE " << node->node_id() << " END   RUN " << std::endl;
-
-      // Check if the processing unit wants to write to a named address
-      auto namedNode = (std::string *)pData->GetExtraData("_#NAMED_ADDRESS#_");
-      PipeNode *nextNode;
-      pipeMapper::nodeId *nextNodeId = nullptr;
-      if (namedNode != nullptr)
-      {
-        // If the address is WRITE_OUT then write to the output queue
-        if (*namedNode == "_#WRITE_OUT#_")
-        {
-          outQueue->Push(data);
-        }
-        else
-        {
-          // If no, get the node associated with the address
-          nextNode = (PipeNode *)map->getPipeNode(*namedNode);
-        }
-      }
-      else
+      node->stats().Record(std::chrono::steady_clock::now() - run_start);
+      if (counters.available())
       {
-        // If the address is NEXT_ADDRESS, you get a nodeId else you get nullptr
-        nextNodeId = (pipeMapper::nodeId *)pData->GetExtraData("_#NEXT_ADDRESS#_");
+        counters.Read(after);
+        node->stats().Record(before, after);
       }
+      // std::cout << "NODE " << node->node_id() << " END   RUN " << std::endl;
 
-      if (nextNodeId != nullptr)
+      // Units that hold their packet release it later through the node
+      if (!processing_unit->Held())
       {
-        // Check that the node exists
-        if (map->nodeExists(*nextNodeId))
-        {
-          // Get the node assiated with the address
-          auto next_node = (PipeNode *)map->getPipeNode((pipeMapper::nodeId)*nextNodeId);
-          next_node->in_data_queue()->Push(data);
-        }
-      }
-      else
-      {
-        // If not address given, just go to the next node
-        auto id = node->getNodeAddress();
-        if (node->last_node())
-        {
-          outQueue->Push(data);
-        }
-        else
-        {
-          id.z += 1;
-//           std::cout << "NODE id.x = " << id.x << " id.y = " << id.y << " id.z = " << id.z << std::endl;
-          auto next_node = (PipeNode *)map->getPipeNode(id);
-//      std::cout << "NODE " << next_node->node_id() << " DATA PUSHED " << std::endl;
-          next_node->in_data_queue()->Push(data);
-        }
+        RouteData(node, pData, map, outQueue, loopExit);
       }
-//      std::cout << "NODE " << node->node_id() << " DATA PUSHED " << std::endl;
 
       if (terminate)
         processing_unit->End(data);
@@ -295,6 +401,18 @@ void RunCubeNode(PipeNode *node, int n_id, std::mutex &mtx, pipeMapper *map, pip
 int Cube::RunCube()
 {
 
+  // The exit is only looked at by the last nodes of a closed Cube
+  auto loop_exit = closed_ ? &loop_exit_ : nullptr;
+
+  // The late packets go to the late node or to the output queue
+  auto late_node = late_policy_ == PipeNode::kDivertLate ? (PipeNode *)threeDimPipe->getPipeNode(late_node_) : nullptr;
+  auto late_queue = late_node != nullptr ? late_node->in_data_queue() : out_queue_;
+
+  if (out_queue_->lanes() != lanes_)
+  {
+    out_queue_->lanes(lanes_, lane_weight_);
+  }
+
   int nodes_executed = 0;
   auto id = pipeMapper::nodeId(0, 0, 0);
   PipeNode *node;
@@ -307,6 +425,18 @@ int Cube::RunCube()
       for (int z = 0; z < zRange_; ++z)
       {
         node = (PipeNode *)threeDimPipe->getPipeNode(pipeMapper::nodeId(x, y, z));
+        node->hw_counters(hw_counters_);
+        node->late(node == late_node ? PipeNode::kRunLate : late_policy_, late_queue);
+        if (node->in_data_queue()->lanes() != lanes_)
+        {
+          node->in_data_queue()->lanes(lanes_, lane_weight_);
+        }
+        // The laps come back to a lane of their own, never full of new input
+        if (closed_ && z == 0 && node->in_data_queue()->reserved() == 0)
+        {
+          node->in_data_queue()->reserve(node->in_data_queue()->max_size());
+        }
+        node->forward([node, loop_exit, this](pipeData *data) { RouteData(node, data, threeDimPipe, out_queue_, loop_exit); });
         auto numberOfInstances = node->number_of_instances();
         for (auto instanceIt = 0; instanceIt < numberOfInstances; ++instanceIt)
         {
@@ -315,7 +445,7 @@ int Cube::RunCube()
             execution_mutex_.lock();
             node->PushThread(new std::thread(
                 RunCubeNode, node, instanceIt, std::ref(execution_mutex_),
-                threeDimPipe, std::ref(out_queue_)));
+                threeDimPipe, std::ref(out_queue_), loop_exit));
           }
           catch (...)
           {
@@ -326,4 +456,132 @@ int Cube::RunCube()
     }
   }
   return nodes_executed;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Sets whether the instances read the hardware counters around Run
+ *
+ * @details It has to be called before RunCube. When the counters can not be
+ * opened the nodes run as usual and Profile reports them as unavailable.
+ *
+ * @param enable True to open the counters for every instance
+ */
+void Cube::hwCounters(bool enable) { hw_counters_ = enable; }
+
+/**
+ * @brief Sets what the nodes do with the packets past their deadline
+ *
+ * @details Every node checks pipeData::deadline before Run and sheds the late
+ * packets: kDropLate releases them, kDivertLate pushes them to the late node
+ * and kOutputLate to the output queue. The late node runs every packet it
+ * gets. It has to be called before RunCube.
+ *
+ * @param policy What is done with the late packets
+ * @param lateNode The name of the late node, only for kDivertLate. The one
+ * given to AddProcessingUnit or the address of the node, like "[1:0:0]"
+ *
+ * @throws std::invalid_argument if kDivertLate is given without a node
+ */
+void Cube::deadlines(PipeNode::latePolicy policy, std::string lateNode)
+{
+  if (policy == PipeNode::kDivertLate && lateNode.empty())
+  {
+    throw std::invalid_argument("kDivertLate needs a late node.");
+  }
+  late_policy_ = policy;
+  late_node_ = lateNode;
+}
+
+/**
+ * @brief Splits every queue of the Cube in priority lanes
+ *
+ * @details The lanes are set on the input queue of every node and on the
+ * output queue when RunCube starts, so it has to be called before and the
+ * queues must be empty by then. The packets are pushed to the lane of
+ * pipeData::priority at every hop. See pipeQueue::lanes.
+ *
+ * @param count The number of lanes, from 1 to pipeQueue::kMaxLanes
+ * @param weight The pops a waiting lane lets go by, 0 for strict priority
+ *
+ * @throws std::invalid_argument if the number of lanes is out of range
+ */
+void Cube::lanes(int count, unsigned int weight)
+{
+  if (count < 1 || count > pipeQueue::kMaxLanes)
+  {
+    throw std::invalid_argument("lanes has to be between 1 and " + std::to_string(pipeQueue::kMaxLanes) + ".");
+  }
+  lanes_ = count;
+  lane_weight_ = weight;
+}
+
+/**
+ * @brief Makes the packets leave a closed Cube after a number of laps
+ *
+ * @details A lap ends at the last node of a column, which sends the packet
+ * back to the first node of the same column until it has made the given
+ * number of laps. It has to be called before RunCube.
+ *
+ * @param laps The laps every packet makes, counting the first one
+ *
+ * @throws std::logic_error if the Cube is not closed
+ */
+void Cube::loop(unsigned int laps)
+{
+  loop([laps](pipeData *data) { return data->passes() >= laps; });
+}
+
+/**
+ * @brief Makes the packets leave a closed Cube once they carry a key
+ *
+ * @details A processing unit ends the loop of a packet by adding the key to
+ * its extra data. The key is looked at the end of every lap.
+ *
+ * @param key The extra data key
+ *
+ * @throws std::logic_error if the Cube is not closed
+ */
+void Cube::loop(std::string key)
+{
+  loop([key](pipeData *data) { return data->isKey(key); });
+}
+
+/**
+ * @brief Makes the packets leave a closed Cube when a predicate holds
+ *
+ * @details The predicate is called at the end of every lap, after
+ * pipeData::passes has been incremented, from the threads of the last nodes.
+ * Packets sent with a route handle, _#NEXT_ADDRESS#_ or _#NAMED_ADDRESS#_
+ * are not looked at. The packets going round come back to a lane of the
+ * input queue of the first nodes reserved for them and served before the new
+ * input, so a full input queue never blocks the loop.
+ *
+ * @param exit Returns true when the packet goes to the output queue
+ *
+ * @throws std::logic_error if the Cube is not closed
+ */
+void Cube::loop(loopExit exit)
+{
+  if (!closed_)
+  {
+    throw std::logic_error("loop needs a closed Cube.");
+  }
+  loop_exit_ = exit;
+}
+
+/**
+ * @brief Prints the execution counters of every node of the cube
+ */
+void Cube::Profile()
+{
+  for (auto x = 0; x < xRange_; ++x)
+  {
+    for (auto y = 0; y < yRange_; ++y)
+    {
+      for (auto z = 0; z < zRange_; ++z)
+      {
+        ((PipeNode *)threeDimPipe->getPipeNode(pipeMapper::nodeId(x, y, z)))->PrintStats();
+      }
+    }
+  }
+}
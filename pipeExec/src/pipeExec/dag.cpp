@@ -0,0 +1,516 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file dag.cpp
+ *
+ * @brief Definition of the Dag class methods
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "dag.h"
+#include "pipeLogger.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+/**
+ * @brief Constructor for the Dag class
+ *
+ * @param queueSize the size of the edge queues and of the output queue
+ */
+Dag::Dag(unsigned int queueSize) : queue_size_(queueSize), stopping_(false)
+{
+  dagMap = new pipeMapper();
+  out_queue_ = new pipeQueue(queueSize);
+  entry_.queue = nullptr;
+  entry_.to = nullptr;
+}
+
+/**
+ * @brief Destructor for the Dag.
+ *
+ * @details Wakes every instance to end, joins them and frees the nodes, the
+ * edges with their queues and the output queue. The instances have to be
+ * waiting for packets, none blocked in Run on a full queue. The processing
+ * units given to the Dag are not deleted.
+ */
+Dag::~Dag()
+{
+  stopping_ = true;
+  for (auto dNode : nodes_)
+  {
+    for (auto it = 0; it < dNode->node->number_of_instances(); ++it)
+    {
+      dNode->ready->Signal();
+    }
+  }
+
+  // Joins the instances before freeing what they use
+  for (auto dNode : nodes_)
+  {
+    auto node = dNode->node;
+
+    // Without edges coming in no one uses the input queue of the node
+    if (dNode->inputs.empty())
+    {
+      delete node->in_data_queue();
+    }
+    delete node->ctl_sema;
+    delete node;
+  }
+
+  // The first edge coming into a node uses the input queue of the node
+  for (auto dNode : nodes_)
+  {
+    for (auto edge : dNode->inputs)
+    {
+      delete edge->queue;
+      if (edge != &entry_)
+      {
+        delete edge;
+      }
+    }
+    delete dNode->ready;
+    delete dNode;
+  }
+
+  delete out_queue_;
+  delete dagMap;
+}
+
+/**
+ * @brief Adds a named node to the Dag
+ *
+ * @details The node is not linked to any other until the edges are added. The
+ * first node added is the entry: the packets sent to the Dag go to it.
+ *
+ * @param procUnit a pointer to a processing unit object.
+ * @param instances number of instances of the processing unit to create
+ * @param name the name of the node, used to add the edges
+ * @param initData data to be passed to the Init() method of the processing unit
+ * @param join true if the node waits for a packet to arrive through all its
+ * incoming edges before running it
+ *
+ * @returns a pointer to the node.
+ */
+PipeNode *Dag::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, std::string name,
+                                 pipeData::dataPacket initData, bool join)
+{
+  if (names_.count(name) != 0)
+  {
+    throw std::invalid_argument("[" + name + "] - is in use.");
+  }
+
+  auto dNode = new dagNode;
+  auto node = new PipeNode;
+
+  node->extra_args(initData);
+  node->ctl_sema = new Semaphore(0);
+  node->node_id(nodes_.size());
+  node->last_node(false);
+  node->processing_unit(procUnit);
+  node->number_of_instances(instances);
+  node->max_instances(0);
+  node->min_instances(0);
+  node->in_data_queue(new pipeQueue(queue_size_));
+  node->out_data_queue(nullptr);
+  node->setNodeAddress(dagMap->addNode(node, name));
+  node->setPrevAddress(node->getNodeAddress());
+
+  dNode->node = node;
+  dNode->ready = new Semaphore(0);
+  dNode->join = join;
+
+  // The first node takes the packets sent to the Dag
+  if (nodes_.empty())
+  {
+    entry_.queue = node->in_data_queue();
+    entry_.to = dNode;
+    dNode->inputs.push_back(&entry_);
+  }
+
+  nodes_.push_back(dNode);
+  names_[name] = dNode;
+
+  return node;
+}
+
+/**
+ * @brief Joins two nodes with an edge
+ *
+ * @details The first edge coming into a node uses the input queue of the
+ * node, the others get a queue of their own.
+ *
+ * @param from the name of the node the packets leave
+ * @param to the name of the node the packets arrive to
+ * @param queueSize the size of the edge queue, 0 for the size of the Dag
+ *
+ * @throws std::invalid_argument if a node does not exist or the edge makes a cycle
+ */
+void Dag::AddEdge(std::string from, std::string to, unsigned int queueSize)
+{
+  if (names_.count(from) == 0 || names_.count(to) == 0)
+  {
+    throw std::invalid_argument("[" + from + "] -> [" + to + "] - node does not exist.");
+  }
+
+  auto source = names_[from];
+  auto target = names_[to];
+
+  // The edge makes a cycle if the source can be reached from the target
+  std::function<bool(dagNode *)> reaches = [&](dagNode *n) {
+    if (n == source)
+      return true;
+    for (auto edge : n->outputs)
+    {
+      if (reaches(edge->to))
+        return true;
+    }
+    return false;
+  };
+  if (reaches(target))
+  {
+    throw std::invalid_argument("[" + from + "] -> [" + to + "] - makes a cycle.");
+  }
+
+  auto edge = new dagEdge;
+  edge->to = target;
+  if (target->inputs.empty())
+  {
+    if (queueSize != 0)
+    {
+      delete (target->node->in_data_queue());
+      target->node->in_data_queue(new pipeQueue(queueSize));
+    }
+    edge->queue = target->node->in_data_queue();
+  }
+  else
+  {
+    edge->queue = new pipeQueue(queueSize != 0 ? queueSize : queue_size_);
+  }
+
+  source->outputs.push_back(edge);
+  target->inputs.push_back(edge);
+}
+
+/**
+ * @brief Puts a packet on an edge and tells the node there is one more
+ *
+ * @param edge The edge
+ * @param data The packet
+ */
+void Dag::Push(dagEdge *edge, pipeData *data)
+{
+  edge->queue->Push(data);
+  edge->to->ready->Signal();
+}
+
+/**
+ * @brief Sends a packet to the entry node
+ *
+ * @param data The packet
+ */
+void Dag::send(pipeData *data)
+{
+  if (entry_.to == nullptr)
+  {
+    throw std::out_of_range("The Dag has no nodes.");
+  }
+  Push(&entry_, data);
+}
+
+/**
+ * @brief Takes the next packet from any of the incoming edges of a node
+ *
+ * @details The node semaphore counts the packets on all the edges, so after
+ * waiting on it there is a packet for this instance on one of them. The edges
+ * are looked at in turns so none of them starves.
+ *
+ * @param dNode The node
+ *
+ * @return The packet, nullptr once the Dag is being destroyed
+ */
+pipeData *Dag::Take(dagNode *dNode)
+{
+  dNode->ready->Wait();
+  if (stopping_)
+  {
+    return nullptr;
+  }
+
+  auto inputs = dNode->inputs.size();
+  while (true)
+  {
+    auto start = dNode->next_input.fetch_add(1, std::memory_order_relaxed);
+    for (size_t it = 0; it < inputs; ++it)
+    {
+      auto data = dNode->inputs[(start + it) % inputs]->queue->TryPop();
+      if (data != nullptr)
+      {
+        return (pipeData *)data;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Waits for a packet to arrive through all the incoming edges
+ *
+ * @details The branches of a broadcast carry views of the same packet. A
+ * branch that broadcasts again makes views of its own view, so the arrivals
+ * are joined on the packet at the top. When the last one arrives, the extra
+ * data of the views in between and then of the views arrived is merged into
+ * the packet, and all of them are released.
+ *
+ * @param dNode The join node
+ * @param data The packet or view that has arrived
+ *
+ * @return The packet once all the branches arrived, nullptr until then
+ */
+pipeData *Dag::Join(dagNode *dNode, pipeData *data)
+{
+  auto packet = data;
+  while (packet->parent() != nullptr)
+  {
+    packet = packet->parent();
+  }
+  std::vector<pipeData *> arrived;
+
+  {
+    std::lock_guard<std::mutex> lock(dNode->join_mutex);
+    auto &pending = dNode->joining[packet];
+    pending.push_back(data);
+    if (pending.size() < dNode->inputs.size())
+    {
+      return nullptr;
+    }
+    arrived.swap(pending);
+    dNode->joining.erase(packet);
+  }
+
+  // The views that broadcast again, every one after the views it comes from,
+  // so the packet takes the entries from the view that owns them
+  std::vector<pipeData *> between;
+  for (auto view : arrived)
+  {
+    auto at = between.size();
+    for (auto up = view->parent(); up != nullptr && up != packet; up = up->parent())
+    {
+      if (std::find(between.begin(), between.end(), up) == between.end())
+      {
+        between.insert(between.begin() + at, up);
+      }
+    }
+  }
+
+  for (auto view : between)
+  {
+    packet->Merge(view);
+  }
+  for (auto view : arrived)
+  {
+    if (view != packet)
+    {
+      packet->Merge(view);
+      view->Release();
+    }
+  }
+
+  // Their own reference was kept when they broadcast
+  for (auto view : between)
+  {
+    view->Release();
+  }
+
+  return packet;
+}
+
+/**
+ * @brief Sends a packet along the outgoing edges of the node that ran it
+ *
+ * @details With several edges every one of them gets its own view of the
+ * packet. Without edges the packet goes to the output queue.
+ *
+ * @param dNode The node that ran the packet
+ * @param data The packet
+ */
+void Dag::Route(dagNode *dNode, pipeData *data)
+{
+  auto outputs = dNode->outputs.size();
+
+  if (outputs == 0)
+  {
+    out_queue_->Push(data);
+  }
+  else if (outputs == 1)
+  {
+    Push(dNode->outputs[0], data);
+  }
+  else
+  {
+    for (auto edge : dNode->outputs)
+    {
+      Push(edge, data->Share());
+    }
+  }
+}
+
+/**
+ * @brief The function that all threads execute to run their processing unit.
+ *
+ * @details The instances of the Dag nodes are not scaled with commands.
+ *
+ * @param dNode The node to be executed.
+ * @param n_id The thread id. The instances other than 0 run a clone.
+ */
+void Dag::RunNode(dagNode *dNode, int n_id)
+{
+  auto node = dNode->node;
+  ProcessingUnitInterface *processing_unit = node->processing_unit();
+
+  if (n_id != 0)
+  {
+    processing_unit = node->processing_unit()->Clone();
+    if (processing_unit == nullptr)
+    {
+      // Thrown here it would end the program, so the instance is not started
+      execution_mutex_.unlock();
+      PIPE_ERROR("NODE %d instance %d not started, Clone returned null pointer", node->node_id(), n_id);
+      return;
+    }
+  }
+
+  execution_mutex_.unlock();
+
+  // Opens the hardware counters of this instance when asked for
+  perfCounters counters(node->hw_counters());
+  perfCounters::values before, after;
+
+  processing_unit->Init(node->extra_args());
+
+  try
+  {
+    while (true)
+    {
+      auto pData = Take(dNode);
+      if (pData == nullptr)
+      {
+        break;
+      }
+
+      if (dNode->join && (pData = Join(dNode, pData)) == nullptr)
+      {
+        continue;
+      }
+
+      pData->setNodeData(node);
+
+      if (counters.available())
+        counters.Read(before);
+      auto run_start = std::chrono::steady_clock::now();
+      processing_unit->Run(pData);
+      node->stats().Record(std::chrono::steady_clock::now() - run_start);
+      if (counters.available())
+      {
+        counters.Read(after);
+        node->stats().Record(before, after);
+      }
+
+      // Units that hold their packet release it later through the node
+      if (!processing_unit->Held())
+      {
+        Route(dNode, pData);
+      }
+    }
+  }
+  catch (...)
+  {
+    PIPE_ERROR("NODE %d stopped by an exception", node->node_id());
+  }
+
+  if (processing_unit != node->processing_unit())
+  {
+    delete processing_unit;
+  }
+}
+
+/**
+ * @brief Sets the Dag to run.
+ * @details For each node it creates "n" instances of threads and executes all
+ * of them.
+ *
+ * @return The number of nodes executed
+ */
+int Dag::RunDag()
+{
+  int nodes_executed = 0;
+
+  for (auto dNode : nodes_)
+  {
+    auto node = dNode->node;
+    node->hw_counters(hw_counters_);
+    node->forward([this, dNode](pipeData *data) { Route(dNode, data); });
+    if (dNode->inputs.empty())
+    {
+      PIPE_WARNING("NODE %d has no incoming edges", node->node_id());
+    }
+
+    auto numberOfInstances = node->number_of_instances();
+    for (auto instanceIt = 0; instanceIt < numberOfInstances; ++instanceIt)
+    {
+      try
+      {
+        execution_mutex_.lock();
+        node->PushThread(new std::thread(&Dag::RunNode, this, dNode, instanceIt));
+      }
+      catch (...)
+      {
+      }
+    }
+    ++nodes_executed;
+  }
+  return nodes_executed;
+}
+
+/**
+ * @brief Prints the execution counters of every node
+ */
+void Dag::Profile()
+{
+  for (auto dNode : nodes_)
+  {
+    dNode->node->PrintStats();
+  }
+}
+
+/**
+ * @brief Sets whether the instances read the hardware counters around Run
+ *
+ * @details It has to be called before RunDag.
+ *
+ * @param enable True to open the counters for every instance
+ */
+void Dag::hwCounters(bool enable) { hw_counters_ = enable; }
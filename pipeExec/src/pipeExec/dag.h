@@ -0,0 +1,125 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file dag.h
+ *
+ * @brief Declaration of the Dag class methods
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+#pragma once
+
+#include "pipe_node.h"
+#include "pipeData.h"
+#include "pipeMapper.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @class Dag
+ * @brief Class representing a directed acyclic graph of processing nodes.
+ *
+ * The nodes are named and joined with explicit edges, every edge with its own
+ * queue. A node with several outgoing edges broadcasts: every branch gets a
+ * view of the packet (pipeData::Share) so the data is never copied. A join
+ * node waits until the packet has arrived through all its incoming edges,
+ * merges the extra data the branches added and runs once. The nodes without
+ * outgoing edges write to the output queue.
+ */
+class Dag
+{
+public:
+  // Constructor for the Dag class
+  Dag(unsigned int queueSize);
+
+  // Destructor of the Dag
+  ~Dag();
+
+  // Adds a named node. The first node added is the entry of the Dag
+  PipeNode *AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, std::string name,
+                              pipeData::dataPacket initData = nullptr, bool join = false);
+
+  // Joins two nodes with an edge of its own queue
+  void AddEdge(std::string from, std::string to, unsigned int queueSize = 0);
+
+  // Sends a packet to the entry node
+  void send(pipeData *data);
+
+  // Runs the Dag making all the threads wait for an input
+  int RunDag();
+
+  // Prints the execution counters of every node
+  void Profile();
+
+  // Reads the hardware counters of every instance around Run
+  void hwCounters(bool);
+
+  void out_queue(pipeQueue *queue) { out_queue_ = queue; };
+  pipeQueue *out_queue() { return out_queue_; };
+
+  pipeMapper *dagMap;
+
+private:
+  struct dagNode;
+
+  /**
+   * @brief An edge and the queue that holds its packets
+   */
+  struct dagEdge
+  {
+    pipeQueue *queue; /**< The packets waiting on the edge */
+    dagNode *to;      /**< The node the edge goes to */
+  };
+
+  /**
+   * @brief A node of the graph with its edges
+   */
+  struct dagNode
+  {
+    PipeNode *node;                  /**< The node running the unit */
+    std::vector<dagEdge *> inputs;   /**< The edges coming in */
+    std::vector<dagEdge *> outputs;  /**< The edges going out */
+    Semaphore *ready;                /**< One count per packet on the inputs */
+    std::atomic<unsigned int> next_input{0}; /**< Input to look at first */
+    bool join;                       /**< Waits for all the inputs */
+    std::mutex join_mutex;           /**< Protects the packets being joined */
+    std::map<pipeData *, std::vector<pipeData *>> joining; /**< Arrivals per packet */
+  };
+
+  void RunNode(dagNode *dNode, int n_id);
+  pipeData *Take(dagNode *dNode);
+  pipeData *Join(dagNode *dNode, pipeData *data);
+  void Route(dagNode *dNode, pipeData *data);
+  void Push(dagEdge *edge, pipeData *data);
+
+  unsigned int queue_size_;              /**< Default size of the edge queues */
+  std::vector<dagNode *> nodes_;         /**< The nodes in the order added */
+  std::map<std::string, dagNode *> names_; /**< The nodes by name */
+  dagEdge entry_;                        /**< The edge packets are sent through */
+  std::mutex execution_mutex_;           /**< The mutex to safely run the nodes */
+  pipeQueue *out_queue_;
+  bool hw_counters_ = false;             /**< The flag to read the hardware counters */
+  std::atomic<bool> stopping_;           /**< The instances end, the Dag is being destroyed */
+};
@@ -32,7 +32,7 @@
 #ifndef MEMORY_MANAGER_H
 #define MEMORY_MANAGER_H
 
-#include "semaphore.h"
+#include "pipeSemaphore.h"
 
 /**
  * @class MemoryManager
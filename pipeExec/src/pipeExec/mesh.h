@@ -34,6 +34,7 @@
 #include "pipeData.h"
 #include "pipeMapper.h"
 #include <algorithm>
+#include <functional>
 #include <stdarg.h>
 
 /**
@@ -58,11 +59,38 @@ public:
 
   // Adds a new processing unit to the Mesh
   PipeNode *AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, unsigned int x, unsigned int y, pipeData::dataPacket initData = nullptr,
-  int maxInstances= 0, int minInstances= 0, unsigned int queueSize = 0);
+  int maxInstances= 0, int minInstances= 0, unsigned int queueSize = 0, std::string name = "");
 
   // Runs the pipe making all the threads wait for an input
   int RunMesh();
 
+  // Prints the execution counters of every node
+  void Profile();
+
+  // Reads the hardware counters of every instance around Run
+  void hwCounters(bool);
+
+  // Splits every queue of the Mesh in priority lanes
+  void lanes(int, unsigned int = 4);
+
+  // Sets what the nodes do with the packets past their deadline
+  void deadlines(PipeNode::latePolicy, std::string = "");
+
+  // Tells when a packet leaves a closed Mesh instead of going round again
+  using loopExit = std::function<bool(pipeData *)>;
+
+  // Closed only. Packets leave after the given number of laps
+  void loop(unsigned int);
+
+  // Closed only. Packets leave once they carry the extra data key
+  void loop(std::string);
+
+  // Closed only. Packets leave when the predicate returns true
+  void loop(loopExit);
+
+  // Getter. True if the last nodes route back to the first ones
+  bool closed() const { return closed_; };
+
   PipeNode *getHead() { return firstNode_; };
   PipeNode *getTail() { return lastNode_; };
 
@@ -83,4 +111,11 @@ private:
   unsigned int xRange_;
   unsigned int yRange_;
   pipeQueue *out_queue_;
+  bool hw_counters_ = false;               /**< The flag to read the hardware counters */
+  int lanes_ = 1;                          /**< The priority lanes of the queues */
+  unsigned int lane_weight_ = 4;           /**< The pops a waiting lane lets go by */
+  PipeNode::latePolicy late_policy_ = PipeNode::kRunLate; /**< What is done with the late packets */
+  std::string late_node_;                  /**< The node the late packets are diverted to */
+  bool closed_;                            /**< The last nodes route back to the first ones */
+  loopExit loop_exit_;                     /**< When a packet leaves the loop */
 };
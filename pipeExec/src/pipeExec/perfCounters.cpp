@@ -0,0 +1,177 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file perfCounters.cpp
+ *
+ * @brief The source file for the perfCounters class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "perfCounters.h"
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Opens a counter for the calling thread on any cpu
+ *
+ * @param type The perf event type
+ * @param config The event inside the type
+ * @param group The group leader or -1 to create the group
+ *
+ * @return The file descriptor or -1 if the event is not available
+ */
+static int OpenCounter(uint32_t type, uint64_t config, int group)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_hv = 1;
+
+  // The context switches happen in the kernel, try to count them there first
+  if (type == PERF_TYPE_SOFTWARE)
+  {
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+    if (fd != -1)
+      return fd;
+  }
+
+  // Restricted by perf_event_paranoid, count only the user space
+  attr.exclude_kernel = 1;
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * @brief Opens the counters of the calling thread
+ *
+ * @param enable False to build an object without counters
+ */
+perfCounters::perfCounters(bool enable) : leader_(-1), opened_(0)
+{
+  static const struct
+  {
+    uint32_t type;
+    uint64_t config;
+  } events[kCounters] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+  };
+
+  for (int it = 0; it < kCounters; ++it)
+  {
+    fd_[it] = -1;
+    index_[it] = -1;
+
+    if (!enable)
+      continue;
+
+    fd_[it] = OpenCounter(events[it].type, events[it].config, leader_);
+    if (fd_[it] != -1)
+    {
+      if (leader_ == -1)
+        leader_ = fd_[it];
+      index_[it] = opened_++;
+    }
+  }
+}
+
+/**
+ * @brief Closes all the counters opened
+ */
+perfCounters::~perfCounters()
+{
+  for (int it = 0; it < kCounters; ++it)
+  {
+    if (fd_[it] != -1)
+      close(fd_[it]);
+  }
+}
+
+/**
+ * @brief Checks if any counter is being measured
+ *
+ * @return True if at least one counter could be opened
+ */
+bool perfCounters::available() const { return opened_ != 0; }
+
+/**
+ * @brief Checks if a counter is being measured
+ *
+ * @param which The counter to check
+ *
+ * @return True if the counter could be opened
+ */
+bool perfCounters::available(counter which) const { return fd_[which] != -1; }
+
+/**
+ * @brief Reads the whole group with a single system call
+ *
+ * @param current Where to store the values. Unavailable counters are 0
+ */
+void perfCounters::Read(values &current) const
+{
+  uint64_t buffer[kCounters + 1];
+
+  memset(&current, 0, sizeof(current));
+  if (leader_ == -1)
+    return;
+
+  if (read(leader_, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t))
+    return;
+
+  for (int it = 0; it < kCounters; ++it)
+  {
+    if (index_[it] != -1 && (uint64_t)index_[it] < buffer[0])
+    {
+      current.value[it] = buffer[index_[it] + 1];
+      current.available |= 1u << it;
+    }
+  }
+}
+
+/**
+ * @brief Gets the printable name of a counter
+ *
+ * @param which The counter
+ *
+ * @return The name of the counter
+ */
+const char *perfCounters::name(counter which)
+{
+  static const char *names[kCounters] = {"cycles", "instructions", "llc-misses",
+                                         "branch-misses", "context-switches"};
+
+  return (which < kCounters) ? names[which] : "unknown";
+}
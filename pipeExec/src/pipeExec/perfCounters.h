@@ -0,0 +1,95 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file perfCounters.h
+ *
+ * @brief The header file for the perfCounters class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @class perfCounters
+ *
+ * @brief The hardware counters of the calling thread
+ *
+ * @details The counters are opened with perf_event_open as a single group, so
+ * one read gives all of them at once. Every counter that can not be opened
+ * (no PMU in a virtual machine, perf_event_paranoid, seccomp...) is just
+ * marked as unavailable and the rest keep working.
+ */
+class perfCounters
+{
+public:
+  /**
+   * @enum counter
+   * @brief The events counted for every instance
+   */
+  enum counter
+  {
+    kCycles,
+    kInstructions,
+    kLlcMisses,
+    kBranchMisses,
+    kContextSwitches,
+    kCounters
+  };
+
+  /**
+   * @brief The value of every counter at a given time
+   */
+  struct values
+  {
+    uint64_t value[kCounters]; /**< Indexed by the counter enum */
+    unsigned int available;    /**< Bit n set if counter n was read */
+  };
+
+  // Opens the counters for the calling thread when enabled
+  perfCounters(bool = true);
+
+  // Closes the counters
+  ~perfCounters();
+
+  // True if at least one counter could be opened
+  bool available() const;
+
+  // True if the given counter could be opened
+  bool available(counter) const;
+
+  // Reads the current value of the counters
+  void Read(values &) const;
+
+  // The printable name of the counter
+  static const char *name(counter);
+
+private:
+  int leader_;           /**< The file descriptor of the group leader */
+  int fd_[kCounters];    /**< The file descriptors, -1 when unavailable */
+  int index_[kCounters]; /**< The position of each counter in a group read */
+  int opened_;           /**< The number of counters opened */
+};
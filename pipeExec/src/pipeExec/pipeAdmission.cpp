@@ -0,0 +1,316 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeAdmission.cpp
+ *
+ * @brief The source file for the pipeAdmission class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeAdmission.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+/**
+ * @brief Current time of the monotonic clock in ns
+ */
+static uint64_t NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief The default drop: the packet loses its reference
+ *
+ * @param data The packet dropped
+ */
+static void ReleaseData(pipeData *data) { data->Release(); }
+
+/**
+ * @brief Constructor. No rate limit and no early drop
+ *
+ * @param policy What is done when the entry queue is full
+ */
+pipeAdmission::pipeAdmission(fullPolicy policy)
+    : full_policy_(policy), drop_(ReleaseData), rate_(0), burst_(1), tokens_(0), refill_ns_(0),
+      min_fill_(0), max_fill_(0), max_probability_(1), gated_(false), random_(std::random_device{}()), admitted_(0),
+      rejected_(0), rate_limited_(0), early_dropped_(0), dropped_oldest_(0)
+{
+}
+
+/**
+ * @brief Lets a packet through the gates and pushes it to the queue
+ *
+ * @param queue The entry queue
+ * @param data The packet
+ *
+ * @return True if the packet was pushed. False if it was shed, and then the
+ * caller still owns it
+ */
+bool pipeAdmission::Admit(pipeQueue *queue, pipeData *data)
+{
+  return Gate() && Push(queue, data);
+}
+
+/**
+ * @brief Lets a packet through the rate limit and the early drop
+ *
+ * @details Takes no lock when neither is set. The early drop follows RED: no
+ * drop below the minimum fill of the queues watched, a probability growing
+ * up to the maximum one between both fills, and every packet above the
+ * maximum fill.
+ *
+ * @return True if the packet can go on, false if it was shed
+ */
+bool pipeAdmission::Gate()
+{
+  if (!gated_.load(std::memory_order_acquire))
+  {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (rate_ != 0)
+  {
+    uint64_t now = NowNs();
+    tokens_ = std::min(burst_, tokens_ + (now - refill_ns_) * rate_ / 1e9);
+    refill_ns_ = now;
+    if (tokens_ < 1)
+    {
+      rate_limited_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+
+  if (max_fill_ != 0)
+  {
+    double fill = Fill();
+    if (fill >= min_fill_)
+    {
+      double probability = fill >= max_fill_ ? 1 : max_probability_ * (fill - min_fill_) / (max_fill_ - min_fill_);
+      if (std::uniform_real_distribution<double>(0, 1)(random_) < probability)
+      {
+        early_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+  }
+
+  // The token is only spent by the packets let in
+  if (rate_ != 0)
+  {
+    tokens_ -= 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Pushes an admitted packet according to the full policy
+ *
+ * @details kDropOldest takes the packet the queue would serve next, which is
+ * the oldest one unless the queue has priority lanes, and drops it until
+ * there is room for the new one. The reserved lane is left alone, and the
+ * packet is rejected if there is nothing else to drop.
+ *
+ * @param queue The entry queue
+ * @param data The packet
+ *
+ * @return True if the packet was pushed, false if it was rejected
+ */
+bool pipeAdmission::Push(pipeQueue *queue, pipeData *data)
+{
+  int priority = data->priority();
+
+  switch (full_policy_)
+  {
+  case kRejectFull:
+    if (!queue->TryPush(data, priority))
+    {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    break;
+  case kDropOldest:
+    while (!queue->TryPush(data, priority))
+    {
+      // The packets of the reserved lane are going round, they are kept
+      auto oldest = (pipeData *)queue->TryPopUnreserved();
+      if (oldest == nullptr)
+      {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      drop_(oldest);
+      dropped_oldest_.fetch_add(1, std::memory_order_relaxed);
+    }
+    break;
+  default:
+    queue->Push(data, priority);
+  }
+
+  admitted_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+/**
+ * @brief Pushes an admitted packet only if there is room
+ *
+ * @details For the callers trying several queues before applying the full
+ * policy to one of them. A packet not pushed is not counted as shed.
+ *
+ * @param queue The entry queue
+ * @param data The packet
+ *
+ * @return True if the packet was pushed
+ */
+bool pipeAdmission::TryPush(pipeQueue *queue, pipeData *data)
+{
+  if (!queue->TryPush(data, data->priority()))
+  {
+    return false;
+  }
+
+  admitted_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+/**
+ * @brief Gets the fill of the fullest queue watched
+ *
+ * @return From 0, empty, to 1, full
+ */
+double pipeAdmission::Fill() const
+{
+  double fill = 0;
+
+  for (auto queue : watched_)
+  {
+    fill = std::max(fill, (double)queue->queue_count() / queue->max_size());
+  }
+  return fill;
+}
+
+/**
+ * @brief Limits the rate of the packets admitted with a token bucket
+ *
+ * @param perSecond The packets admitted per second, 0 for no limit
+ * @param burst The packets admitted at once after a quiet time
+ *
+ * @throws std::invalid_argument if the rate is negative or the burst below 1
+ */
+void pipeAdmission::rate(double perSecond, double burst)
+{
+  if (perSecond < 0 || burst < 1)
+  {
+    throw std::invalid_argument("The rate can not be negative and the burst has to be 1 at least.");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  rate_ = perSecond;
+  burst_ = burst;
+  tokens_ = burst;
+  refill_ns_ = NowNs();
+  gated_.store(rate_ != 0 || max_fill_ != 0, std::memory_order_release);
+}
+
+/**
+ * @brief Sheds packets early as the queues downstream fill up
+ *
+ * @param minFill The fill, from 0 to 1, where the drops start
+ * @param maxFill The fill where every packet is dropped, 0 to turn it off
+ * @param maxProbability The drop probability right below maxFill
+ *
+ * @throws std::invalid_argument if the fills are not ordered within [0, 1]
+ */
+void pipeAdmission::early_drop(double minFill, double maxFill, double maxProbability)
+{
+  if (maxFill != 0 && (minFill < 0 || maxFill <= minFill || maxFill > 1))
+  {
+    throw std::invalid_argument("The fills have to be 0 <= min < max <= 1.");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  min_fill_ = minFill;
+  max_fill_ = maxFill;
+  max_probability_ = maxProbability;
+  gated_.store(rate_ != 0 || max_fill_ != 0, std::memory_order_release);
+}
+
+/**
+ * @brief Adds a queue to the ones the early drop looks at
+ *
+ * @param queue The queue
+ */
+void pipeAdmission::Watch(pipeQueue *queue)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std::find(watched_.begin(), watched_.end(), queue) == watched_.end())
+  {
+    watched_.push_back(queue);
+  }
+}
+
+/**
+ * @brief Removes a queue from the ones the early drop looks at
+ *
+ * @param queue The queue
+ */
+void pipeAdmission::Unwatch(pipeQueue *queue)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  watched_.erase(std::remove(watched_.begin(), watched_.end(), queue), watched_.end());
+}
+
+/**
+ * @brief Sets what is done when the entry queue is full
+ *
+ * @param policy The full policy
+ */
+void pipeAdmission::full_policy(fullPolicy policy) { full_policy_ = policy; }
+
+/**
+ * @brief Sets what is done with the packets dropped by kDropOldest
+ *
+ * @details By default they are released.
+ *
+ * @param hook Called with every packet dropped
+ */
+void pipeAdmission::drop(dropHook hook) { drop_ = hook; }
+
+/**
+ * @brief Gets every packet shed, whatever the reason
+ *
+ * @return The packets rejected, over the rate, dropped early and dropped to
+ * make room
+ */
+uint64_t pipeAdmission::shed() const
+{
+  return rejected() + rate_limited() + early_dropped() + dropped_oldest();
+}
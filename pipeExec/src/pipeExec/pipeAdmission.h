@@ -0,0 +1,146 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeAdmission.h
+ *
+ * @brief The header file for the pipeAdmission class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeData.h"
+#include "pipeQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+/**
+ * @class pipeAdmission
+ *
+ * @brief Decides which packets enter a topology when it can not keep up
+ *
+ * @details The packets first go through two optional gates: a token bucket
+ * limiting the rate, and an early drop that sheds them with a probability
+ * growing with the depth of the queues downstream. The packets let in are
+ * pushed to the entry queue, and what happens when it is full is the full
+ * policy: wait, reject the packet, or drop the oldest one to make room. A
+ * packet shed by a gate or rejected stays with the caller.
+ */
+class pipeAdmission
+{
+public:
+  /**
+   * @enum fullPolicy
+   * @brief What is done when the entry queue is full
+   */
+  enum fullPolicy
+  {
+    kBlockFull,  /**< Waits for room, as a plain Push */
+    kRejectFull, /**< Gives the packet back to the caller */
+    kDropOldest  /**< Drops the next packet the queue would serve */
+  };
+
+  // Drops a packet taken out of the queue by kDropOldest
+  using dropHook = void (*)(pipeData *);
+
+  // Constructor
+  pipeAdmission(fullPolicy = kBlockFull);
+
+  // Lets a packet through the gates and pushes it. False if it was shed
+  bool Admit(pipeQueue *, pipeData *);
+
+  // Lets a packet through the rate limit and the early drop
+  bool Gate();
+
+  // Pushes an admitted packet according to the full policy
+  bool Push(pipeQueue *, pipeData *);
+
+  // Pushes an admitted packet only if there is room. Never blocks
+  bool TryPush(pipeQueue *, pipeData *);
+
+  // Limits the packets per second, with a burst. 0 for no limit
+  void rate(double, double = 1);
+
+  // Drops early between two fill levels of the queues watched
+  void early_drop(double, double, double = 1);
+
+  // Adds a queue to the ones the early drop looks at
+  void Watch(pipeQueue *);
+
+  // Removes a queue from the ones the early drop looks at
+  void Unwatch(pipeQueue *);
+
+  // Sets the full policy
+  void full_policy(fullPolicy);
+
+  // Sets what is done with the packets dropped by kDropOldest
+  void drop(dropHook);
+
+  // Getter. Returns the full policy
+  fullPolicy full_policy() const { return full_policy_; };
+
+  // Getter. Returns the packets pushed
+  uint64_t admitted() const { return admitted_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets given back because the queue was full
+  uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets shed by the rate limit
+  uint64_t rate_limited() const { return rate_limited_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets shed by the early drop
+  uint64_t early_dropped() const { return early_dropped_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the queued packets dropped to make room
+  uint64_t dropped_oldest() const { return dropped_oldest_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns every packet shed, whatever the reason
+  uint64_t shed() const;
+
+private:
+  double Fill() const;
+
+  fullPolicy full_policy_;        /**< What is done when the queue is full */
+  dropHook drop_;                 /**< Drops the packets taken by kDropOldest */
+  std::mutex mutex_;              /**< Protects the bucket and the random source */
+  double rate_;                   /**< Tokens added per second, 0 for no limit */
+  double burst_;                  /**< The most tokens the bucket holds */
+  double tokens_;                 /**< Tokens in the bucket */
+  uint64_t refill_ns_;            /**< The last time tokens were added */
+  double min_fill_;               /**< Fill where the early drop starts */
+  double max_fill_;               /**< Fill where everything is dropped, 0 if off */
+  double max_probability_;        /**< Drop probability right below max_fill_ */
+  std::atomic<bool> gated_;       /**< A rate or an early drop is set, read without the lock */
+  std::vector<pipeQueue *> watched_; /**< The queues the early drop looks at */
+  std::minstd_rand random_;       /**< The source of the early drops */
+  std::atomic<uint64_t> admitted_;       /**< Packets pushed */
+  std::atomic<uint64_t> rejected_;       /**< Packets given back, queue full */
+  std::atomic<uint64_t> rate_limited_;   /**< Packets over the rate */
+  std::atomic<uint64_t> early_dropped_;  /**< Packets dropped early */
+  std::atomic<uint64_t> dropped_oldest_; /**< Queued packets dropped for room */
+};
@@ -0,0 +1,328 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeAnalyzer.cpp
+ *
+ * @brief The source file for the pipeAnalyzer class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeAnalyzer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+
+/**
+ * @brief Constructor for the analysis of a pipeline
+ *
+ * @param pipe The pipeline to analyze
+ * @param target The utilization per instance the recommendations aim to
+ */
+pipeAnalyzer::pipeAnalyzer(Pipeline *pipe, double target)
+    : map_(pipe->oneDimPipe), axis_(0), target_(target), warmup_thread_(nullptr) {}
+
+/**
+ * @brief Constructor for the analysis of a mesh
+ *
+ * @param mesh The mesh to analyze
+ * @param target The utilization per instance the recommendations aim to
+ */
+pipeAnalyzer::pipeAnalyzer(Mesh *mesh, double target)
+    : map_(mesh->twoDimPipe), axis_(1), target_(target), warmup_thread_(nullptr) {}
+
+/**
+ * @brief Constructor for the analysis of a cube
+ *
+ * @param cube The cube to analyze
+ * @param target The utilization per instance the recommendations aim to
+ */
+pipeAnalyzer::pipeAnalyzer(Cube *cube, double target)
+    : map_(cube->threeDimPipe), axis_(2), target_(target), warmup_thread_(nullptr) {}
+
+/**
+ * @brief Destructor. Waits for the warmup thread if it is still running
+ */
+pipeAnalyzer::~pipeAnalyzer()
+{
+  if (warmup_thread_ != nullptr)
+  {
+    warmup_thread_->join();
+    delete warmup_thread_;
+  }
+}
+
+/**
+ * @brief Starts the analysis
+ *
+ * @details The nodes are collected from the map and, once the warmup time has
+ * elapsed, the baseline is taken from a background thread so the caller can
+ * keep feeding the topology. Starting it again waits for the warmup of the
+ * previous start first.
+ *
+ * @param warmupMs Milliseconds to wait before taking the baseline
+ */
+void pipeAnalyzer::Start(unsigned int warmupMs)
+{
+  if (warmup_thread_ != nullptr)
+  {
+    warmup_thread_->join();
+    delete warmup_thread_;
+    warmup_thread_ = nullptr;
+  }
+
+  Collect();
+
+  if (warmupMs == 0)
+  {
+    Baseline();
+    return;
+  }
+
+  // Take an initial baseline in case a report is asked during the warmup
+  Baseline();
+  warmup_thread_ = new std::thread([this, warmupMs]()
+                                   {
+                                     std::this_thread::sleep_for(std::chrono::milliseconds(warmupMs));
+                                     Baseline();
+                                   });
+}
+
+/**
+ * @brief Walks the map and keeps the nodes that have a processing unit
+ *
+ * @details The walk is done x, y, z so the nodes of a path are stored
+ * consecutively and in routing order.
+ */
+void pipeAnalyzer::Collect()
+{
+  nodes_.clear();
+
+  for (uint x = 0; map_->nodeExists(pipeMapper::nodeId(x, 0, 0)); ++x)
+  {
+    for (uint y = 0; map_->nodeExists(pipeMapper::nodeId(x, y, 0)); ++y)
+    {
+      for (uint z = 0; map_->nodeExists(pipeMapper::nodeId(x, y, z)); ++z)
+      {
+        auto node = (PipeNode *)map_->getPipeNode(pipeMapper::nodeId(x, y, z));
+        if (node->processing_unit() != nullptr)
+        {
+          nodes_.push_back(node);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Reads the current counters of a node and its input queue
+ *
+ * @param node The node to read
+ *
+ * @return The counters
+ */
+pipeAnalyzer::snapshot pipeAnalyzer::Take(PipeNode *node) const
+{
+  auto &stats = node->stats();
+  auto queue = node->in_data_queue();
+
+  return {stats.packets.load(std::memory_order_relaxed),
+          stats.busy_ns.load(std::memory_order_relaxed),
+          queue->pushes(),
+          queue->depth_sum(),
+          queue->full_waits()};
+}
+
+/**
+ * @brief Stores the counters of every node as the start of the window
+ */
+void pipeAnalyzer::Baseline()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  baseline_.clear();
+  for (auto node : nodes_)
+  {
+    baseline_.push_back(Take(node));
+    node->in_data_queue()->reset_high_water();
+  }
+  baseline_time_ = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Gets the path a node belongs to
+ *
+ * @param id The address of the node
+ *
+ * @return The same value for all the nodes of a path
+ */
+unsigned int pipeAnalyzer::PathOf(const pipeMapper::nodeId &id) const
+{
+  switch (axis_)
+  {
+  case 1:
+    return id.x;
+  case 2:
+    return (id.x << 16) | id.y;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Computes the figures of every node since the baseline
+ *
+ * @details The utilization is the busy time divided by the wall time of the
+ * window and the number of instances. The limiting stage of every path is the
+ * node with the highest utilization. The proposed instances bring every node
+ * to the target utilization, and the proposed queue size fits the bursts that
+ * were seen, doubling it where the producer had to block.
+ *
+ * @return A report per node
+ */
+std::vector<pipeAnalyzer::nodeReport> pipeAnalyzer::Report()
+{
+  std::vector<nodeReport> reports;
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - baseline_time_).count();
+  if (wall <= 0)
+    wall = 1e-9;
+
+  for (size_t it = 0; it < nodes_.size() && it < baseline_.size(); ++it)
+  {
+    auto node = nodes_[it];
+    auto now = Take(node);
+    auto &base = baseline_[it];
+    nodeReport report;
+
+    uint64_t packets = now.packets - base.packets;
+    uint64_t pushes = now.pushes - base.pushes;
+    double busy = (now.busy_ns - base.busy_ns) / 1e9;
+    int instances = std::max(node->number_of_instances(), 1);
+
+    report.address = node->getNodeAddress();
+    report.node_id = node->node_id();
+    report.instances = instances;
+    report.packets = packets;
+    report.throughput = packets / wall;
+    report.utilization = busy / (wall * instances);
+    report.service_ms = packets ? (busy * 1000.0) / packets : 0.0;
+    report.mean_depth = pushes ? (double)(now.depth_sum - base.depth_sum) / pushes : 0.0;
+    report.high_water = node->in_data_queue()->high_water();
+    report.queue_size = node->in_data_queue()->max_size();
+    report.full_waits = now.full_waits - base.full_waits;
+    report.bottleneck = false;
+
+    // Instances needed to keep every instance at the target utilization
+    report.recommended_instances = instances;
+    if (packets != 0)
+    {
+      report.recommended_instances = std::max(1, (int)std::ceil(busy / (wall * target_)));
+      if (node->min_instances() > report.recommended_instances)
+        report.recommended_instances = node->min_instances();
+      if (node->max_instances() != 0 && node->max_instances() < report.recommended_instances)
+        report.recommended_instances = node->max_instances();
+    }
+
+    // Queues only need to absorb the bursts, unless the producer blocked
+    if (report.full_waits != 0)
+      report.recommended_queue_size = report.queue_size * 2;
+    else
+      report.recommended_queue_size = std::max(2, (int)std::ceil(report.high_water * 1.25));
+
+    reports.push_back(report);
+  }
+
+  // The limiting stage of every path is the most utilized node
+  std::map<unsigned int, size_t> limiting;
+  for (size_t it = 0; it < reports.size(); ++it)
+  {
+    auto path = PathOf(reports[it].address);
+    auto found = limiting.find(path);
+    if (found == limiting.end() || reports[found->second].utilization < reports[it].utilization)
+      limiting[path] = it;
+  }
+  for (auto &entry : limiting)
+  {
+    auto &report = reports[entry.second];
+    report.bottleneck = true;
+    // A bigger queue in front of the limiting stage only adds latency
+    if (report.recommended_queue_size > report.queue_size)
+      report.recommended_queue_size = report.queue_size;
+  }
+
+  return reports;
+}
+
+/**
+ * @brief Prints the report of every node, the limiting stage of every path,
+ * the critical path and the recommended configuration.
+ */
+void pipeAnalyzer::Print()
+{
+  auto reports = Report();
+
+  std::map<unsigned int, double> latency;
+  for (auto &report : reports)
+  {
+    latency[PathOf(report.address)] += report.service_ms;
+  }
+
+  printf("NODE  ADDRESS        INST  PACKETS   PKT/S       UTIL    RUN(ms)   "
+         "QDEPTH  QHIGH  QSIZE  QFULL  -> INST  QSIZE\n");
+  for (auto &report : reports)
+  {
+    char address[48];
+    snprintf(address, sizeof(address), "[%u:%u:%u]", report.address.x, report.address.y, report.address.z);
+    printf("%-5d %-14s %-5d %-9lu %-11.2f %5.1f%%  %-9.3f %-7.2f %-6d %-6d %-6lu    %-5d %-5d%s\n",
+           report.node_id, address, report.instances, (unsigned long)report.packets, report.throughput,
+           report.utilization * 100.0, report.service_ms, report.mean_depth, report.high_water,
+           report.queue_size, (unsigned long)report.full_waits, report.recommended_instances,
+           report.recommended_queue_size, report.bottleneck ? "  <- limiting stage" : "");
+  }
+
+  // The critical path is the one with the longest service time
+  if (!latency.empty())
+  {
+    auto critical = latency.begin();
+    for (auto it = latency.begin(); it != latency.end(); ++it)
+    {
+      if (it->second > critical->second)
+        critical = it;
+    }
+
+    for (auto &report : reports)
+    {
+      if (report.bottleneck && PathOf(report.address) == critical->first)
+      {
+        printf("Critical path: %.3fms of service time, limited by node %d [%u:%u:%u] at %.1f%% "
+               "utilization with %d instances (recommended %d)\n",
+               critical->second, report.node_id, report.address.x, report.address.y, report.address.z,
+               report.utilization * 100.0, report.instances, report.recommended_instances);
+      }
+    }
+  }
+}
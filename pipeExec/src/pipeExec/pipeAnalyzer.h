@@ -0,0 +1,123 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeAnalyzer.h
+ *
+ * @brief The header file for the pipeAnalyzer class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeline.h"
+#include "mesh.h"
+#include "cube.h"
+#include <chrono>
+#include <thread>
+
+/**
+ * @class pipeAnalyzer
+ *
+ * @brief Finds the limiting stage of a running Pipeline, Mesh or Cube and
+ * proposes the number of instances and queue sizes for every node.
+ *
+ * @details The analyzer reads the counters kept by the nodes and their input
+ * queues. Once the warmup window has elapsed it takes a baseline, so the
+ * report only covers the steady state of the topology. Paths are followed
+ * along the axis the topology routes on: x for a Pipeline, y for every Mesh
+ * row and z for every Cube column.
+ */
+class pipeAnalyzer
+{
+public:
+  /**
+   * @brief The figures computed for a single node
+   */
+  struct nodeReport
+  {
+    pipeMapper::nodeId address; /**< The address of the node */
+    int node_id;                /**< The id of the node */
+    int instances;              /**< Instances running when reported */
+    uint64_t packets;           /**< Packets processed in the window */
+    double throughput;          /**< Packets per second */
+    double utilization;         /**< Busy time / wall time per instance */
+    double service_ms;          /**< Mean time spent inside Run */
+    double mean_depth;          /**< Mean input queue depth seen by arrivals */
+    int high_water;             /**< Highest input queue depth */
+    int queue_size;             /**< Size of the input queue */
+    uint64_t full_waits;        /**< Pushes that found the input queue full */
+    int recommended_instances;  /**< Proposed number of instances */
+    int recommended_queue_size; /**< Proposed size of the input queue */
+    bool bottleneck;            /**< True for the limiting stage of its path */
+  };
+
+  // Analyzer for the nodes of a pipeline
+  pipeAnalyzer(Pipeline *, double = 0.75);
+
+  // Analyzer for the rows of a mesh
+  pipeAnalyzer(Mesh *, double = 0.75);
+
+  // Analyzer for the columns of a cube
+  pipeAnalyzer(Cube *, double = 0.75);
+
+  // Waits for the warmup thread
+  ~pipeAnalyzer();
+
+  // Takes the baseline once the warmup time (ms) has elapsed
+  void Start(unsigned int = 0);
+
+  // Computes the figures of every node since the baseline
+  std::vector<nodeReport> Report();
+
+  // Prints the report, the critical path and the recommendations
+  void Print();
+
+private:
+  /**
+   * @brief The counters of a node at a given time
+   */
+  struct snapshot
+  {
+    uint64_t packets;
+    uint64_t busy_ns;
+    uint64_t pushes;
+    uint64_t depth_sum;
+    uint64_t full_waits;
+  };
+
+  void Collect();
+  void Baseline();
+  snapshot Take(PipeNode *) const;
+  unsigned int PathOf(const pipeMapper::nodeId &) const;
+
+  pipeMapper *map_;                 /**< The map of the topology analyzed */
+  int axis_;                        /**< Axis of the paths 0 = x, 1 = y, 2 = z */
+  double target_;                   /**< Utilization aimed per instance */
+  std::vector<PipeNode *> nodes_;   /**< Nodes sorted by path and position */
+  std::vector<snapshot> baseline_;  /**< Counters when the warmup ended */
+  std::chrono::steady_clock::time_point baseline_time_;
+  std::thread *warmup_thread_;      /**< Thread waiting for the warmup */
+  std::mutex mutex_;                /**< Protects the baseline */
+};
@@ -42,13 +42,37 @@
  * carrier for all the next data in the class.
  * @param debug The debug flag for showing the information inside the pipeData class
  */
-pipeData::pipeData(pipeData::dataPacket data, bool debug) : data_(data), debug_(debug) {}
+pipeData::pipeData(pipeData::dataPacket data, bool debug)
+    : data_(data), debug_(debug), node(nullptr), sequence_(0), passes_(0), route_(0), priority_(0), deadline_(0), parent_(nullptr), references_(1),
+      release_hook_(nullptr), release_arg_(nullptr) {}
 
 /**
  * @brief The data destructor.
- * @details Don't know what to do with it yet
+ * @details Deletes the extra data entries the packet created. The entries
+ * pushed with PushExtraData still belong to whoever pushed them.
  */
-pipeData::~pipeData() {}
+pipeData::~pipeData() { ClearExtraData(); }
+
+/**
+ * @brief Deletes the entries the packet owns and empties the extra data
+ */
+void pipeData::ClearExtraData()
+{
+  for (size_t it = 0; it < extra_data_.size(); ++it)
+  {
+    if (slots_[it] & kOwned)
+    {
+      delete extra_data_[it];
+    }
+  }
+  for (auto entry : retired_)
+  {
+    delete entry;
+  }
+  extra_data_.clear();
+  slots_.clear();
+  retired_.clear();
+}
 
 /**
  * @brief Pushes data to the extra data vector to be accessed later on if needed
@@ -58,6 +82,7 @@ pipeData::~pipeData() {}
 void pipeData::PushExtraData(DataKey *extra_data)
 {
   extra_data_.push_back(extra_data);
+  slots_.push_back(0);
 }
 
 /**
@@ -92,12 +117,26 @@ pipeData::dataPacket pipeData::resetExtraData(std::string key, pipeData::dataPac
 
   pipeData::dataPacket oldData;
 
-  for (const auto &entry : extra_data_)
+  for (size_t it = 0; it < extra_data_.size(); ++it)
   {
+    auto &entry = extra_data_[it];
     if (entry->key == key)
     {
       oldData = entry->data;
-      entry->data = newData;
+      // The others keep seeing the entry as it was
+      if (slots_[it] & kShared)
+      {
+        if (slots_[it] & kOwned)
+        {
+          retired_.push_back(entry);
+        }
+        entry = new DataKey{key, newData};
+        slots_[it] = kOwned;
+      }
+      else
+      {
+        entry->data = newData;
+      }
       return oldData;
     }
   }
@@ -130,7 +169,8 @@ bool pipeData::setDataKey(std::string key, pipeData::dataPacket data)
     DataKey *hold = new DataKey;
     hold->key = key;
     hold->data = data;
-    PushExtraData(hold);
+    extra_data_.push_back(hold);
+    slots_.push_back(kOwned);
     return true;
   }
   else
@@ -138,3 +178,155 @@ bool pipeData::setDataKey(std::string key, pipeData::dataPacket data)
     return false;
   }
 }
+
+/**
+ * @brief Creates a view of the packet for one branch of a broadcast
+ * @details The view points to the same data and starts with the same extra
+ * data entries, so nothing is copied but the list of entries. The keys set on
+ * the view are its own, and an entry changed on the view or on the packet is
+ * copied first. The packet keeps a reference for every view alive.
+ *
+ * The view has no release hook: it is deleted with its last reference and
+ * then drops the one it holds on the packet, so the hook of the packet runs
+ * once, after every view is gone.
+ *
+ * @return The view, released with Release()
+ */
+pipeData *pipeData::Share()
+{
+  auto view = new pipeData(data_, debug_);
+
+  // The entries are shared from now on, by the packet and by the view
+  for (auto &flags : slots_)
+  {
+    flags |= kShared;
+  }
+  view->extra_data_ = extra_data_;
+  view->slots_.assign(slots_.size(), kShared);
+  view->sequence_ = sequence_;
+  view->passes_ = passes_;
+  view->route_ = route_;
+  view->priority_ = priority_;
+  view->deadline_ = deadline_;
+  view->parent_ = this;
+  Retain();
+
+  return view;
+}
+
+/**
+ * @brief Adds the extra data of a view with the keys the packet does not have
+ * @details Used when the branches of a broadcast are joined, so the keys every
+ * branch set are seen after the join.
+ *
+ * @param view The view of a branch
+ */
+void pipeData::Merge(pipeData *view)
+{
+  for (size_t it = 0; it < view->extra_data_.size(); ++it)
+  {
+    auto entry = view->extra_data_[it];
+    if (!isKey(entry->key))
+    {
+      // The packet takes the ownership of the entries the view created
+      extra_data_.push_back(entry);
+      slots_.push_back(view->slots_[it] & kOwned);
+      view->slots_[it] &= ~kOwned;
+    }
+  }
+}
+
+/**
+ * @brief Adds a reference to the packet
+ */
+void pipeData::Retain() { references_.fetch_add(1, std::memory_order_relaxed); }
+
+/**
+ * @brief Drops a reference to the packet
+ * @details The last reference hands the packet to the release hook, or
+ * deletes it when there is none. A view then drops its reference on the
+ * packet it was shared from.
+ */
+void pipeData::Release()
+{
+  if (references_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+  {
+    return;
+  }
+
+  auto parent = parent_;
+  if (release_hook_ != nullptr)
+  {
+    release_hook_(this, release_arg_);
+  }
+  else
+  {
+    delete this;
+  }
+
+  if (parent != nullptr)
+  {
+    parent->Release();
+  }
+}
+
+/**
+ * @brief Sets what is done with the packet when the last reference is dropped
+ *
+ * @param hook The function called with the packet, nullptr to delete it
+ * @param arg The argument passed to the hook
+ */
+void pipeData::release_hook(releaseHook hook, void *arg)
+{
+  release_hook_ = hook;
+  release_arg_ = arg;
+}
+
+/**
+ * @brief Clears the packet so it can carry new data
+ * @details The release hook is kept, everything else is as after the
+ * constructor.
+ *
+ * @param data The new data of the packet
+ */
+void pipeData::Reset(pipeData::dataPacket data)
+{
+  ClearExtraData();
+  data_ = data;
+  node = nullptr;
+  sequence_ = 0;
+  passes_ = 0;
+  route_ = 0;
+  priority_ = 0;
+  deadline_ = 0;
+  parent_ = nullptr;
+  references_.store(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Sets the deadline of the packet from now
+ *
+ * @param timeout The time the packet has from now on
+ */
+void pipeData::expires_in(std::chrono::nanoseconds timeout)
+{
+  auto now = std::chrono::steady_clock::now().time_since_epoch() + timeout;
+  deadline_ = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+/**
+ * @brief Checks the deadline of the packet
+ *
+ * @details The clock is only read when the packet has a deadline.
+ *
+ * @return True if the packet has a deadline and it has passed
+ */
+bool pipeData::expired() const
+{
+  if (deadline_ == 0)
+  {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() > deadline_;
+}
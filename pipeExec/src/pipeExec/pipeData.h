@@ -33,6 +33,7 @@
 
 // #include "memory_manager.h"
 #include "pipeQueue.h"
+#include <chrono>
 // #include "pipe_node.h"
 
 class PipeNode; // Forward defintion
@@ -46,6 +47,12 @@ class PipeNode; // Forward defintion
  * @details This class provides functionallity to store multiple data via keys
  * and a pointer to the original data that was stored initially with the
  * creation of the class.
+ *
+ * The packet carries an atomic reference count. The last Release() hands the
+ * packet to its release hook (e.g. back to a pipeDataPool) or deletes it when
+ * there is none. Views made with Share() point to the same data and extra
+ * data entries; an entry shared between a packet and its views is copied
+ * before it is changed, so no branch sees the changes of another.
  */
 class pipeData
 {
@@ -92,14 +99,97 @@ void* GetExtraData(std::string) const;
 
   dataPacket resetExtraData(std::string key, dataPacket newData);
 
+  // Getter. The extra data entries, in the order they were set
+  const std::vector<DataKey *> &extra_data() const { return extra_data_; };
+
   PipeNode *getNodeData() { return node; };
 
   void setNodeData(PipeNode *nodeData) { node = nodeData; };
 
+  // The order of the packet, stamped where it enters. 0 if not stamped
+  uint64_t sequence() const { return sequence_; };
+
+  void sequence(uint64_t sequence) { sequence_ = sequence; };
+
+  // The laps completed around a closed Mesh or Cube
+  unsigned int passes() const { return passes_; };
+
+  void passes(unsigned int passes) { passes_ = passes; };
+
+  // The pipeMapper::route the packet takes on its next hop, 0 if none
+  uint32_t route() const { return route_; };
+
+  void route(uint32_t route) { route_ = route; };
+
+  // The priority lane the packet is pushed to, 0 the lowest
+  int priority() const { return priority_; };
+
+  void priority(int priority) { priority_ = priority; };
+
+  // The time the packet has to be done by, in ns of the steady clock. 0 if none
+  uint64_t deadline() const { return deadline_; };
+
+  void deadline(uint64_t deadline) { deadline_ = deadline; };
+
+  // Sets the deadline from now
+  void expires_in(std::chrono::nanoseconds);
+
+  // True if the packet has a deadline and it has passed
+  bool expired() const;
+
+  // Creates a view of the packet for one branch of a broadcast
+  pipeData *Share();
+
+  // Adds the extra data of a view with the keys the packet does not have
+  void Merge(pipeData *);
+
+  // The packet a view was shared from, nullptr if it is not a view
+  pipeData *parent() const { return parent_; };
+
+  // Adds a reference to the packet
+  void Retain();
+
+  // Drops a reference. The last one hands the packet to the release hook
+  void Release();
+
+  // Getter. The references held on the packet
+  int references() const { return references_.load(std::memory_order_acquire); };
+
+  // Called with the packet and the argument when the last reference is dropped
+  using releaseHook = void (*)(pipeData *, void *);
+
+  // Sets what is done with the packet when the last reference is dropped
+  void release_hook(releaseHook, void *);
+
+  // Clears the packet so it can carry new data
+  void Reset(dataPacket);
+
 private:
+  /**
+   * @brief The state of an extra data entry
+   */
+  enum slotFlags : unsigned char
+  {
+    kOwned = 1,  /**< Created by the packet, deleted with it */
+    kShared = 2  /**< Seen by a view or a parent, copied before a change */
+  };
+
+  void ClearExtraData();
+
   dataPacket data_;
   unsigned int index_;
   std::vector<DataKey *> extra_data_;
   bool debug_;
   PipeNode *node;
+  uint64_t sequence_;
+  unsigned int passes_;              /**< Laps completed around a closed loop */
+  uint32_t route_;                   /**< The route handle of the next hop */
+  int priority_;                     /**< The queue lane of the packet */
+  uint64_t deadline_;                /**< Steady clock ns to be done by, 0 if none */
+  pipeData *parent_;                 /**< The packet this one is a view of */
+  std::atomic<int> references_;      /**< The owner plus one per live view */
+  std::vector<unsigned char> slots_; /**< The slotFlags of every extra data entry */
+  std::vector<DataKey *> retired_;   /**< Owned entries replaced while shared */
+  releaseHook release_hook_;         /**< Takes the packet after the last release */
+  void *release_arg_;                /**< The argument of the release hook */
 };
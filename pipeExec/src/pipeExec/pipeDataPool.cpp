@@ -0,0 +1,150 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeDataPool.cpp
+ *
+ * @brief The source file for the pipeDataPool class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeDataPool.h"
+
+/**
+ * @brief Constructor
+ *
+ * @param capacity The most free packets kept
+ */
+pipeDataPool::pipeDataPool(int capacity) : state_(new poolState(capacity)) {}
+
+/**
+ * @brief Destructor
+ *
+ * @details The packets still in use keep the state of the pool and are
+ * deleted when they are released.
+ */
+pipeDataPool::~pipeDataPool()
+{
+  state_->closed.store(true, std::memory_order_release);
+  Unref(state_);
+}
+
+/**
+ * @brief Destructor of the state. Deletes the free packets
+ */
+pipeDataPool::poolState::~poolState()
+{
+  void *data;
+
+  while ((data = free.TryPop()) != nullptr)
+  {
+    delete (pipeData *)data;
+  }
+}
+
+/**
+ * @brief Drops a reference to the state, freeing it with the last one
+ *
+ * @param state The state of the pool
+ */
+void pipeDataPool::Unref(poolState *state)
+{
+  if (state->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    delete state;
+  }
+}
+
+/**
+ * @brief Gets a packet carrying the data with one reference
+ *
+ * @param data The data of the packet
+ *
+ * @return The packet. Release it instead of deleting it
+ */
+pipeData *pipeDataPool::Acquire(pipeData::dataPacket data)
+{
+  auto packet = (pipeData *)state_->free.TryPop();
+
+  if (packet == nullptr)
+  {
+    state_->allocated.fetch_add(1, std::memory_order_relaxed);
+    packet = new pipeData(data);
+  }
+  else
+  {
+    packet->Reset(data);
+  }
+  state_->references.fetch_add(1, std::memory_order_relaxed);
+  packet->release_hook(Recycle, state_);
+
+  return packet;
+}
+
+/**
+ * @brief The release hook of the packets of the pool
+ *
+ * @param data The packet whose last reference was released
+ * @param pool The state of the pool
+ */
+void pipeDataPool::Recycle(pipeData *data, void *pool)
+{
+  auto state = (poolState *)pool;
+
+  state->recycled.fetch_add(1, std::memory_order_relaxed);
+  if (state->closed.load(std::memory_order_acquire))
+  {
+    delete data;
+  }
+  else
+  {
+    data->Reset(nullptr);
+    if (!state->free.TryPush(data))
+    {
+      delete data;
+    }
+  }
+  Unref(state);
+}
+
+/**
+ * @brief Gets the free packets
+ *
+ * @return The packets ready to be taken
+ */
+int pipeDataPool::available() const { return state_->free.queue_count(); }
+
+/**
+ * @brief Gets the packets allocated by the pool
+ *
+ * @return The packets created
+ */
+uint64_t pipeDataPool::allocated() const { return state_->allocated.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Gets the packets given back to the pool
+ *
+ * @return The packets recycled
+ */
+uint64_t pipeDataPool::recycled() const { return state_->recycled.load(std::memory_order_relaxed); }
@@ -0,0 +1,91 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeDataPool.h
+ *
+ * @brief The header file for the pipeDataPool class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeData.h"
+#include <atomic>
+
+/**
+ * @class pipeDataPool
+ *
+ * @brief Recycles the pipeData packets instead of allocating them every time
+ *
+ * @details The packets are taken with Acquire and come back by themselves
+ * when their last reference is released. When the pool is full the packets
+ * coming back are deleted.
+ *
+ * The free packets live in a state shared with the packets in use, so the
+ * pool can be destroyed before them: the packets released afterwards are
+ * deleted and the last one frees the state.
+ */
+class pipeDataPool
+{
+public:
+  // Constructor. Keeps at most the given number of free packets
+  pipeDataPool(int);
+
+  // Destructor. The packets still in use are deleted when released
+  ~pipeDataPool();
+
+  // Gets a packet carrying the data with one reference
+  pipeData *Acquire(pipeData::dataPacket);
+
+  // Getter. Returns the free packets
+  int available() const;
+
+  // Getter. Returns the packets allocated by the pool
+  uint64_t allocated() const;
+
+  // Getter. Returns the packets given back to the pool
+  uint64_t recycled() const;
+
+private:
+  /**
+   * @brief What the pool shares with the packets it gave
+   */
+  struct poolState
+  {
+    poolState(int capacity) : free(capacity), allocated(0), recycled(0), references(1), closed(false) {}
+    ~poolState();
+
+    pipeQueue free;                  /**< The packets ready to be taken */
+    std::atomic<uint64_t> allocated; /**< Packets created by the pool */
+    std::atomic<uint64_t> recycled;  /**< Packets given back */
+    std::atomic<int> references;     /**< The pool plus one per packet in use */
+    std::atomic<bool> closed;        /**< The pool was destroyed */
+  };
+
+  static void Recycle(pipeData *, void *);
+  static void Unref(poolState *);
+
+  poolState *state_; /**< Freed with the last of the pool and its packets */
+};
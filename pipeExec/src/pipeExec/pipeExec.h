@@ -3,4 +3,6 @@
 #include "pipeline.h"
 #include "memory_manager.h"
 #include "pipeData.h"
-#include "processing_unit_interface.h"
\ No newline at end of file
+#include "processing_unit_interface.h"
+#include "async_processing_unit.h"
+#include "pipeLogger.h"
\ No newline at end of file
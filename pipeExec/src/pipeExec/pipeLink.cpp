@@ -0,0 +1,790 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeLink.cpp
+ *
+ * @brief The source file for the pipeLink class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeLink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const uint32_t kBatch = 1;  /**< A message carrying frames */
+static const uint32_t kCredit = 2; /**< A message granting credits */
+
+/**
+ * @brief What is written before every message
+ */
+struct linkHeader
+{
+  uint32_t length;   /**< The bytes of the message, header included */
+  uint32_t type;     /**< kBatch or kCredit */
+  uint32_t count;    /**< The frames of a batch or the credits granted */
+  uint32_t reserved; /**< Keeps the frames 8 byte aligned */
+};
+
+/**
+ * @brief The bytes before a frame received, where its sender is kept. Keeps
+ * the frame 8 byte aligned
+ */
+static const size_t kFrameOffset = 16;
+
+/**
+ * @brief The credits of the queue the senders push to
+ *
+ * @details Shared by the link and the senders it accepted, as the packets
+ * received can be released after the link is gone. Freed with the last.
+ */
+struct pipeLink::creditPool
+{
+  std::mutex mutex;                  /**< Protects the pool and its senders */
+  int size = 0;                      /**< The credits of the queue */
+  int free = 0;                      /**< The credits no sender holds */
+  std::vector<linkSender *> senders; /**< The senders still connected */
+  std::atomic<int> references{1};    /**< The link plus one per sender */
+};
+
+/**
+ * @brief A sender accepted by the link
+ */
+struct pipeLink::linkSender
+{
+  creditPool *pool;                  /**< Where its credits come from */
+  int fd;                            /**< The connection, -1 once it ended */
+  int held = 0;                      /**< Credits granted and not come back */
+  int queued = 0;                    /**< Packets received and not released */
+  int references = 1;                /**< The link plus one per packet queued */
+  std::thread *thread = nullptr;     /**< Its Receiver */
+  std::atomic<bool> finished{false}; /**< The Receiver has returned */
+};
+
+/**
+ * @brief Writes all the bytes to a socket
+ *
+ * @return False if the connection failed
+ */
+static bool WriteAll(int fd, const char *bytes, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t done = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (done < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (done <= 0)
+    {
+      return false;
+    }
+    bytes += done;
+    size -= done;
+  }
+  return true;
+}
+
+/**
+ * @brief Reads the given number of bytes from a socket
+ *
+ * @return False if the connection was closed or failed
+ */
+static bool ReadAll(int fd, char *bytes, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t done = recv(fd, bytes, size, 0);
+    if (done < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (done <= 0)
+    {
+      return false;
+    }
+    bytes += done;
+    size -= done;
+  }
+  return true;
+}
+
+/**
+ * @brief Constructor. Neither connected nor listening
+ *
+ * @param wire Writes and reads the frames, set up the same in both processes
+ */
+pipeLink::pipeLink(const pipeWire &wire)
+    : wire_(wire), batch_count_(0), writing_(false), credits_(0), fd_(-1), connected_(false), writer_(nullptr),
+      reader_(nullptr), listen_fd_(-1), target_(nullptr), acceptor_(nullptr), pool_(nullptr), sent_(0), batches_(0), bytes_(0),
+      credit_waits_(0), refused_(0), received_(0)
+{
+}
+
+/**
+ * @brief Destructor. Closes the link
+ */
+pipeLink::~pipeLink() { Close(); }
+
+/**
+ * @brief Opens a socket to connect to or to listen on an address
+ *
+ * @param address "unix:<path>" or "tcp:<host>:<port>"
+ * @param listening True to bind and listen
+ *
+ * @throws std::invalid_argument if the address has no known scheme
+ *
+ * @return The socket, -1 if it failed
+ */
+int pipeLink::Open(std::string address, bool listening)
+{
+  if (address.compare(0, 5, "unix:") == 0)
+  {
+    std::string path = address.substr(5);
+    struct sockaddr_un name = {};
+    if (path.size() >= sizeof(name.sun_path))
+    {
+      return -1;
+    }
+    name.sun_family = AF_UNIX;
+    strcpy(name.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening)
+    {
+      unlink(path.c_str());
+      if (fd >= 0 && (bind(fd, (struct sockaddr *)&name, sizeof(name)) != 0 || listen(fd, 16) != 0))
+      {
+        close(fd);
+        return -1;
+      }
+    }
+    else if (fd >= 0 && connect(fd, (struct sockaddr *)&name, sizeof(name)) != 0)
+    {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  if (address.compare(0, 4, "tcp:") != 0)
+  {
+    throw std::invalid_argument("Unknown link address " + address + ".");
+  }
+
+  auto colon = address.rfind(':');
+  std::string host = address.substr(4, colon - 4);
+  std::string port = address.substr(colon + 1);
+  struct addrinfo hints = {};
+  struct addrinfo *found = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0)
+  {
+    return -1;
+  }
+
+  int fd = -1;
+  for (auto it = found; it != nullptr && fd < 0; it = it->ai_next)
+  {
+    fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+    if (fd < 0)
+    {
+      continue;
+    }
+    int on = 1;
+    if (listening)
+    {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (bind(fd, it->ai_addr, it->ai_addrlen) != 0 || listen(fd, 16) != 0)
+      {
+        close(fd);
+        fd = -1;
+      }
+    }
+    else if (connect(fd, it->ai_addr, it->ai_addrlen) != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+    else
+    {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+  }
+  freeaddrinfo(found);
+
+  // Tell the port taken when any port would do
+  if (fd >= 0 && listening && port == "0")
+  {
+    struct sockaddr_storage name;
+    socklen_t length = sizeof(name);
+    getsockname(fd, (struct sockaddr *)&name, &length);
+    int taken = name.ss_family == AF_INET6 ? ntohs(((struct sockaddr_in6 *)&name)->sin6_port)
+                                           : ntohs(((struct sockaddr_in *)&name)->sin_port);
+    address_ = "tcp:" + host + ":" + std::to_string(taken);
+  }
+  return fd;
+}
+
+/**
+ * @brief Connects to a listening link
+ *
+ * @details Called again after the link went down, it reconnects to the same
+ * address. Nothing is sent until the receiver grants the first credits.
+ *
+ * @param address "unix:<path>" or "tcp:<host>:<port>", empty to use the one
+ * given before
+ *
+ * @return True if connected
+ */
+bool pipeLink::Connect(std::string address)
+{
+  std::lock_guard<std::mutex> guard(connect_mutex_);
+
+  if (!address.empty())
+  {
+    address_ = address;
+  }
+  if (connected_)
+  {
+    return true;
+  }
+
+  // The threads of the last connection have seen it fail
+  for (auto thread : {writer_, reader_})
+  {
+    if (thread != nullptr)
+    {
+      thread->join();
+      delete thread;
+    }
+  }
+  writer_ = reader_ = nullptr;
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  int fd = Open(address_, false);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch_.clear();
+    batch_count_ = 0;
+    credits_ = 0;
+    fd_ = fd;
+    connected_ = true;
+  }
+  writer_ = new std::thread(&pipeLink::Writer, this, fd);
+  reader_ = new std::thread(&pipeLink::CreditReader, this, fd);
+  return true;
+}
+
+/**
+ * @brief Marks the connection as failed and wakes everybody waiting on it
+ */
+void pipeLink::Disconnect()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (connected_)
+  {
+    connected_ = false;
+    shutdown(fd_, SHUT_RDWR);
+  }
+  ready_.notify_all();
+  credited_.notify_all();
+}
+
+/**
+ * @brief Queues a packet in the next batch and releases it
+ *
+ * @details Waits for a credit first. The batch is written as soon as the
+ * writer is done with the previous one. The packets of a batch being written
+ * when the connection fails are lost.
+ *
+ * @param data The packet
+ *
+ * @return True if it was queued, false if the link is down and then it is
+ * still the caller's
+ */
+bool pipeLink::Send(pipeData *data)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  if (connected_ && credits_ <= 0)
+  {
+    credit_waits_.fetch_add(1, std::memory_order_relaxed);
+    credited_.wait(lock, [this]() { return credits_ > 0 || !connected_; });
+  }
+  if (!connected_)
+  {
+    refused_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if (batch_count_ == 0)
+  {
+    batch_.resize(sizeof(linkHeader));
+  }
+  wire_.Serialize(data, batch_);
+  --credits_;
+  ++batch_count_;
+  lock.unlock();
+  ready_.notify_all();
+
+  sent_.fetch_add(1, std::memory_order_relaxed);
+  data->Release();
+  return true;
+}
+
+/**
+ * @brief Writes the batches while the connection is up
+ *
+ * @param fd The connection
+ */
+void pipeLink::Writer(int fd)
+{
+  std::string sending;
+
+  while (true)
+  {
+    uint32_t count;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return batch_count_ > 0 || !connected_; });
+      if (!connected_)
+      {
+        return;
+      }
+      sending.swap(batch_);
+      count = batch_count_;
+      batch_count_ = 0;
+      writing_ = true;
+    }
+
+    linkHeader header = {(uint32_t)sending.size(), kBatch, count, 0};
+    memcpy(&sending[0], &header, sizeof(header));
+    bool written = WriteAll(fd, sending.data(), sending.size());
+    if (written)
+    {
+      batches_.fetch_add(1, std::memory_order_relaxed);
+      bytes_.fetch_add(sending.size(), std::memory_order_relaxed);
+    }
+    sending.clear();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      writing_ = false;
+    }
+    ready_.notify_all();
+    if (!written)
+    {
+      Disconnect();
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Reads the credits granted while the connection is up
+ *
+ * @param fd The connection
+ */
+void pipeLink::CreditReader(int fd)
+{
+  linkHeader header;
+
+  while (ReadAll(fd, (char *)&header, sizeof(header)))
+  {
+    if (header.type == kCredit)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      credits_ += header.count;
+      credited_.notify_all();
+    }
+  }
+  Disconnect();
+}
+
+/**
+ * @brief Accepts senders and pushes their packets to a queue
+ *
+ * @param address "unix:<path>" or "tcp:<host>:<port>"
+ * @param queue The queue the packets are pushed to. Its size is the credit
+ * shared by the senders
+ *
+ * @throws std::logic_error if the link is already listening
+ *
+ * @return True if listening
+ */
+bool pipeLink::Listen(std::string address, pipeQueue *queue)
+{
+  std::lock_guard<std::mutex> guard(connect_mutex_);
+
+  if (listen_fd_ >= 0)
+  {
+    throw std::logic_error("The link is already listening.");
+  }
+
+  address_ = address;
+  target_ = queue;
+  listen_fd_ = Open(address, true);
+  if (listen_fd_ < 0)
+  {
+    return false;
+  }
+  pool_ = new creditPool;
+  pool_->size = pool_->free = queue->max_size();
+  cancel_.Reset();
+  acceptor_ = new std::thread(&pipeLink::Acceptor, this);
+  return true;
+}
+
+/**
+ * @brief Accepts the senders until the link is closed
+ */
+void pipeLink::Acceptor()
+{
+  while (true)
+  {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (fd < 0)
+    {
+      return;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    Reap(false);
+    auto sender = new linkSender;
+    sender->pool = pool_;
+    sender->fd = fd;
+    pool_->references.fetch_add(1, std::memory_order_relaxed);
+    sender->thread = new std::thread(&pipeLink::Receiver, this, sender);
+    receivers_.push_back(sender);
+  }
+}
+
+/**
+ * @brief Joins the receivers whose connection has ended
+ *
+ * @param all True to join them all, once their connections are shut down
+ */
+void pipeLink::Reap(bool all)
+{
+  for (auto it = receivers_.begin(); it != receivers_.end();)
+  {
+    auto sender = *it;
+    if (!all && !sender->finished.load(std::memory_order_acquire))
+    {
+      ++it;
+      continue;
+    }
+    sender->thread->join();
+    delete sender->thread;
+    sender->thread = nullptr;
+    it = receivers_.erase(it);
+    Unref(sender);
+  }
+}
+
+/**
+ * @brief Grants the free credits to the senders below their share of the
+ * queue. Called with the mutex of the pool held
+ *
+ * @details The share is the size of the queue over the senders connected,
+ * at least one. The senders above it, e.g. when another one connects, keep
+ * their credits until they come back.
+ *
+ * @param pool The credits of the queue
+ */
+void pipeLink::Share(creditPool *pool)
+{
+  if (pool->senders.empty())
+  {
+    return;
+  }
+
+  int share = std::max(1, pool->size / (int)pool->senders.size());
+  for (auto sender : pool->senders)
+  {
+    int grant = std::min(share - sender->held, pool->free);
+    if (grant <= 0)
+    {
+      continue;
+    }
+    linkHeader header = {sizeof(linkHeader), kCredit, (uint32_t)grant, 0};
+    if (WriteAll(sender->fd, (const char *)&header, sizeof(header)))
+    {
+      sender->held += grant;
+      pool->free -= grant;
+    }
+  }
+}
+
+/**
+ * @brief Drops a reference to a sender, freeing it and its reference to the
+ * pool with the last one
+ *
+ * @param sender The sender
+ */
+void pipeLink::Unref(linkSender *sender)
+{
+  auto pool = sender->pool;
+  bool last;
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    last = --sender->references == 0;
+  }
+  if (!last)
+  {
+    return;
+  }
+  delete sender;
+  if (pool->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    delete pool;
+  }
+}
+
+/**
+ * @brief The release hook of the packets received
+ *
+ * @details Frees the frame and gives the credit of the packet back, to be
+ * shared again among the senders connected.
+ *
+ * @param data The packet
+ * @param arg The block of its frame, its sender at the start
+ */
+void pipeLink::ReturnCredit(pipeData *data, void *arg)
+{
+  auto block = (char *)arg;
+  linkSender *sender;
+
+  memcpy(&sender, block, sizeof(sender));
+  delete data;
+  delete[] block;
+  {
+    std::lock_guard<std::mutex> lock(sender->pool->mutex);
+    --sender->held;
+    --sender->queued;
+    ++sender->pool->free;
+    Share(sender->pool);
+  }
+  Unref(sender);
+}
+
+/**
+ * @brief Pushes the packets of a sender to the queue
+ *
+ * @details The packets carry their credit back when they are released. A
+ * sender going beyond its credits is disconnected. When the connection ends
+ * the credits the sender did not use are shared among the others.
+ *
+ * @param sender The sender
+ */
+void pipeLink::Receiver(linkSender *sender)
+{
+  auto pool = sender->pool;
+  int fd = sender->fd;
+  linkHeader header;
+  std::string batch;
+  bool running = true;
+
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->senders.push_back(sender);
+    Share(pool);
+  }
+
+  while (running && ReadAll(fd, (char *)&header, sizeof(header)))
+  {
+    if (header.type != kBatch || header.length < sizeof(header))
+    {
+      break;
+    }
+    batch.resize(header.length - sizeof(header));
+    if (!ReadAll(fd, &batch[0], batch.size()))
+    {
+      break;
+    }
+
+    size_t at = 0;
+    uint64_t pushed = 0;
+    for (uint32_t it = 0; running && it < header.count; ++it)
+    {
+      size_t length = pipeWire::FrameLength(batch.data() + at, batch.size() - at);
+      {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        running = length > 0 && sender->queued < sender->held;
+        if (running)
+        {
+          ++sender->queued;
+          ++sender->references;
+        }
+      }
+      if (!running)
+      {
+        break;
+      }
+
+      // The frame is kept after its sender, until the packet is released
+      auto block = new char[kFrameOffset + length];
+      pipeData *data = nullptr;
+      memcpy(block, &sender, sizeof(sender));
+      memcpy(block + kFrameOffset, batch.data() + at, length);
+      try
+      {
+        data = wire_.Deserialize(block + kFrameOffset, length);
+      }
+      catch (const std::exception &)
+      {
+      }
+      if (data == nullptr)
+      {
+        delete[] block;
+        {
+          std::lock_guard<std::mutex> lock(pool->mutex);
+          --sender->queued;
+        }
+        Unref(sender);
+        running = false;
+        break;
+      }
+
+      data->release_hook(ReturnCredit, block);
+      if (!target_->PushUntil(data, std::chrono::steady_clock::time_point::max(), data->priority(), &cancel_))
+      {
+        data->Release();
+        running = false;
+      }
+      else
+      {
+        ++pushed;
+        at += length;
+      }
+    }
+    received_.fetch_add(pushed, std::memory_order_relaxed);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->senders.erase(std::find(pool->senders.begin(), pool->senders.end(), sender));
+    close(fd);
+    sender->fd = -1;
+    pool->free += sender->held - sender->queued;
+    sender->held = sender->queued;
+    Share(pool);
+  }
+  sender->finished.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Closes the connection and stops listening
+ *
+ * @details The sender first waits for the batch queued to be written. The
+ * receivers stop, even if they are waiting for room in the queue.
+ */
+void pipeLink::Close()
+{
+  std::lock_guard<std::mutex> guard(connect_mutex_);
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this]() { return (batch_count_ == 0 && !writing_) || !connected_; });
+  }
+  Disconnect();
+  for (auto thread : {writer_, reader_})
+  {
+    if (thread != nullptr)
+    {
+      thread->join();
+      delete thread;
+    }
+  }
+  writer_ = reader_ = nullptr;
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  if (listen_fd_ < 0)
+  {
+    return;
+  }
+  cancel_.Cancel();
+  shutdown(listen_fd_, SHUT_RDWR);
+  acceptor_->join();
+  delete acceptor_;
+  acceptor_ = nullptr;
+  close(listen_fd_);
+  listen_fd_ = -1;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    for (auto sender : pool_->senders)
+    {
+      shutdown(sender->fd, SHUT_RDWR);
+    }
+  }
+  Reap(true);
+  if (pool_->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    delete pool_;
+  }
+  pool_ = nullptr;
+  if (address_.compare(0, 5, "unix:") == 0)
+  {
+    unlink(address_.substr(5).c_str());
+  }
+}
+
+/**
+ * @brief Gets the address connected to or listened on
+ *
+ * @return The address, with the port taken when listening on port 0
+ */
+std::string pipeLink::address() const { return address_; }
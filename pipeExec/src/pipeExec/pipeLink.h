@@ -0,0 +1,151 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeLink.h
+ *
+ * @brief Declaration of the pipeLink class methods
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeQueue.h"
+#include "pipeWire.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class pipeLink
+ *
+ * @brief Carries packets to a pipeExec process over a Unix domain or a TCP
+ * socket
+ *
+ * @details The sending side serializes every packet with a pipeWire into
+ * the next batch, and a writer thread sends each batch as one length framed
+ * message, so the packets sent while the previous batch is being written go
+ * together. The receiving side pushes the packets to a local queue, e.g. the
+ * input queue of the node at the same address of a Cube in the other
+ * process.
+ *
+ * The flow is controlled with credits: the receiver shares as many as its
+ * queue holds among the senders connected, and a credit comes back when the
+ * packet it was used for is released, so the senders together never have
+ * more packets on the way or queued than the queue would hold. A sender
+ * without credits waits.
+ *
+ * The addresses are "unix:<path>" and "tcp:<host>:<port>". Port 0 listens on
+ * a free port, told by address().
+ */
+class pipeLink
+{
+public:
+  // Constructor. Neither connected nor listening
+  pipeLink(const pipeWire &);
+
+  // Destructor. Closes the link
+  ~pipeLink();
+
+  // Sender. Connects to a listening link. The address is kept to reconnect
+  bool Connect(std::string = "");
+
+  // Sender. Queues a packet in the next batch and releases it
+  bool Send(pipeData *);
+
+  // Receiver. Accepts senders and pushes their packets to the queue
+  bool Listen(std::string, pipeQueue *);
+
+  // Closes the connection and stops listening
+  void Close();
+
+  // Getter. True while the sender is connected
+  bool connected() const { return connected_.load(); };
+
+  // Getter. Returns the address connected to or listened on
+  std::string address() const;
+
+  // Getter. Returns the packets sent
+  uint64_t sent() const { return sent_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the batches written
+  uint64_t batches() const { return batches_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the bytes written
+  uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the sends that had to wait for a credit
+  uint64_t credit_waits() const { return credit_waits_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets refused because the link was down
+  uint64_t refused() const { return refused_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets received and pushed to the queue
+  uint64_t received() const { return received_.load(std::memory_order_relaxed); };
+
+private:
+  struct creditPool;
+  struct linkSender;
+
+  void Disconnect();
+  void Writer(int);
+  void CreditReader(int);
+  void Acceptor();
+  void Receiver(linkSender *);
+  int Open(std::string, bool);
+  void Reap(bool);
+  static void Share(creditPool *);
+  static void Unref(linkSender *);
+  static void ReturnCredit(pipeData *, void *);
+
+  const pipeWire &wire_;          /**< Writes and reads the frames */
+  std::string address_;           /**< The address connected to or listened on */
+  std::mutex connect_mutex_;      /**< Serializes Connect and Close */
+  std::mutex mutex_;              /**< Protects the batch and the credits */
+  std::condition_variable ready_; /**< Signaled when a batch is there or written */
+  std::condition_variable credited_; /**< Signaled when credits are granted */
+  std::string batch_;             /**< The message being filled */
+  uint32_t batch_count_;          /**< The packets in it */
+  bool writing_;                  /**< A batch is being written */
+  int64_t credits_;               /**< The packets the receiver can take */
+  int fd_;                        /**< The connection of the sender */
+  std::atomic<bool> connected_;   /**< False once the connection fails */
+  std::thread *writer_;           /**< Writes the batches */
+  std::thread *reader_;           /**< Reads the credits */
+  int listen_fd_;                 /**< The listening socket */
+  pipeQueue *target_;             /**< Where the packets received go */
+  cancelToken cancel_;            /**< Interrupts the receivers */
+  std::thread *acceptor_;         /**< Accepts the senders */
+  creditPool *pool_;              /**< The credits of the queue, shared by the senders */
+  std::vector<linkSender *> receivers_; /**< The senders accepted, until joined */
+  std::atomic<uint64_t> sent_;         /**< Packets sent */
+  std::atomic<uint64_t> batches_;      /**< Batches written */
+  std::atomic<uint64_t> bytes_;        /**< Bytes written */
+  std::atomic<uint64_t> credit_waits_; /**< Sends that waited for a credit */
+  std::atomic<uint64_t> refused_;      /**< Sends refused, link down */
+  std::atomic<uint64_t> received_;     /**< Packets received */
+};
@@ -0,0 +1,253 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeLogger.cpp
+ *
+ * @brief The source file for the pipeLogger class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeLogger.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+
+/**
+ * @brief Current time of the monotonic clock in ns
+ */
+static uint64_t NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Marks the ring of a thread as orphan when the thread finishes, so
+ * the flusher frees it once it has been drained.
+ */
+struct ringOwner
+{
+  pipeLogger::ring *ring = nullptr;
+
+  ~ringOwner()
+  {
+    if (ring != nullptr)
+      ring->orphan.store(true, std::memory_order_release);
+  }
+};
+
+/**
+ * @brief Writes the pending messages when the process exits
+ */
+static void FlushAtExit() { pipeLogger::instance().Flush(); }
+
+/**
+ * @brief Gets the logger of the process
+ *
+ * @details The logger is never destroyed, so threads still running while the
+ * process exits can keep logging safely.
+ *
+ * @return The logger
+ */
+pipeLogger &pipeLogger::instance()
+{
+  static pipeLogger *logger = new pipeLogger;
+
+  return *logger;
+}
+
+/**
+ * @brief Constructor. Starts the flusher thread
+ */
+pipeLogger::pipeLogger()
+    : output_(stdout), threshold_(PIPEEXEC_LOG_LEVEL), dropped_(0), threads_(0), start_ns_(NowNs())
+{
+  flusher_ = new std::thread(&pipeLogger::Run, this);
+  flusher_->detach();
+  atexit(FlushAtExit);
+}
+
+/**
+ * @brief Gets the ring of the calling thread, creating it the first time
+ *
+ * @return The ring
+ */
+pipeLogger::ring *pipeLogger::ThreadRing()
+{
+  thread_local ringOwner owner;
+
+  if (owner.ring == nullptr)
+  {
+    owner.ring = new ring;
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    owner.ring->thread = threads_++;
+    rings_.push_back(owner.ring);
+  }
+
+  return owner.ring;
+}
+
+/**
+ * @brief Formats a message into the ring of the calling thread
+ *
+ * @details No lock is taken: only the calling thread writes its ring. The
+ * flusher is only woken up when the ring gets half full, the rest of the
+ * time it finds the messages on its periodic pass.
+ *
+ * @param severity The level of the message
+ * @param format The printf format
+ */
+void pipeLogger::Log(level severity, const char *format, ...)
+{
+  auto own = ThreadRing();
+  uint64_t head = own->head.load(std::memory_order_relaxed);
+  uint64_t tail = own->tail.load(std::memory_order_acquire);
+
+  if (head - tail >= (uint64_t)kRingSize)
+  {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto &slot = own->slots[head % kRingSize];
+  va_list args;
+
+  slot.time_ns = NowNs();
+  slot.severity = severity;
+  va_start(args, format);
+  vsnprintf(slot.text, sizeof(slot.text), format, args);
+  va_end(args);
+
+  own->head.store(head + 1, std::memory_order_release);
+
+  if (head - tail == kRingSize / 2)
+    wake_.notify_one();
+}
+
+/**
+ * @brief Writes the messages of every ring and frees the orphan rings
+ */
+void pipeLogger::Drain()
+{
+  static const char *names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+  std::vector<ring *> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings = rings_;
+  }
+
+  for (auto own : rings)
+  {
+    // Read the orphan flag first: once set, no more messages will come
+    bool orphan = own->orphan.load(std::memory_order_acquire);
+    uint64_t head = own->head.load(std::memory_order_acquire);
+    uint64_t tail = own->tail.load(std::memory_order_relaxed);
+
+    for (; tail != head; ++tail)
+    {
+      auto &slot = own->slots[tail % kRingSize];
+      uint64_t elapsed = slot.time_ns - start_ns_;
+      fprintf(output_, "%lu.%06lu %-7s [T%u] %s\n", (unsigned long)(elapsed / 1000000000),
+              (unsigned long)((elapsed / 1000) % 1000000), names[slot.severity], own->thread, slot.text);
+    }
+    own->tail.store(tail, std::memory_order_release);
+
+    if (orphan)
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      for (auto it = rings_.begin(); it != rings_.end(); ++it)
+      {
+        if (*it == own)
+        {
+          rings_.erase(it);
+          break;
+        }
+      }
+      delete own;
+    }
+  }
+
+  fflush(output_);
+}
+
+/**
+ * @brief Writes every message logged so far by any thread
+ */
+void pipeLogger::Flush()
+{
+  std::lock_guard<std::mutex> lock(drain_mutex_);
+  Drain();
+}
+
+/**
+ * @brief The flusher thread. Drains the rings every few milliseconds or as
+ * soon as a ring gets half full.
+ */
+void pipeLogger::Run()
+{
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(5));
+    }
+    Flush();
+  }
+}
+
+/**
+ * @brief Sets the output of the messages
+ *
+ * @param file The file to write to. It is not closed by the logger
+ */
+void pipeLogger::output(FILE *file)
+{
+  std::lock_guard<std::mutex> lock(drain_mutex_);
+  output_ = file;
+}
+
+/**
+ * @brief Sets the lowest level written. The levels removed at compile time by
+ * PIPEEXEC_LOG_LEVEL can not be brought back
+ *
+ * @param lowest The lowest level written
+ */
+void pipeLogger::threshold(level lowest) { threshold_ = lowest; }
+
+/**
+ * @brief Gets the lowest level written
+ *
+ * @return The level
+ */
+pipeLogger::level pipeLogger::threshold() const { return (level)threshold_.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Gets the number of messages dropped because a ring was full
+ *
+ * @return The messages dropped
+ */
+uint64_t pipeLogger::dropped() const { return dropped_.load(std::memory_order_relaxed); }
@@ -0,0 +1,186 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeLogger.h
+ *
+ * @brief The header file for the pipeLogger class and the logging macros
+ *
+ * @details Use the macros, not the class: PIPE_DEBUG, PIPE_INFO, PIPE_WARNING
+ * and PIPE_ERROR take printf arguments. The levels below PIPEEXEC_LOG_LEVEL
+ * (0 debug, 1 info, 2 warning, 3 error, 4 off) are removed by the
+ * preprocessor, so with the default level the debug messages of the hot path
+ * compile to nothing.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef PIPEEXEC_LOG_LEVEL
+#define PIPEEXEC_LOG_LEVEL 1
+#endif
+
+/**
+ * @class pipeLogger
+ *
+ * @brief A leveled logger that never blocks the threads that log
+ *
+ * @details Every thread formats its messages into its own single producer
+ * ring, so logging takes no lock. A background thread drains the rings and
+ * writes the messages to the output. When a ring is full the message is
+ * dropped and counted instead of waiting for the flusher.
+ */
+class pipeLogger
+{
+public:
+  /**
+   * @enum level
+   * @brief The severity of a message
+   */
+  enum level
+  {
+    kDebug,
+    kInfo,
+    kWarning,
+    kError,
+    kOff
+  };
+
+  // Gets the logger of the process
+  static pipeLogger &instance();
+
+  // Formats a message into the ring of the calling thread
+  void Log(level, const char *, ...) __attribute__((format(printf, 3, 4)));
+
+  // Writes every message logged so far
+  void Flush();
+
+  // Sets the output of the messages (stdout by default)
+  void output(FILE *);
+
+  // Sets the lowest level written at run time
+  void threshold(level);
+
+  // Gets the lowest level written at run time
+  level threshold() const;
+
+  // Gets the number of messages dropped because a ring was full
+  uint64_t dropped() const;
+
+private:
+  static const int kMessageSize = 240; /**< Bytes of text per message */
+  static const int kRingSize = 256;    /**< Messages per thread ring */
+
+  /**
+   * @brief A message waiting to be written
+   */
+  struct record
+  {
+    uint64_t time_ns;
+    level severity;
+    char text[kMessageSize];
+  };
+
+  /**
+   * @brief The single producer ring of a thread
+   */
+  struct ring
+  {
+    std::atomic<uint64_t> head{0};    /**< Next slot written by the thread */
+    std::atomic<uint64_t> tail{0};    /**< Next slot read by the flusher */
+    std::atomic<bool> orphan{false};  /**< The thread has finished */
+    unsigned int thread;              /**< The number given to the thread */
+    record slots[kRingSize];
+  };
+
+  friend struct ringOwner;
+
+  pipeLogger();
+  ring *ThreadRing();
+  void Drain();
+  void Run();
+
+  std::vector<ring *> rings_;        /**< The rings of every thread */
+  std::mutex rings_mutex_;           /**< Protects the list of rings */
+  std::mutex drain_mutex_;           /**< Only one consumer at a time */
+  std::condition_variable wake_;     /**< Wakes up the flusher */
+  std::mutex wake_mutex_;            /**< The mutex of the condition */
+  std::thread *flusher_;             /**< The background thread */
+  FILE *output_;                     /**< Where the messages are written */
+  std::atomic<int> threshold_;       /**< The lowest level written */
+  std::atomic<uint64_t> dropped_;    /**< Messages lost because of full rings */
+  unsigned int threads_;             /**< Threads that have logged */
+  uint64_t start_ns_;                /**< The time the logger was created */
+};
+
+#define PIPE_LOG(severity, ...)                                     \
+  do                                                                \
+  {                                                                 \
+    if ((int)(severity) >= (int)pipeLogger::instance().threshold()) \
+      pipeLogger::instance().Log(severity, __VA_ARGS__);            \
+  } while (0)
+
+#if PIPEEXEC_LOG_LEVEL <= 0
+#define PIPE_DEBUG(...) PIPE_LOG(pipeLogger::kDebug, __VA_ARGS__)
+#else
+#define PIPE_DEBUG(...) \
+  do                    \
+  {                     \
+  } while (0)
+#endif
+
+#if PIPEEXEC_LOG_LEVEL <= 1
+#define PIPE_INFO(...) PIPE_LOG(pipeLogger::kInfo, __VA_ARGS__)
+#else
+#define PIPE_INFO(...) \
+  do                   \
+  {                    \
+  } while (0)
+#endif
+
+#if PIPEEXEC_LOG_LEVEL <= 2
+#define PIPE_WARNING(...) PIPE_LOG(pipeLogger::kWarning, __VA_ARGS__)
+#else
+#define PIPE_WARNING(...) \
+  do                      \
+  {                       \
+  } while (0)
+#endif
+
+#if PIPEEXEC_LOG_LEVEL <= 3
+#define PIPE_ERROR(...) PIPE_LOG(pipeLogger::kError, __VA_ARGS__)
+#else
+#define PIPE_ERROR(...) \
+  do                    \
+  {                     \
+  } while (0)
+#endif
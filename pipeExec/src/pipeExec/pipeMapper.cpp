@@ -19,6 +19,7 @@ pipeMapper::pipeMapper(uint dimensions, uint xRange, uint yRange)
     xRange_ = xRange;
     yRange_ = yRange;
     x_ = y_ = z_ = 0;
+    route_nodes_.assign(kWriteOut + 1, nullptr);
 }
 
 pipeMapper::nodeId pipeMapper::addNode(void *node, std::string nodeName)
@@ -98,29 +99,93 @@ pipeMapper::nodeId pipeMapper::addNode(void *node, std::string nodeName, pipeMap
 
     nodes_[id] = node;
     ids_[nodeName].push_back(id);
+    idList_.push_back(id);
+
+    // The handle of a name follows the last node added with it
+    auto handle = routes_.find(nodeName);
+    if (handle == routes_.end())
+    {
+        routes_[nodeName] = route_nodes_.size();
+        route_nodes_.push_back(node);
+    }
+    else
+    {
+        route_nodes_[handle->second] = node;
+    }
 
     return id;
 }
 
+void pipeMapper::nameNode(pipeMapper::nodeId id, std::string nodeName)
+{
+    auto node = pipeMapper::getPipeNode(id);
+
+    if (nodeName == "")
+    {
+        throw std::invalid_argument("A node name can not be empty.");
+    }
+
+    auto named = ids_.find(nodeName);
+    if (named != ids_.end())
+    {
+        if (named->second.back().x == id.x && named->second.back().y == id.y && named->second.back().z == id.z)
+        {
+            return;
+        }
+        throw std::invalid_argument("[" + nodeName + "] - is in use.");
+    }
+
+    ids_[nodeName].push_back(id);
+    routes_[nodeName] = route_nodes_.size();
+    route_nodes_.push_back(node);
+}
+
 void *pipeMapper::getPipeNode(pipeMapper::nodeId id) const
 {
-    if (!pipeMapper::nodeExists(id))
+    auto node = nodes_.find(id);
+    if (node == nodes_.end())
     {
         auto string_id = std::to_string(id.x) + ":" + std::to_string(id.y) + ":" +
                          std::to_string(id.z);
         throw std::out_of_range("[" + string_id + "] - does not exists.");
     }
-    return nodes_.at(id);
+    return node->second;
 }
 
-void *pipeMapper::getPipeNode(std::string id) const {
-    if (!pipeMapper::nodeExists(id))
+void *pipeMapper::getPipeNode(const std::string &id) const {
+    auto address = ids_.find(id);
+    if (address == ids_.end())
     {
         throw std::out_of_range("[" + id + "] - does not exists.");
     }
 
-    auto address = ids_.at(id);
-    return nodes_.at(address.back());
+    return nodes_.at(address->second.back());
+}
+
+pipeMapper::route pipeMapper::Route(std::string name) const
+{
+    if (name == "_#WRITE_OUT#_")
+    {
+        return kWriteOut;
+    }
+
+    auto handle = routes_.find(name);
+    if (handle == routes_.end())
+    {
+        throw std::out_of_range("[" + name + "] - does not exists.");
+    }
+
+    return handle->second;
+}
+
+void *pipeMapper::getRouteNode(pipeMapper::route handle) const
+{
+    if (handle <= kWriteOut || handle >= route_nodes_.size())
+    {
+        throw std::out_of_range("route " + std::to_string(handle) + " - does not exists.");
+    }
+
+    return route_nodes_[handle];
 }
 bool pipeMapper::nodeExists(pipeMapper::nodeId id) const
 {
@@ -2,6 +2,7 @@
 
 #pragma once
 #include "processing_unit_interface.h"
+#include <cstdint>
 #include <map>
 
 
@@ -51,12 +52,47 @@ public:
     /// @throws bad_alloc if node id already exists
     nodeId addNode(void *, std::string , nodeId);
 
+    /// @brief Gives one more name to a node already in the map
+    /// @details The name resolves with getPipeNode and Route like the one
+    ///          the node was added with. Naming a node again with the same
+    ///          name does nothing.
+    /// @param  nodeId the x,y,z coordinates of the node
+    /// @param  string The node name
+    /// @throws std::out_of_range if nodeId does not exist
+    /// @throws std::invalid_argument if the name is empty or names another node
+    void nameNode(nodeId, std::string);
+
     /// @brief Return the node with a given id
     /// @param  nodeId the x,y,z coordinates of the node
     /// @return a pointer to a void
     /// @throws std::out_of_range if nodeId does not exist
     void* getPipeNode(nodeId) const;
-    void* getPipeNode(std::string) const;
+    void* getPipeNode(const std::string &) const;
+
+    /// @brief A compact handle of a node name
+    /// @details Resolved once with Route at setup, so a unit can send a
+    ///          packet to a named node without any string on the hot path.
+    using route = uint32_t;
+
+    /// @brief The packet follows the default routing
+    static const route kNoRoute = 0;
+
+    /// @brief The packet goes to the output queue of the topology
+    static const route kWriteOut = 1;
+
+    /// @brief Resolves a node name to its route handle
+    /// @details "_#WRITE_OUT#_" resolves to kWriteOut. When a name is given
+    ///          to several nodes the handle points to the last one added.
+    /// @param  std::string The node name
+    /// @return The route handle
+    /// @throws std::out_of_range if the name does not exist
+    route Route(std::string) const;
+
+    /// @brief Return the node of a route handle
+    /// @param  route A handle returned by Route
+    /// @return a pointer to a void
+    /// @throws std::out_of_range if the handle is not a node
+    void *getRouteNode(route) const;
 
     /// @brief Checks if the given node id is already assigned
     /// @param  nodeId The node id
@@ -89,4 +125,6 @@ private:
     std::map<nodeId, void *> nodes_;
     std::vector<nodeId> idList_;
     std::map<std::string, std::vector<nodeId>> ids_;
+    std::map<std::string, route> routes_;
+    std::vector<void *> route_nodes_;
 };
\ No newline at end of file
@@ -0,0 +1,554 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeMetrics.cpp
+ *
+ * @brief The source file for the pipeMetrics class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeMetrics.h"
+#include "pipeSpill.h"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor for the pipeMetrics class
+ *
+ * @param prefix The prefix of every metric name
+ */
+pipeMetrics::pipeMetrics(std::string prefix)
+    : prefix_(prefix), listener_(nullptr), running_(false) {}
+
+/**
+ * @brief Destructor. Stops the listener and frees the user metrics
+ */
+pipeMetrics::~pipeMetrics()
+{
+  Stop();
+
+  for (auto metric : user_)
+  {
+    delete metric;
+  }
+}
+
+/**
+ * @brief Registers every node found in the map of a topology
+ *
+ * @param map The map of the topology
+ * @param name The value of the topology label
+ */
+void pipeMetrics::RegisterMap(pipeMapper *map, std::string name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (auto &id : map->getNodeIds())
+  {
+    auto node = (PipeNode *)map->getPipeNode(id);
+    nodes_.push_back({name, node});
+    queues_.push_back({name, std::to_string(node->node_id()), node->in_data_queue()});
+  }
+}
+
+/**
+ * @brief Registers the nodes and the output queue of a pipeline
+ *
+ * @param pipe The pipeline
+ * @param name The value of the topology label
+ */
+void pipeMetrics::Register(Pipeline *pipe, std::string name)
+{
+  RegisterMap(pipe->oneDimPipe, name);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  queues_.push_back({name, "out", pipe->getHead()->out_data_queue()});
+}
+
+/**
+ * @brief Registers the nodes and the output queue of a mesh
+ *
+ * @param mesh The mesh
+ * @param name The value of the topology label
+ */
+void pipeMetrics::Register(Mesh *mesh, std::string name)
+{
+  RegisterMap(mesh->twoDimPipe, name);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  queues_.push_back({name, "out", mesh->out_queue()});
+}
+
+/**
+ * @brief Registers the nodes and the output queue of a cube
+ *
+ * @param cube The cube
+ * @param name The value of the topology label
+ */
+void pipeMetrics::Register(Cube *cube, std::string name)
+{
+  RegisterMap(cube->threeDimPipe, name);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  queues_.push_back({name, "out", cube->out_queue()});
+}
+
+/**
+ * @brief Registers a queue that is not the input of a node, e.g. the queue
+ * feeding a distributer
+ *
+ * @param queue The queue
+ * @param name The value of the queue label
+ */
+void pipeMetrics::Register(pipeQueue *queue, std::string name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  queues_.push_back({"", name, queue});
+}
+
+/**
+ * @brief Gets a counter owned by the registry
+ *
+ * @details The counter is exposed as <prefix>_<name>. Update it with
+ * fetch_add(n, std::memory_order_relaxed); the pointer lives as long as the
+ * registry.
+ *
+ * @param name The name of the counter
+ * @param help The description of the counter
+ *
+ * @return A pointer to the counter
+ */
+std::atomic<uint64_t> *pipeMetrics::Counter(std::string name, std::string help)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto metric = new userMetric;
+  metric->name = name;
+  metric->help = help;
+  metric->gauge = false;
+  user_.push_back(metric);
+
+  return &metric->counter;
+}
+
+/**
+ * @brief Gets a gauge owned by the registry
+ *
+ * @param name The name of the gauge
+ * @param help The description of the gauge
+ *
+ * @return A pointer to the gauge
+ */
+std::atomic<int64_t> *pipeMetrics::Gauge(std::string name, std::string help)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto metric = new userMetric;
+  metric->name = name;
+  metric->help = help;
+  metric->gauge = true;
+  user_.push_back(metric);
+
+  return &metric->value;
+}
+
+/**
+ * @brief Appends the HELP and TYPE lines of a metric family
+ */
+static void Family(std::string &out, const std::string &name, const char *type, const std::string &help)
+{
+  out += "# HELP " + name + " " + help + "\n";
+  out += "# TYPE " + name + " " + type + "\n";
+}
+
+/**
+ * @brief Builds the labels of a node
+ */
+static std::string NodeLabels(const std::string &topology, PipeNode *node)
+{
+  auto id = node->getNodeAddress();
+
+  return "topology=\"" + topology + "\",node=\"" + std::to_string(node->node_id()) +
+         "\",address=\"" + std::to_string(id.x) + ":" + std::to_string(id.y) + ":" +
+         std::to_string(id.z) + "\"";
+}
+
+/**
+ * @brief Builds the exposition in the Prometheus text format (version 0.0.4)
+ *
+ * @return The exposition
+ */
+std::string pipeMetrics::Expose()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string out;
+  std::string name;
+
+  name = prefix_ + "_node_packets_total";
+  Family(out, name, "counter", "Packets processed by the node.");
+  for (auto &entry : nodes_)
+  {
+    out += name + "{" + NodeLabels(entry.topology, entry.node) + "} " +
+           std::to_string(entry.node->stats().packets.load(std::memory_order_relaxed)) + "\n";
+  }
+
+  name = prefix_ + "_node_busy_seconds_total";
+  Family(out, name, "counter", "Time spent by the node instances inside Run.");
+  for (auto &entry : nodes_)
+  {
+    out += name + "{" + NodeLabels(entry.topology, entry.node) + "} " +
+           std::to_string(entry.node->stats().busy_ns.load(std::memory_order_relaxed) / 1e9) + "\n";
+  }
+
+  name = prefix_ + "_node_instances";
+  Family(out, name, "gauge", "Instances of the processing unit running in the node.");
+  for (auto &entry : nodes_)
+  {
+    out += name + "{" + NodeLabels(entry.topology, entry.node) + "} " +
+           std::to_string(entry.node->number_of_instances()) + "\n";
+  }
+
+  name = prefix_ + "_node_scaling_commands_total";
+  Family(out, name, "counter", "Scaling commands executed by the node.");
+  for (auto &entry : nodes_)
+  {
+    auto labels = NodeLabels(entry.topology, entry.node);
+    out += name + "{" + labels + ",command=\"add\"} " +
+           std::to_string(entry.node->stats().scale_up.load(std::memory_order_relaxed)) + "\n";
+    out += name + "{" + labels + ",command=\"remove\"} " +
+           std::to_string(entry.node->stats().scale_down.load(std::memory_order_relaxed)) + "\n";
+  }
+
+  name = prefix_ + "_node_shed_total";
+  Family(out, name, "counter", "Packets past their deadline taken away before Run.");
+  for (auto &entry : nodes_)
+  {
+    out += name + "{" + NodeLabels(entry.topology, entry.node) + "} " +
+           std::to_string(entry.node->stats().shed.load(std::memory_order_relaxed)) + "\n";
+  }
+
+  name = prefix_ + "_node_run_seconds";
+  Family(out, name, "histogram", "Latency of the calls to Run.");
+  for (auto &entry : nodes_)
+  {
+    auto labels = NodeLabels(entry.topology, entry.node);
+    auto &stats = entry.node->stats();
+    uint64_t cumulative = 0;
+
+    for (int it = 0; it < PipeNode::nodeStats::kLatencyBuckets; ++it)
+    {
+      cumulative += stats.latency[it].load(std::memory_order_relaxed);
+      std::string bound = "+Inf";
+      if (it < PipeNode::nodeStats::kLatencyBuckets - 1)
+      {
+        char text[32];
+        snprintf(text, sizeof(text), "%g", PipeNode::nodeStats::kLatencyBounds[it] / 1e9);
+        bound = text;
+      }
+      out += name + "_bucket{" + labels + ",le=\"" + bound + "\"} " + std::to_string(cumulative) + "\n";
+    }
+    out += name + "_sum{" + labels + "} " + std::to_string(stats.busy_ns.load(std::memory_order_relaxed) / 1e9) + "\n";
+    out += name + "_count{" + labels + "} " + std::to_string(cumulative) + "\n";
+  }
+
+  name = prefix_ + "_queue_depth";
+  Family(out, name, "gauge", "Data packets waiting in the queue.");
+  for (auto &entry : queues_)
+  {
+    out += name + "{topology=\"" + entry.topology + "\",queue=\"" + entry.name + "\"} " +
+           std::to_string(entry.queue->queue_count()) + "\n";
+  }
+
+  name = prefix_ + "_queue_capacity";
+  Family(out, name, "gauge", "Maximum number of data packets the queue holds.");
+  for (auto &entry : queues_)
+  {
+    out += name + "{topology=\"" + entry.topology + "\",queue=\"" + entry.name + "\"} " +
+           std::to_string(entry.queue->max_size()) + "\n";
+  }
+
+  name = prefix_ + "_queue_full_waits_total";
+  Family(out, name, "counter", "Pushes that found the queue full and blocked the producer.");
+  for (auto &entry : queues_)
+  {
+    out += name + "{topology=\"" + entry.topology + "\",queue=\"" + entry.name + "\"} " +
+           std::to_string(entry.queue->full_waits()) + "\n";
+  }
+
+  name = prefix_ + "_queue_spilled_bytes_total";
+  Family(out, name, "counter", "Bytes written to the spill segment of the queue.");
+  for (auto &entry : queues_)
+  {
+    if (entry.queue->spill() != nullptr)
+    {
+      out += name + "{topology=\"" + entry.topology + "\",queue=\"" + entry.name + "\"} " +
+             std::to_string(entry.queue->spill()->spilled_bytes()) + "\n";
+    }
+  }
+
+  name = prefix_ + "_queue_spill_bytes";
+  Family(out, name, "gauge", "Bytes waiting in the spill segment of the queue.");
+  for (auto &entry : queues_)
+  {
+    if (entry.queue->spill() != nullptr)
+    {
+      out += name + "{topology=\"" + entry.topology + "\",queue=\"" + entry.name + "\"} " +
+             std::to_string(entry.queue->spill()->bytes()) + "\n";
+    }
+  }
+
+  for (auto metric : user_)
+  {
+    name = prefix_ + "_" + metric->name;
+    Family(out, name, metric->gauge ? "gauge" : "counter", metric->help);
+    out += name + " " +
+           (metric->gauge ? std::to_string(metric->value.load(std::memory_order_relaxed))
+                          : std::to_string(metric->counter.load(std::memory_order_relaxed))) +
+           "\n";
+  }
+
+  return out;
+}
+
+/**
+ * @brief Writes the exposition to a file
+ *
+ * @details The exposition is written to a temporary file that is then renamed,
+ * so a collector reading the file never sees it half written.
+ *
+ * @param path The file to write
+ *
+ * @return True if the file could be written
+ */
+bool pipeMetrics::WriteFile(std::string path)
+{
+  auto text = Expose();
+  auto temporary = path + ".tmp";
+
+  FILE *file = fopen(temporary.c_str(), "w");
+  if (file == nullptr)
+    return false;
+
+  bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  written = (fclose(file) == 0) && written;
+
+  return written && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief Serves the exposition on a Unix-domain socket
+ *
+ * @details Every client connecting to the socket receives the exposition and
+ * the connection is closed.
+ *
+ * @param path The path of the socket
+ *
+ * @return True if the socket could be created
+ */
+bool pipeMetrics::ServeUnix(std::string path)
+{
+  struct sockaddr_un address;
+
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return false;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path.c_str());
+  unlink(path.c_str());
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, 8) == -1)
+  {
+    close(fd);
+    return false;
+  }
+
+  unix_path_ = path;
+  return Listen(fd, false);
+}
+
+/**
+ * @brief Serves the exposition over HTTP on 127.0.0.1
+ *
+ * @param port The TCP port
+ *
+ * @return True if the port could be bound
+ */
+bool pipeMetrics::ServeHttp(unsigned short port)
+{
+  struct sockaddr_in address;
+  int reuse = 1;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1)
+    return false;
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, 8) == -1)
+  {
+    close(fd);
+    return false;
+  }
+
+  return Listen(fd, true);
+}
+
+/**
+ * @brief Adds a listening socket and starts the listener thread if needed
+ *
+ * @param fd The listening socket
+ * @param http True if the clients speak HTTP
+ *
+ * @return True
+ */
+bool pipeMetrics::Listen(int fd, bool http)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  listen_fds_.push_back(fd);
+  listen_http_.push_back(http);
+
+  if (listener_ == nullptr)
+  {
+    running_ = true;
+    listener_ = new std::thread(&pipeMetrics::Serve, this);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Writes the whole buffer to a socket
+ */
+static void WriteAll(int fd, const std::string &text)
+{
+  size_t sent = 0;
+
+  while (sent < text.size())
+  {
+    auto written = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+    if (written <= 0)
+      return;
+    sent += written;
+  }
+}
+
+/**
+ * @brief The listener thread. Answers every client with the exposition
+ */
+void pipeMetrics::Serve()
+{
+  while (running_)
+  {
+    std::vector<struct pollfd> fds;
+    std::vector<bool> http;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t it = 0; it < listen_fds_.size(); ++it)
+      {
+        fds.push_back({listen_fds_[it], POLLIN, 0});
+      }
+      http = listen_http_;
+    }
+
+    // Wake up from time to time to see if the registry is stopping
+    if (poll(fds.data(), fds.size(), 200) <= 0)
+      continue;
+
+    for (size_t it = 0; it < fds.size(); ++it)
+    {
+      if (!(fds[it].revents & POLLIN))
+        continue;
+
+      int client = accept(fds[it].fd, nullptr, nullptr);
+      if (client == -1)
+        continue;
+
+      if (http[it])
+      {
+        // The request itself does not matter, consume what was sent
+        char request[4096];
+        struct pollfd wait = {client, POLLIN, 0};
+        if (poll(&wait, 1, 1000) > 0)
+          recv(client, request, sizeof(request), 0);
+
+        auto body = Expose();
+        WriteAll(client, "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " +
+                             std::to_string(body.size()) + "\r\n\r\n" + body);
+      }
+      else
+      {
+        WriteAll(client, Expose());
+      }
+
+      close(client);
+    }
+  }
+}
+
+/**
+ * @brief Stops the listener thread and closes the listening sockets
+ */
+void pipeMetrics::Stop()
+{
+  if (listener_ == nullptr)
+    return;
+
+  running_ = false;
+  listener_->join();
+  delete listener_;
+  listener_ = nullptr;
+
+  for (auto fd : listen_fds_)
+  {
+    close(fd);
+  }
+  listen_fds_.clear();
+  listen_http_.clear();
+
+  if (!unix_path_.empty())
+  {
+    unlink(unix_path_.c_str());
+    unix_path_.clear();
+  }
+}
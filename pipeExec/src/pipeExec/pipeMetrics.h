@@ -0,0 +1,136 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeMetrics.h
+ *
+ * @brief The header file for the pipeMetrics class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeline.h"
+#include "mesh.h"
+#include "cube.h"
+#include <string>
+#include <thread>
+
+/**
+ * @class pipeMetrics
+ *
+ * @brief A registry of metrics exposed in the Prometheus text format
+ *
+ * @details The node metrics (packets, busy time, Run latency histogram,
+ * instances, scaling commands and input queue depth) are read from the
+ * counters the nodes already keep, so registering a topology adds nothing to
+ * the hot path. User counters and gauges are plain atomics owned by the
+ * registry. The exposition can be asked for as a string, written to a file or
+ * served to scrapers on a Unix-domain socket or a loopback HTTP port.
+ */
+class pipeMetrics
+{
+public:
+  // Constructor. The prefix is prepended to every metric name
+  pipeMetrics(std::string = "pipeexec");
+
+  // Destructor. Stops the listener
+  ~pipeMetrics();
+
+  // Registers the nodes and the output queue of a topology
+  void Register(Pipeline *, std::string);
+  void Register(Mesh *, std::string);
+  void Register(Cube *, std::string);
+
+  // Registers a queue that is not the input of a node
+  void Register(pipeQueue *, std::string);
+
+  // Gets a counter owned by the registry
+  std::atomic<uint64_t> *Counter(std::string, std::string);
+
+  // Gets a gauge owned by the registry
+  std::atomic<int64_t> *Gauge(std::string, std::string);
+
+  // Builds the exposition in the Prometheus text format
+  std::string Expose();
+
+  // Writes the exposition to a file
+  bool WriteFile(std::string);
+
+  // Serves the exposition to every client connecting to a Unix socket
+  bool ServeUnix(std::string);
+
+  // Serves the exposition over HTTP on the loopback interface
+  bool ServeHttp(unsigned short);
+
+  // Stops serving the exposition
+  void Stop();
+
+private:
+  /**
+   * @brief A node registered with the name of its topology
+   */
+  struct nodeEntry
+  {
+    std::string topology;
+    PipeNode *node;
+  };
+
+  /**
+   * @brief A queue registered with its labels
+   */
+  struct queueEntry
+  {
+    std::string topology;
+    std::string name;
+    pipeQueue *queue;
+  };
+
+  /**
+   * @brief A metric updated by the user
+   */
+  struct userMetric
+  {
+    std::string name;
+    std::string help;
+    bool gauge;
+    std::atomic<uint64_t> counter{0};
+    std::atomic<int64_t> value{0};
+  };
+
+  void RegisterMap(pipeMapper *, std::string);
+  bool Listen(int, bool);
+  void Serve();
+
+  std::string prefix_;                 /**< Prepended to the metric names */
+  std::vector<nodeEntry> nodes_;       /**< The nodes registered */
+  std::vector<queueEntry> queues_;     /**< The queues registered */
+  std::vector<userMetric *> user_;     /**< The user counters and gauges */
+  std::mutex mutex_;                   /**< Protects the registration */
+  std::vector<int> listen_fds_;        /**< The listening sockets */
+  std::vector<bool> listen_http_;      /**< True for the HTTP sockets */
+  std::string unix_path_;              /**< The Unix socket to remove */
+  std::thread *listener_;              /**< The thread serving the scrapers */
+  std::atomic<bool> running_;          /**< False to stop the listener */
+};
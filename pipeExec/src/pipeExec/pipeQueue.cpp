@@ -33,8 +33,11 @@
  */
 
 #include "pipeQueue.h"
+#include "pipeSpill.h"
 #include <malloc.h>
 #include <cstdio>
+#include <stdexcept>
+#include <string>
 
 /**
  * @brief Constructor for pipeQueue class
@@ -44,8 +47,9 @@
  * @throw invalid_argument If the maximum size is less than 1
  */
 pipeQueue::pipeQueue(int mx_size, bool debug)
-  : max_size_(mx_size), debug_(debug), rear_iterator_(-1), 
-  front_iterator_(0), queue_count_(0) {
+  : max_size_(mx_size), lanes_(new lane[1]), lane_count_(1),
+  weight_(0), queue_count_(0), pushes_(0), depth_sum_(0),
+  full_waits_(0), high_water_(0), spill_(nullptr), spill_mark_(mx_size), debug_(debug) {
     // Validate the maximum size parameter
     if (mx_size < 1) {
       throw std::invalid_argument("mx_size has to be grater 0");
@@ -71,95 +75,470 @@ pipeQueue::pipeQueue(int mx_size, bool debug)
  */
 pipeQueue::~pipeQueue() {
   // Free the buffers inside the queue_ and out_queue_ arrays
-  for (int it = 0; it < max_size_; ++it) {
+  for (int it = 0; it < max_size_ * lane_count_; ++it) {
     free(queue_[it]);
   }
 
+  for (int it = 0; it < reserved_; ++it) {
+    free(reserved_queue_[it]);
+  }
+
   // Free both arrays
   free(queue_);
+  free(reserved_queue_);
+  delete[] lanes_;
+  delete reserved_semaphore_;
 }
 
 /**
  * @brief Pushes a memory buffer into the input queue.
  *
  * @param data Pointer to the memory buffer.
+ * @param priority The lane of the buffer, 0 the lowest. Clamped to the lanes
+ * of the queue.
  *
  * @return True if the input queue is not full, false otherwise.
  */
- bool pipeQueue::Push(void *data) {
+ bool pipeQueue::Push(void *data, int priority) {
+  // Past the spill mark the buffer goes to the segment file and never waits
+  if (spill_ != nullptr && Spill(data, std::chrono::steady_clock::time_point::max()) != kToRing) {
+    return true;
+  }
+
+  // Account the pushes that will have to wait for a free slot
+  if (push_semaphore_->count() == 0) {
+    full_waits_.fetch_add(1, std::memory_order_relaxed);
+  }
+
   push_semaphore_->Wait();
-  // Acquire the lock for the queue_mutex_
-  // This ensures that only one thread can access the queue_ array at a time
-  push_mutex_.lock();
+  Enqueue(data, priority);
+
+  // Return true to indicate that the data was successfully pushed into the queue
+  return true;
+}
+
+/**
+ * @brief Pushes a memory buffer into the input queue only if there is room.
+ *
+ * @details Never blocks: when the queue is full the buffer is not pushed and
+ * the caller keeps it, e.g. to try another queue.
+ *
+ * @param data Pointer to the memory buffer.
+ * @param priority The lane of the buffer, 0 the lowest.
+ *
+ * @return True if the buffer was pushed, false if the queue was full.
+ */
+bool pipeQueue::TryPush(void *data, int priority) {
+  if (spill_ != nullptr) {
+    auto result = Spill(data, std::chrono::steady_clock::time_point::min());
+    if (result != kToRing) {
+      return result == kSpilled;
+    }
+  }
+
+  if (!push_semaphore_->TryWait()) {
+    full_waits_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  Enqueue(data, priority);
+  return true;
+}
+
+/**
+ * @brief Pushes a memory buffer, waiting for a free slot until a given time.
+ *
+ * @param data Pointer to the memory buffer.
+ * @param deadline The latest time to wait until.
+ * @param priority The lane of the buffer, 0 the lowest.
+ * @param token Interrupts the wait when cancelled, nullptr for none.
+ *
+ * @return True if the buffer was pushed, false on time out or cancellation,
+ * and then the caller keeps it.
+ */
+bool pipeQueue::PushUntil(void *data, std::chrono::steady_clock::time_point deadline, int priority,
+                          cancelToken *token) {
+  if (spill_ != nullptr) {
+    auto result = Spill(data, deadline);
+    if (result != kToRing) {
+      return result == kSpilled;
+    }
+  }
 
-  // Check if the queue is full
- /* if (queue_count_ == max_size_) {
+  if (push_semaphore_->count() == 0) {
+    full_waits_.fetch_add(1, std::memory_order_relaxed);
+  }
 
-    // The queue is full, so we cannot push the data into the queue
-    push_mutex_.unlock();
+  if (!push_semaphore_->WaitUntil(deadline, token)) {
     return false;
-  }*/
+  }
+
+  Enqueue(data, priority);
+  return true;
+}
+
+/**
+ * @brief Pushes a memory buffer, waiting for a free slot at most a given time.
+ *
+ * @param data Pointer to the memory buffer.
+ * @param timeout The longest time to wait.
+ * @param priority The lane of the buffer, 0 the lowest.
+ * @param token Interrupts the wait when cancelled, nullptr for none.
+ *
+ * @return True if the buffer was pushed, false on time out or cancellation.
+ */
+bool pipeQueue::PushFor(void *data, std::chrono::nanoseconds timeout, int priority, cancelToken *token) {
+  return PushUntil(data, std::chrono::steady_clock::now() + timeout, priority, token);
+}
 
-  // Push the data into the queue
-  rear_iterator_ += 1;
-  queue_[rear_iterator_] = data;
+/**
+ * @brief Pushes a memory buffer into the reserved lane.
+ *
+ * @details Waits for a slot of the reserved lane only, never for the ones
+ * taken by the other lanes, and bypasses the spill.
+ *
+ * @param data Pointer to the memory buffer.
+ *
+ * @throw logic_error If the queue has no reserved lane.
+ *
+ * @return True once the buffer was pushed.
+ */
+bool pipeQueue::PushReserved(void *data) {
+  if (reserved_semaphore_ == nullptr) {
+    throw std::logic_error("The queue has no reserved lane.");
+  }
+
+  if (reserved_semaphore_->count() == 0) {
+    full_waits_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  reserved_semaphore_->Wait();
+  Enqueue(data, 0, true);
+  return true;
+}
+
+/**
+ * @brief Stores a memory buffer once a free slot has been taken.
+ *
+ * @param data Pointer to the memory buffer.
+ * @param priority The lane of the buffer.
+ * @param reserved True to store it in the reserved lane instead.
+ */
+void pipeQueue::Enqueue(void *data, int priority, bool reserved) {
+  int lane_id = priority <= 0 ? 0 : (priority < lane_count_ ? priority : lane_count_ - 1);
+
+  // Acquire the lock for the queue_mutex_
+  // This ensures that only one thread can access the queue_ array at a time
+  push_mutex_.lock();
+
+  // Push the data into the ring of its lane
+  auto &own = reserved ? reserved_lane_ : lanes_[lane_id];
+  auto ring = reserved ? reserved_queue_ : queue_ + lane_id * max_size_;
+  int size = reserved ? reserved_ : max_size_;
+  own.rear_iterator += 1;
+  ring[own.rear_iterator] = data;
 
   // If the rear iterator has reached the end of the array, wrap it around to the beginning
-  if (rear_iterator_ == max_size_ - 1) {
-    rear_iterator_ = -1;
+  if (own.rear_iterator == size - 1) {
+    own.rear_iterator = -1;
   }
 
-  // Increment the queue_count_
-  queue_count_ += 1;
+  // The consumers look at the lane count before reading the slot
+  own.count.fetch_add(1, std::memory_order_release);
+
+  // Increment the queue_count_ and keep the depth statistics
+  int depth = (queue_count_ += 1);
+  pushes_.fetch_add(1, std::memory_order_relaxed);
+  depth_sum_.fetch_add(depth, std::memory_order_relaxed);
+  if (depth > high_water_.load(std::memory_order_relaxed)) {
+    high_water_.store(depth, std::memory_order_relaxed);
+  }
 
   // Signal the queue_semaphore_ queue_semaphore to wake up a thread that is waiting to pop an element from the queue_
   pop_semaphore_->Signal();
 
   // Release the lock for the queue_mutex_
   push_mutex_.unlock();
-
-  // Return true to indicate that the data was successfully pushed into the queue
-  return true;
 }
 
 /**
  * @brief Pops a memory buffer from the input queue.
  *
- * @throw Throws out_of_range If the content to return is null
- * (it can't be processed)
+ * @param block False to return nullptr instead of waiting, as TryPop
  *
  * @return Pointer to the memory buffer.
  */
 void *pipeQueue::Pop(bool block) {
-  
-  if ( (queue_count_ == 0) && ! block ) return nullptr;
+
+  // Checking the count first would race with the other consumers
+  if (!block) return TryPop();
 
   // Wait for the queue_semaphore_ queue_semaphore to be signaled, indicating that there is an element in the queue_
   pop_semaphore_->Wait();
 
+  return Dequeue();
+}
+
+/**
+ * @brief Pops a memory buffer from the input queue only if there is one.
+ *
+ * @details Never blocks, and unlike Pop(false) it can not wait when another
+ * consumer takes the last buffer first.
+ *
+ * @return Pointer to the memory buffer, nullptr if the queue was empty.
+ */
+void *pipeQueue::TryPop() {
+  if (!pop_semaphore_->TryWait()) {
+    return nullptr;
+  }
+
+  return Dequeue();
+}
+
+/**
+ * @brief Pops a memory buffer from the lanes other than the reserved one, only
+ * if there is one. Never blocks.
+ *
+ * @details For the callers making room for new input, which must not take
+ * the buffers going round a closed topology.
+ *
+ * @return Pointer to the memory buffer, nullptr if those lanes are empty.
+ */
+void *pipeQueue::TryPopUnreserved() {
+  if (!pop_semaphore_->TryWait()) {
+    return nullptr;
+  }
+
+  return Dequeue(true);
+}
+
+/**
+ * @brief Pops a memory buffer, waiting for one until a given time.
+ *
+ * @details A buffer taken from the pop semaphore is always there to be
+ * dequeued, so unlike checking the count first no other consumer can take
+ * it in between.
+ *
+ * @param deadline The latest time to wait until, time_point::max() for ever.
+ * @param token Interrupts the wait when cancelled, nullptr for none.
+ *
+ * @return Pointer to the memory buffer, nullptr on time out or cancellation.
+ */
+void *pipeQueue::PopUntil(std::chrono::steady_clock::time_point deadline, cancelToken *token) {
+  if (!pop_semaphore_->WaitUntil(deadline, token)) {
+    return nullptr;
+  }
+
+  return Dequeue();
+}
+
+/**
+ * @brief Pops a memory buffer, waiting for one at most a given time.
+ *
+ * @param timeout The longest time to wait.
+ * @param token Interrupts the wait when cancelled, nullptr for none.
+ *
+ * @return Pointer to the memory buffer, nullptr on time out or cancellation.
+ */
+void *pipeQueue::PopFor(std::chrono::nanoseconds timeout, cancelToken *token) {
+  return PopUntil(std::chrono::steady_clock::now() + timeout, token);
+}
+
+/**
+ * @brief Takes a memory buffer once it has been made available.
+ *
+ * @param unreserved True to take it only from the lanes other than the
+ * reserved one, giving back the buffer made available if they are empty.
+ *
+ * @return Pointer to the memory buffer, nullptr if unreserved found none.
+ */
+void *pipeQueue::Dequeue(bool unreserved) {
   // Acquire the lock for the queue_mutex_
   // This ensures that only one thread can access the queue_ array at a time
   pop_mutex_.lock();
 
+  // Pop the element from the ring of the lane served, the reserved one first
+  bool reserved = reserved_ != 0 && reserved_lane_.count.load(std::memory_order_acquire) != 0;
+
+  // Only the other lanes: the buffer taken is given back if they are empty
+  if (unreserved) {
+    bool held = false;
+    for (int it = 0; it < lane_count_ && !held; ++it) {
+      held = lanes_[it].count.load(std::memory_order_acquire) != 0;
+    }
+    if (!held) {
+      pop_mutex_.unlock();
+      pop_semaphore_->Signal();
+      return nullptr;
+    }
+    reserved = false;
+  }
+
   // Decrement the queue_count_
   queue_count_ -= 1;
 
-  // Pop the element from the queue
-  void *memory_buffer = queue_[front_iterator_];
-  queue_[front_iterator_] = nullptr;
+  int lane_id = reserved || lane_count_ == 1 ? 0 : NextLane();
+  auto &own = reserved ? reserved_lane_ : lanes_[lane_id];
+  auto ring = reserved ? reserved_queue_ : queue_ + lane_id * max_size_;
+  void *memory_buffer = ring[own.front_iterator];
+  ring[own.front_iterator] = nullptr;
+  own.count.fetch_sub(1, std::memory_order_relaxed);
 
   // Increment the front iterator
-  front_iterator_ = (front_iterator_ + 1) % max_size_;
+  own.front_iterator = (own.front_iterator + 1) % (reserved ? reserved_ : max_size_);
 
-  push_semaphore_->Signal();
+  (reserved ? reserved_semaphore_ : push_semaphore_)->Signal();
 
   // Release the lock for the queue_mutex_
   pop_mutex_.unlock();
 
+  // A spilled buffer takes the slot. The count is read after queue_count_ was
+  // decremented, so either this pop or the spilling push sees the other
+  if (spill_ != nullptr && spill_->records() > 0) {
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    if (Refill()) {
+      spill_room_.notify_all();
+    }
+  }
+
   // Return the popped element
   return memory_buffer;
 }
 
+/**
+ * @brief Chooses the lane served by the next pop.
+ *
+ * @details The highest lane holding buffers is served, unless a lower one
+ * holding buffers has already been passed over weight_ times in a row. Called
+ * with the pop mutex held and a buffer taken from the pop semaphore, so one
+ * lane at least holds a buffer.
+ *
+ * @return The lane to pop from.
+ */
+int pipeQueue::NextLane() {
+  int served = -1;
+
+  for (int it = lane_count_ - 1; it >= 0; --it) {
+    if (lanes_[it].count.load(std::memory_order_acquire) == 0) {
+      continue;
+    }
+    if (served == -1) {
+      served = it;
+    } else if (weight_ != 0 && lanes_[it].skipped >= weight_ && lanes_[it].skipped >= lanes_[served].skipped) {
+      // The lane has waited long enough, it takes the turn of the higher one
+      served = it;
+    }
+  }
+
+  // Every other lane holding buffers has been passed over once more
+  for (int it = 0; it < lane_count_; ++it) {
+    if (it != served && lanes_[it].count.load(std::memory_order_relaxed) != 0) {
+      ++lanes_[it].skipped;
+    }
+  }
+  lanes_[served].skipped = 0;
+
+  return served;
+}
+
+/**
+ * @brief Writes a buffer to the spill if the queue is at the mark or has
+ * buffers spilled already.
+ *
+ * @details Once a buffer has been spilled, every push is spilled until the
+ * pops have read all of them back, so the order of the pushes is kept. When
+ * the segment is out of budget the push waits for the pops to read some.
+ * The buffers must be pipeData packets, released once written.
+ *
+ * @param data Pointer to the memory buffer.
+ * @param deadline The latest time to wait for room in the spill.
+ *
+ * @throw length_error If the buffer alone does not fit in the budget.
+ *
+ * @return Where the buffer has gone.
+ */
+pipeQueue::spillResult pipeQueue::Spill(void *data, std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(spill_mutex_);
+
+  if (spill_->records() == 0 && queue_count_ < spill_mark_) {
+    return kToRing;
+  }
+
+  while (!spill_->Write((pipeData *)data)) {
+    if (spill_->records() == 0) {
+      throw std::length_error("The packet does not fit in the spill budget.");
+    }
+    full_waits_.fetch_add(1, std::memory_order_relaxed);
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+      spill_room_.wait(lock);
+    } else if (spill_room_.wait_until(lock, deadline) == std::cv_status::timeout) {
+      return kNoRoom;
+    }
+  }
+
+  // The pops may have emptied the ring while it was written
+  Refill();
+  return kSpilled;
+}
+
+/**
+ * @brief Moves the oldest spilled buffers to the ring while it is below the
+ * mark and has free slots. Called with the spill mutex held.
+ *
+ * @return True if any buffer was read from the spill, moved or not decoded.
+ */
+bool pipeQueue::Refill() {
+  bool moved = false;
+
+  while (spill_->records() > 0 && queue_count_ < spill_mark_ && push_semaphore_->TryWait()) {
+    auto data = spill_->Read();
+    moved = true;
+
+    // The records left could not be decoded, the slot is given back
+    if (data == nullptr) {
+      push_semaphore_->Signal();
+      break;
+    }
+    Enqueue(data, data->priority());
+  }
+
+  return moved;
+}
+
+/**
+ * @brief Spills the pushes to a segment file once the queue holds a number
+ * of buffers.
+ *
+ * @details Set it before the queue is used. The spill is not owned by the
+ * queue and can not be removed while it holds buffers.
+ *
+ * @param spill The segment file, nullptr to stop spilling.
+ * @param mark The queue count from which the pushes are spilled, the size of
+ * the queue when 0.
+ *
+ * @throw invalid_argument If the mark is beyond the size of the queue.
+ * @throw logic_error If the current spill still holds buffers.
+ */
+void pipeQueue::spill(pipeSpill *spill, int mark) {
+  if (mark < 0 || mark > max_size_) {
+    throw std::invalid_argument("The spill mark has to be within the queue size.");
+  }
+
+  std::lock_guard<std::mutex> lock(spill_mutex_);
+  if (spill_ != nullptr && spill_->records() > 0) {
+    throw std::logic_error("The spill of the queue still holds buffers.");
+  }
+  spill_ = spill;
+  spill_mark_ = mark == 0 ? max_size_ : mark;
+}
+
+/**
+ * @brief Returns the spill of the queue.
+ *
+ * @return The spill, nullptr if the queue has none.
+ */
+pipeSpill *pipeQueue::spill() const { return spill_; }
+
 /**
  * @brief Returns the maximum size of the memory buffer queues.
  *
@@ -174,7 +553,145 @@ int pipeQueue::max_size() const { return max_size_; }
  */
 int pipeQueue::queue_count() const { return queue_count_; }
 
+/**
+ * @brief Returns the number of memory buffers pushed into the queue.
+ *
+ * @return Number of pushes done since the queue was created.
+ */
+uint64_t pipeQueue::pushes() const {
+  return pushes_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the sum of the queue depth seen after every push.
+ * @details Divided by pushes() it gives the mean depth found by the arrivals.
+ *
+ * @return Sum of the depths.
+ */
+uint64_t pipeQueue::depth_sum() const {
+  return depth_sum_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the number of pushes that found the queue full.
+ *
+ * @return Number of pushes that blocked the producer.
+ */
+uint64_t pipeQueue::full_waits() const {
+  return full_waits_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the highest number of memory buffers held at once.
+ *
+ * @return The high water mark of the queue.
+ */
+int pipeQueue::high_water() const {
+  return high_water_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Restarts the high water mark from the current queue count.
+ */
+void pipeQueue::reset_high_water() {
+  high_water_.store(queue_count_, std::memory_order_relaxed);
+}
+
 /**
  * @brief Tries to get the ownership of the cpu resources to do any action
  */
 void pipeQueue::wait_finish() { pop_semaphore_->Wait(); }
+
+/**
+ * @brief Splits the queue in priority lanes.
+ *
+ * @details The lanes share the size of the queue. A push goes to the lane of
+ * its priority and a pop serves the highest lane holding buffers. A lane
+ * holding buffers is passed over at most weight times in a row, then it is
+ * served once, so the lower lanes keep moving under a flood of higher ones.
+ * It has to be called before the queue is used.
+ *
+ * @param count The number of lanes, from 1 to kMaxLanes
+ * @param weight The pops a waiting lane lets go by, 0 for strict priority
+ *
+ * @throw invalid_argument If the number of lanes is out of range
+ * @throw logic_error If the queue holds any buffer
+ */
+void pipeQueue::lanes(int count, unsigned int weight) {
+  if (count < 1 || count > kMaxLanes) {
+    throw std::invalid_argument("lanes has to be between 1 and " + std::to_string(kMaxLanes));
+  }
+
+  std::lock_guard<std::mutex> push_lock(push_mutex_);
+  std::lock_guard<std::mutex> pop_lock(pop_mutex_);
+  if (queue_count_ != 0) {
+    throw std::logic_error("lanes can only be set on an empty queue");
+  }
+
+  free(queue_);
+  queue_ = (void **)calloc(max_size_ * count, sizeof(void *));
+  delete[] lanes_;
+  lanes_ = new lane[count];
+  lane_count_ = count;
+  weight_ = weight;
+}
+
+/**
+ * @brief Reserves a lane served before the others, with slots of its own.
+ *
+ * @details The buffers pushed with PushReserved go to the lane and only wait
+ * for its slots, so they always find room once the lane is popped, however
+ * full the other lanes are. Set it while the queue is empty.
+ *
+ * @param slots The slots of the reserved lane, 0 to remove it.
+ *
+ * @throw invalid_argument If the slots are negative.
+ * @throw logic_error If the queue is not empty.
+ */
+void pipeQueue::reserve(int slots) {
+  if (slots < 0) {
+    throw std::invalid_argument("The reserved slots can not be negative.");
+  }
+
+  std::lock_guard<std::mutex> push_lock(push_mutex_);
+  std::lock_guard<std::mutex> pop_lock(pop_mutex_);
+  if (queue_count_ != 0) {
+    throw std::logic_error("reserve can only be set on an empty queue");
+  }
+
+  free(reserved_queue_);
+  delete reserved_semaphore_;
+  reserved_queue_ = slots != 0 ? (void **)calloc(slots, sizeof(void *)) : nullptr;
+  reserved_semaphore_ = slots != 0 ? new Semaphore(slots) : nullptr;
+  reserved_lane_.rear_iterator = -1;
+  reserved_lane_.front_iterator = 0;
+  reserved_ = slots;
+}
+
+/**
+ * @brief Returns the slots of the reserved lane.
+ *
+ * @return The slots, 0 if the queue has no reserved lane.
+ */
+int pipeQueue::reserved() const { return reserved_; }
+
+/**
+ * @brief Returns the number of priority lanes.
+ *
+ * @return The lanes of the queue, 1 if it was never split.
+ */
+int pipeQueue::lanes() const { return lane_count_; }
+
+/**
+ * @brief Returns the number of memory buffers waiting in a lane.
+ *
+ * @param priority The lane.
+ *
+ * @return The buffers in the lane, 0 if there is no such lane.
+ */
+int pipeQueue::lane_depth(int priority) const {
+  if (priority < 0 || priority >= lane_count_) {
+    return 0;
+  }
+  return lanes_[priority].count.load(std::memory_order_relaxed);
+}
@@ -31,7 +31,9 @@
 
 #pragma once
 
-#include "semaphore.h"
+#include "pipeSemaphore.h"
+
+class pipeSpill; // Forward definition
 
 /**
  * @class pipeQueue
@@ -41,6 +43,19 @@
  * @details This class provides functionality to push and pop memory buffers in
  * and out of the queue. It also implements semaphores to ensure synchronization
  * between the producer and consumer threads.
+ *
+ * The queue can be split in priority lanes that share its size. Pop serves
+ * the highest lane holding buffers, but a waiting lane is only passed over a
+ * given number of times before it gets a turn, so bulk work is never starved.
+ *
+ * A lane can be reserved above the others, with slots of its own that the
+ * pushes to the other lanes can not take. It is always served first, e.g.
+ * for the packets going round a closed topology, which then never wait for
+ * the slots filled by new input.
+ *
+ * A queue of pipeData packets can be given a pipeSpill. Once it holds the
+ * spill mark, the pushes are written to the segment file instead of waiting,
+ * and the pops bring them back in the same order as room is made.
  */
 class pipeQueue {
  public:
@@ -52,14 +67,36 @@ class pipeQueue {
   // Frees the buffers inside both queues and then frees the queues
   ~pipeQueue();
 
-  // Pushes a memory buffer into the input queue.
-  bool Push(void *);
+  // Pushes a memory buffer into the input queue, into the given lane.
+  bool Push(void *, int = 0);
+
+  // Pushes a memory buffer only if the queue is not full. Never blocks
+  bool TryPush(void *, int = 0);
+
+  // Pushes a memory buffer, waiting for a free slot until the time given
+  bool PushUntil(void *, std::chrono::steady_clock::time_point, int = 0, cancelToken * = nullptr);
+
+  // Pushes a memory buffer, waiting for a free slot at most the time given
+  bool PushFor(void *, std::chrono::nanoseconds, int = 0, cancelToken * = nullptr);
 
   // Pops a memory buffer from the input queue.
   // Throws pipeQueueError::kNullPtr If the content to return is
   // null (it can't be processed)
   void *Pop(bool = true);
 
+  // Pops a memory buffer only if there is one. Never blocks
+  void *TryPop();
+
+  // Pops a memory buffer from the lanes other than the reserved one, only if
+  // there is one. Never blocks
+  void *TryPopUnreserved();
+
+  // Pops a memory buffer, waiting for one until the time given
+  void *PopUntil(std::chrono::steady_clock::time_point, cancelToken * = nullptr);
+
+  // Pops a memory buffer, waiting for one at most the time given
+  void *PopFor(std::chrono::nanoseconds, cancelToken * = nullptr);
+
   // Loads a memory buffer into the queues.
   void LoadpipeQueue(void *);
 
@@ -69,9 +106,52 @@ class pipeQueue {
   // Getter. Returns the maximum size of the memory buffer queues.
   int max_size() const;
 
+  // Getter. Returns the number of memory buffers pushed into the queue.
+  uint64_t pushes() const;
+
+  // Getter. Returns the sum of the queue depth seen after every push.
+  uint64_t depth_sum() const;
+
+  // Getter. Returns the number of pushes that found the queue full.
+  uint64_t full_waits() const;
+
+  // Getter. Returns the highest number of memory buffers held at once.
+  int high_water() const;
+
+  // Restarts the high water mark from the current queue count.
+  void reset_high_water();
+
   // Wait until the queue is full again
   void wait_finish();
 
+  // Splits the queue in priority lanes. Only while it is empty
+  void lanes(int, unsigned int = 4);
+
+  // Getter. Returns the number of priority lanes.
+  int lanes() const;
+
+  // Getter. Returns the number of memory buffers waiting in a lane.
+  int lane_depth(int) const;
+
+  // Reserves a lane served before the others, with the given slots of its
+  // own. Only while it is empty
+  void reserve(int);
+
+  // Getter. Returns the slots of the reserved lane, 0 if there is none.
+  int reserved() const;
+
+  // Pushes a memory buffer into the reserved lane, waiting for one of its slots
+  bool PushReserved(void *);
+
+  // Spills the pushes to a segment file once the queue holds the given
+  // number of buffers, the size of the queue by default. nullptr stops it
+  void spill(pipeSpill *, int = 0);
+
+  // Getter. Returns the spill of the queue, nullptr if it has none.
+  pipeSpill *spill() const;
+
+  static const int kMaxLanes = 8; /**< The most priority lanes of a queue */
+
   /**
    * @enum pipeQueueError
    * @brief Enumerated type for possible errors in pipeQueue class
@@ -86,20 +166,71 @@ class pipeQueue {
   };
 
  private:
-  void **queue_;  /**< Pointer to the input queue. */
+  /**
+   * @brief The ring of a priority lane
+   */
+  struct lane {
+    int rear_iterator = -1;   /**< Index of the rear of the lane. */
+    int front_iterator = 0;   /**< Index of the front of the lane. */
+    std::atomic<int> count{0}; /**< Number of memory buffers in the lane. */
+    unsigned int skipped = 0; /**< Pops served elsewhere while it waited */
+  };
+
+  // Stores a memory buffer once a free slot has been taken
+  void Enqueue(void *, int, bool = false);
+
+  // Takes a memory buffer once one has been made available. Not from the
+  // reserved lane if asked, nullptr then if the others are empty
+  void *Dequeue(bool = false);
+
+  // Chooses the lane served by the next pop
+  int NextLane();
+
+  /**
+   * @brief Where a push has gone when the queue has a spill
+   */
+  enum spillResult {
+    kToRing,   /**< The queue is below the mark, it goes to the ring */
+    kSpilled,  /**< It has been written to the spill */
+    kNoRoom    /**< The spill had no room before the deadline */
+  };
+
+  // Writes a buffer to the spill if the queue is at the mark or has spilled
+  spillResult Spill(void *, std::chrono::steady_clock::time_point);
+
+  // Moves the oldest spilled buffers to the ring. Called with the spill mutex
+  bool Refill();
+
+  void **queue_;  /**< Pointer to the input queue, max_size_ slots per lane. */
   int max_size_;     /**< Maximum size of the memory buffer queues. */
 
-  int rear_iterator_;   /**< Index of the rear of the input queue. */
-  int front_iterator_;  /**< Index of the front of the input queue. */
+  lane *lanes_;          /**< The rings of the lanes, the highest served first */
+  int lane_count_;       /**< Number of priority lanes */
+  unsigned int weight_;  /**< Times a waiting lane can be passed over, 0 for ever */
 
   std::atomic<int>
       queue_count_; /**< Number of memory buffers in the input queue. */
 
+  std::atomic<uint64_t> pushes_;     /**< Number of pushes done */
+  std::atomic<uint64_t> depth_sum_;  /**< Sum of the depth after each push */
+  std::atomic<uint64_t> full_waits_; /**< Pushes that found the queue full */
+  std::atomic<int> high_water_;      /**< Highest queue count reached */
+
+  lane reserved_lane_;                   /**< Served before the other lanes */
+  void **reserved_queue_ = nullptr;      /**< The ring of the reserved lane */
+  int reserved_ = 0;                     /**< Slots of the reserved lane, 0 if none */
+  Semaphore *reserved_semaphore_ = nullptr; /**< Free slots of the reserved lane */
+
   Semaphore *pop_semaphore_;  /**< Semaphore for the input queue. */
   Semaphore *push_semaphore_;  /**< Semaphore for the input queue. */
 
   std::mutex push_mutex_;  /**< Mutex for pushing into the input queue. */
   std::mutex pop_mutex_;   /**< Mutex for popping from the input queue. */
 
+  pipeSpill *spill_;    /**< Takes the pushes beyond the mark, nullptr if none */
+  int spill_mark_;      /**< The queue count from which the pushes are spilled */
+  std::mutex spill_mutex_;  /**< Orders the spill against the ring */
+  std::condition_variable spill_room_; /**< Signaled when the spill is read */
+
   bool debug_; /**< Boolean for showing the debug information*/
 };
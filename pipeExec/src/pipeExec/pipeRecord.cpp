@@ -0,0 +1,281 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeRecord.cpp
+ *
+ * @brief The source file for the pipeRecorder and pipeReplay classes
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeRecord.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+static const uint32_t kMagic = 0x50585243; /**< "PXRC" */
+static const uint16_t kFileVersion = 1;    /**< The version of the files written */
+
+/**
+ * @brief What the file starts with
+ */
+struct recordFileHeader
+{
+  uint32_t magic;    /**< kMagic */
+  uint16_t version;  /**< kFileVersion */
+  uint16_t reserved; /**< Keeps the records 8 byte aligned */
+};
+
+/**
+ * @brief What is written before every frame
+ */
+struct recordHeader
+{
+  uint64_t time;     /**< Steady clock ns the packet was recorded at */
+  uint32_t bytes;    /**< The length of the frame */
+  uint32_t reserved; /**< Keeps the frames 8 byte aligned */
+};
+
+/**
+ * @brief The steady clock now in ns, as the deadlines of the packets
+ */
+static uint64_t Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param path The file to create
+ * @param wire Writes the frames
+ *
+ * @throws std::runtime_error if the file can not be created
+ */
+pipeRecorder::pipeRecorder(std::string path, const pipeWire &wire)
+    : wire_(wire), file_(fopen(path.c_str(), "wb")), records_(0), bytes_(0)
+{
+  recordFileHeader header = {kMagic, kFileVersion, 0};
+
+  if (file_ == nullptr || fwrite(&header, sizeof(header), 1, file_) != 1)
+  {
+    throw std::runtime_error("Can not record to " + path + ".");
+  }
+  bytes_ = sizeof(header);
+}
+
+/**
+ * @brief Destructor. Closes the file
+ */
+pipeRecorder::~pipeRecorder() { Close(); }
+
+/**
+ * @brief Writes a packet with the time it is recorded at
+ *
+ * @param data The packet, which is still the caller's
+ *
+ * @return False if the file is closed or could not be written
+ */
+bool pipeRecorder::Record(pipeData *data)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (file_ == nullptr)
+  {
+    return false;
+  }
+
+  recordHeader header = {Now(), 0, 0};
+  buffer_.assign(sizeof(header), '\0');
+  header.bytes = (uint32_t)wire_.Serialize(data, buffer_);
+  memcpy(&buffer_[0], &header, sizeof(header));
+
+  if (fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size())
+  {
+    return false;
+  }
+  records_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(buffer_.size(), std::memory_order_relaxed);
+  return true;
+}
+
+/**
+ * @brief Writes the buffered records to the file
+ *
+ * @return False if the file is closed or could not be written
+ */
+bool pipeRecorder::Flush()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return file_ != nullptr && fflush(file_) == 0;
+}
+
+/**
+ * @brief Closes the file
+ */
+void pipeRecorder::Close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (file_ != nullptr)
+  {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param path The recorded file
+ * @param wire Reads the frames, set up as the one that wrote them
+ *
+ * @throws std::runtime_error if the file can not be opened or was not written
+ * by a pipeRecorder of this version
+ */
+pipeReplay::pipeReplay(std::string path, const pipeWire &wire)
+    : wire_(wire), file_(fopen(path.c_str(), "rb")), start_(0), played_(0), refused_(0), max_lag_(0)
+{
+  recordFileHeader header;
+
+  if (file_ == nullptr || fread(&header, sizeof(header), 1, file_) != 1 || header.magic != kMagic ||
+      header.version != kFileVersion)
+  {
+    if (file_ != nullptr)
+    {
+      fclose(file_);
+    }
+    throw std::runtime_error("Can not replay " + path + ".");
+  }
+  start_ = ftell(file_);
+}
+
+/**
+ * @brief Destructor. Closes the file
+ */
+pipeReplay::~pipeReplay() { fclose(file_); }
+
+/**
+ * @brief Plays the file from the start
+ *
+ * @details The first packet is handed at once and every other one when its
+ * time since the first, divided by the speed, has passed. A sink slower than
+ * the schedule makes the packets late, not dropped. A truncated last record,
+ * as left by a recorder that was not closed, ends the replay.
+ *
+ * @param out Takes the packets
+ * @param speed How much faster than recorded, 0 for as fast as possible
+ * @param token Stops the replay when cancelled, nullptr for none
+ *
+ * @throws std::invalid_argument if the speed is negative
+ *
+ * @return The packets played
+ */
+uint64_t pipeReplay::Play(sink out, double speed, cancelToken *token)
+{
+  if (speed < 0)
+  {
+    throw std::invalid_argument("The replay speed can not be negative.");
+  }
+
+  Semaphore pacer(0); // Never signaled, only waited on until the next time
+  recordHeader header;
+  std::string frame;
+  uint64_t first = 0;
+  auto began = std::chrono::steady_clock::now();
+
+  played_ = refused_ = max_lag_ = 0;
+  fseek(file_, start_, SEEK_SET);
+  while (fread(&header, sizeof(header), 1, file_) == 1)
+  {
+    frame.resize(header.bytes);
+    if (fread(&frame[0], 1, frame.size(), file_) != frame.size())
+    {
+      break;
+    }
+    if (played_ + refused_ == 0)
+    {
+      first = header.time;
+    }
+
+    auto due = began;
+    if (speed > 0)
+    {
+      due += std::chrono::nanoseconds((uint64_t)((header.time - first) / speed));
+      pacer.WaitUntil(due, token);
+    }
+    if (token != nullptr && token->cancelled())
+    {
+      break;
+    }
+
+    auto data = wire_.Deserialize(frame.data(), frame.size(), true);
+    auto now = Now();
+    if (data->deadline() != 0)
+    {
+      data->deadline(data->deadline() > header.time ? now + (data->deadline() - header.time) : now);
+    }
+
+    if (speed > 0)
+    {
+      auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - due).count();
+      max_lag_ = std::max(max_lag_, (uint64_t)std::max<int64_t>(lag, 0));
+    }
+
+    if (out(data))
+    {
+      ++played_;
+    }
+    else
+    {
+      ++refused_;
+      data->Release();
+    }
+  }
+  return played_;
+}
+
+/**
+ * @brief Plays the file to a queue
+ *
+ * @details Every packet waits for room in the queue, so a full queue makes
+ * the next packets late.
+ *
+ * @param queue The queue the packets are pushed to
+ * @param speed How much faster than recorded, 0 for as fast as possible
+ * @param token Stops the replay when cancelled, nullptr for none
+ *
+ * @return The packets played
+ */
+uint64_t pipeReplay::Play(pipeQueue *queue, double speed, cancelToken *token)
+{
+  return Play(
+      [queue, token](pipeData *data)
+      { return queue->PushUntil(data, std::chrono::steady_clock::time_point::max(), data->priority(), token); },
+      speed, token);
+}
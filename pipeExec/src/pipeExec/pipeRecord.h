@@ -0,0 +1,135 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeRecord.h
+ *
+ * @brief The header file for the pipeRecorder and pipeReplay classes
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeQueue.h"
+#include "pipeWire.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/**
+ * @class pipeRecorder
+ *
+ * @brief Records the packets entering a topology to a file
+ *
+ * @details Every packet is written as its pipeWire frame after the steady
+ * clock time it was recorded at. Record is called where the packets enter,
+ * before pushing them or Admit, or by a Recorder unit placed first. The file
+ * is played back by pipeReplay with the same pipeWire set up.
+ *
+ * Record can be called from several threads; the records are written in the
+ * order the calls take the lock.
+ */
+class pipeRecorder
+{
+public:
+  // Constructor. Creates the file, throws if it can not
+  pipeRecorder(std::string, const pipeWire &);
+
+  // Destructor. Closes the file
+  ~pipeRecorder();
+
+  // Writes a packet with the time it is recorded at. The packet is not released
+  bool Record(pipeData *);
+
+  // Writes the buffered records to the file
+  bool Flush();
+
+  // Closes the file. The records after it are refused
+  void Close();
+
+  // Getter. Returns the packets recorded
+  uint64_t records() const { return records_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the bytes written
+  uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); };
+
+private:
+  const pipeWire &wire_;           /**< Writes the frames */
+  FILE *file_;                     /**< The file recorded to */
+  std::mutex mutex_;               /**< Keeps the records whole */
+  std::string buffer_;             /**< The record being written */
+  std::atomic<uint64_t> records_;  /**< Packets recorded */
+  std::atomic<uint64_t> bytes_;    /**< Bytes written */
+};
+
+/**
+ * @class pipeReplay
+ *
+ * @brief Plays a recorded file back into a topology
+ *
+ * @details The packets are built again from their frames and handed to a
+ * sink, a queue or e.g. the Admit of a Pipeline, keeping the time between
+ * them as recorded, scaled by a speed factor, or as fast as possible. The
+ * deadlines of the packets keep the time they had left when recorded. The
+ * lag behind the schedule is measured, so a replay that could not keep up is
+ * told apart from a slow topology.
+ */
+class pipeReplay
+{
+public:
+  // Takes a packet played, false if it was not taken and is still the caller's
+  using sink = std::function<bool(pipeData *)>;
+
+  // Constructor. Opens a recorded file, throws if it is not one
+  pipeReplay(std::string, const pipeWire &);
+
+  // Destructor. Closes the file
+  ~pipeReplay();
+
+  // Plays the file from the start. A speed of 0 plays as fast as possible
+  uint64_t Play(sink, double = 1.0, cancelToken * = nullptr);
+
+  // Plays the file to a queue, waiting for room
+  uint64_t Play(pipeQueue *, double = 1.0, cancelToken * = nullptr);
+
+  // Getter. Returns the packets played in the last Play
+  uint64_t played() const { return played_; };
+
+  // Getter. Returns the packets the sink did not take in the last Play
+  uint64_t refused() const { return refused_; };
+
+  // Getter. Returns the longest a packet was handed after its time, in ns
+  uint64_t max_lag() const { return max_lag_; };
+
+private:
+  const pipeWire &wire_; /**< Reads the frames */
+  FILE *file_;           /**< The file played */
+  long start_;           /**< Where the first record starts */
+  uint64_t played_;      /**< Packets played */
+  uint64_t refused_;     /**< Packets not taken */
+  uint64_t max_lag_;     /**< The longest lag behind the schedule */
+};
@@ -0,0 +1,198 @@
+/**
+ * @file pipeSemaphore.cpp
+ * @brief This file contains the definition of the Semaphore class, which
+ * provides a synchronization mechanism for concurrent access to a shared
+ * resource.
+ */
+#include "pipeSemaphore.h"
+
+/**
+ * @brief Constructs a new Semaphore object
+ *
+ * @param count The initial count of the semaphore
+ * @param type The type of semaphore we're using (in/out/none)
+ * @param debug The flag for debug information
+ */
+Semaphore::Semaphore(int count) : count_(count) { }
+
+/**
+ * @brief Destroys the Semaphore object
+ */
+Semaphore::~Semaphore() {}
+
+/**
+ * @brief Waits for the semaphore
+ *
+ * This function blocks the calling thread until the semaphore count is
+ * greater than zero.
+ */
+void Semaphore::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  cond_var_.wait(lock, [this] {
+    bool result = count_ > 0;
+    return result;
+  });
+  count_--;
+}
+
+/**
+ * @brief Takes one unit of the semaphore count without waiting
+ *
+ * @return True if the count was greater than zero and has been decremented,
+ * false if the caller would have blocked
+ */
+bool Semaphore::TryWait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  if (count_ <= 0) {
+    return false;
+  }
+  count_--;
+  return true;
+}
+
+/**
+ * @brief Waits for the semaphore until a point in time
+ *
+ * @details Takes a unit at once if there is any. Otherwise the caller sleeps
+ * until a unit is signaled, the time comes or the token is cancelled, and
+ * only registers itself in the token while it sleeps. A cancelled wait that
+ * was woken up by a Signal passes the wake up on, so no unit is left behind
+ * with threads waiting for it.
+ *
+ * @param deadline The latest time to wait until. time_point::max() waits for
+ * ever
+ * @param token Interrupts the wait when cancelled, nullptr for none
+ *
+ * @return True if a unit was taken, false on time out or cancellation
+ */
+bool Semaphore::WaitUntil(std::chrono::steady_clock::time_point deadline, cancelToken *token) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (count_ > 0 && (token == nullptr || !token->cancelled())) {
+      count_--;
+      return true;
+    }
+  }
+
+  if (token != nullptr) {
+    token->Register(this);
+  }
+
+  bool taken = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto ready = [this, token] { return count_ > 0 || (token != nullptr && token->cancelled()); };
+
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+      cond_var_.wait(lock, ready);
+    } else {
+      cond_var_.wait_until(lock, deadline, ready);
+    }
+
+    if (token != nullptr && token->cancelled()) {
+      if (count_ > 0) {
+        cond_var_.notify_one();
+      }
+    } else if (count_ > 0) {
+      count_--;
+      taken = true;
+    }
+  }
+
+  if (token != nullptr) {
+    token->Unregister(this);
+  }
+  return taken;
+}
+
+/**
+ * @brief Waits for the semaphore at most a given time
+ *
+ * @param timeout The longest time to wait
+ * @param token Interrupts the wait when cancelled, nullptr for none
+ *
+ * @return True if a unit was taken, false on time out or cancellation
+ */
+bool Semaphore::WaitFor(std::chrono::nanoseconds timeout, cancelToken *token) {
+  return WaitUntil(std::chrono::steady_clock::now() + timeout, token);
+}
+
+/**
+ * @brief Wakes every waiting thread so they look at their tokens
+ */
+void Semaphore::Interrupt() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_var_.notify_all();
+}
+
+/**
+ * @brief Signals the semaphore
+ *
+ * This function increments the semaphore count and wakes up one waiting
+ * thread, if there is any.
+ */
+void Semaphore::Signal() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  count_++;
+  cond_var_.notify_one();
+}
+
+/**
+ * @brief Returns the current count of the semaphore
+ *
+ * @return int The current count of the semaphore
+ */
+int Semaphore::count() const { return count_.load(); }
+
+/**
+ * @brief Constructs a token that is not cancelled
+ */
+cancelToken::cancelToken() : cancelled_(false) {}
+
+/**
+ * @brief Cancels the token
+ *
+ * @details Wakes up every wait using the token. The waits started later
+ * return at once until the token is reset.
+ */
+void cancelToken::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cancelled_.store(true, std::memory_order_release);
+  for (auto semaphore : waiting_) {
+    semaphore->Interrupt();
+  }
+}
+
+/**
+ * @brief Lets the waits using the token block again
+ */
+void cancelToken::Reset() { cancelled_.store(false, std::memory_order_release); }
+
+/**
+ * @brief Registers a semaphore about to be waited on with the token
+ *
+ * @param semaphore The semaphore
+ */
+void cancelToken::Register(Semaphore *semaphore) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  waiting_.push_back(semaphore);
+}
+
+/**
+ * @brief Removes one registration of a semaphore no longer waited on
+ *
+ * @param semaphore The semaphore
+ */
+void cancelToken::Unregister(Semaphore *semaphore) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = waiting_.begin(); it != waiting_.end(); ++it) {
+    if (*it == semaphore) {
+      waiting_.erase(it);
+      break;
+    }
+  }
+}
+
+/* vim:set softtabstop=2 shiftwidth=2 tabstop=2 expandtab: */
@@ -20,7 +20,7 @@
  */
 
 /**
- * @file semaphore.h
+ * @file pipeSemaphore.h
  *
  * @brief This file contains the declaration of the Semaphore class, which
  * provides a synchronization mechanism for concurrent access to a shared
@@ -32,10 +32,46 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <vector>
 #include <condition_variable>
 
+class Semaphore;
+
+/**
+ * @class cancelToken
+ * @brief Interrupts the waits done with it
+ *
+ * Every Semaphore wait given the token registers itself while it sleeps, so
+ * Cancel wakes all of them at once. Once cancelled, the waits using the token
+ * return without taking anything until it is reset.
+ */
+class cancelToken {
+ public:
+  // Constructs a token that is not cancelled
+  cancelToken();
+
+  // Wakes every wait using the token, and the later ones return at once
+  void Cancel();
+
+  // Lets the waits using the token block again
+  void Reset();
+
+  // True once Cancel has been called
+  bool cancelled() const { return cancelled_.load(std::memory_order_acquire); };
+
+ private:
+  friend class Semaphore;
+
+  void Register(Semaphore *);
+  void Unregister(Semaphore *);
+
+  std::atomic<bool> cancelled_;    /**< Set by Cancel */
+  std::mutex mutex_;               /**< Protects the waiting list */
+  std::vector<Semaphore *> waiting_; /**< The semaphores being waited on */
+};
+
 /**
  * @class Semaphore
  * @brief A class that implements a semaphore
@@ -57,6 +93,15 @@ class Semaphore {
   // greater than zero.
   void Wait();
 
+  // Takes one unit of the count if there is any. Never blocks
+  bool TryWait();
+
+  // Waits for a unit until the time given or until the token is cancelled
+  bool WaitUntil(std::chrono::steady_clock::time_point, cancelToken * = nullptr);
+
+  // Waits for a unit at most the time given or until the token is cancelled
+  bool WaitFor(std::chrono::nanoseconds, cancelToken * = nullptr);
+
   // This function increments the semaphore count and wakes up one waiting
   // thread, if there is any.
   void Signal();
@@ -65,6 +110,11 @@ class Semaphore {
   int count() const;
 
  private:
+  friend class cancelToken;
+
+  // Wakes every waiting thread so they look at their tokens
+  void Interrupt();
+
   std::atomic<int> count_; /**< The count of the semaphore */
   std::mutex mutex_;       /**< The mutex used to protect the semaphore */
   std::condition_variable
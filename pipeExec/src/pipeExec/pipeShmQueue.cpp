@@ -0,0 +1,672 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeShmQueue.cpp
+ *
+ * @brief The source file for the pipeShmQueue class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeShmQueue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint32_t kMagic = 0x70534851;      /**< Set once the segment is ready */
+static const uint32_t kSegmentVersion = 1;      /**< The layout of the segment */
+static const uint32_t kBlockFree = 0;           /**< The block can be reused */
+static const uint32_t kBlockUsed = 1;           /**< The block holds a frame */
+static const auto kPoll = std::chrono::milliseconds(100); /**< How often a waiting side looks at its peer */
+
+/**
+ * @brief The header at the start of the segment
+ *
+ * @details The fields written by the producer and the ones written by the
+ * consumer are kept on different cache lines.
+ */
+struct pipeShmQueue::segment
+{
+  std::atomic<uint32_t> magic;   /**< kMagic once the creator has set it up */
+  uint32_t version;              /**< kSegmentVersion */
+  uint64_t slots;                /**< The positions the ring holds, a power of 2 */
+  uint64_t arena_bytes;          /**< The size of the arena */
+  uint64_t arena_offset;         /**< Where the arena starts in the segment */
+  std::atomic<int32_t> producer; /**< The pid of the producer, 0 if none */
+  std::atomic<int32_t> consumer; /**< The pid of the consumer, 0 if none */
+
+  alignas(64) std::atomic<uint64_t> head; /**< The next ring slot written */
+  std::atomic<uint64_t> write;            /**< Arena position past the last block pushed */
+  std::atomic<uint64_t> reclaim;          /**< Arena position of the oldest block kept */
+  std::atomic<uint64_t> pushed;           /**< Packets pushed */
+  std::atomic<uint32_t> data_seq;         /**< Futex bumped on every push */
+  std::atomic<uint32_t> data_waiters;     /**< Consumers sleeping on data_seq */
+
+  alignas(64) std::atomic<uint64_t> tail; /**< The next ring slot read */
+  std::atomic<uint64_t> recovered;        /**< Blocks given back for a crashed consumer */
+  std::atomic<uint32_t> space_seq;        /**< Futex bumped on every pop and free */
+  std::atomic<uint32_t> space_waiters;    /**< Producers sleeping on space_seq */
+};
+
+/**
+ * @brief What is written before every frame in the arena
+ */
+struct shmBlock
+{
+  std::atomic<uint32_t> state; /**< kBlockFree or kBlockUsed */
+  uint32_t bytes;              /**< The bytes of the block, header included */
+  uint64_t back;               /**< The offset of the block from the segment start */
+};
+
+/**
+ * @brief Rounds a size up to keep the blocks 16 byte aligned
+ */
+static size_t Align(size_t bytes) { return (bytes + 15) & ~(size_t)15; }
+
+/**
+ * @brief Sleeps on a futex of the segment while it holds the value seen
+ */
+static void FutexWait(std::atomic<uint32_t> *word, uint32_t seen, std::chrono::nanoseconds timeout)
+{
+  struct timespec wait = {(time_t)(timeout.count() / 1000000000), (long)(timeout.count() % 1000000000)};
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, seen, &wait, nullptr, 0);
+}
+
+/**
+ * @brief Bumps a futex of the segment and wakes the side sleeping on it
+ */
+static void FutexWake(std::atomic<uint32_t> *word, std::atomic<uint32_t> *waiters)
+{
+  word->fetch_add(1);
+  if (waiters->load() != 0)
+  {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+  }
+}
+
+/**
+ * @brief True if the process exists
+ */
+static bool Alive(int32_t pid) { return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM); }
+
+/**
+ * @brief Constructor. Creates the segment, or attaches to it if the other
+ * side created it first
+ *
+ * @details The sizes are the ones given by the side that creates the
+ * segment. The consumer gives back the blocks a crashed consumer had taken.
+ *
+ * @param name The name of the segment, shared by both processes
+ * @param side Whether this process pushes or pops
+ * @param wire Writes and reads the frames, set up the same in both processes
+ * @param slots The packets the ring holds, rounded up to a power of 2
+ * @param arenaBytes The bytes of the payload arena
+ *
+ * @throws std::runtime_error if the segment can not be created or mapped
+ * @throws std::logic_error if a live process is attached as the same side
+ */
+pipeShmQueue::pipeShmQueue(std::string name, role side, const pipeWire &wire, unsigned int slots,
+                           size_t arenaBytes)
+    : name_(name[0] == '/' ? name : "/" + name), role_(side), wire_(wire), fd_(-1), size_(0), segment_(nullptr)
+{
+  uint64_t ring = 1;
+  while (ring < slots)
+  {
+    ring <<= 1;
+  }
+  size_t header = (sizeof(segment) + 63) & ~(size_t)63;
+  size_t offset = (header + ring * sizeof(uint64_t) + 63) & ~(size_t)63;
+  size_t arena = (arenaBytes + 63) & ~(size_t)63;
+
+  bool creator = true;
+  fd_ = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd_ < 0 && errno == EEXIST)
+  {
+    creator = false;
+    fd_ = shm_open(name_.c_str(), O_RDWR, 0600);
+  }
+  if (fd_ < 0)
+  {
+    throw std::runtime_error("Can not open the shared segment " + name_ + ": " + strerror(errno));
+  }
+
+  if (creator)
+  {
+    size_ = offset + arena;
+    if (ftruncate(fd_, size_) != 0)
+    {
+      close(fd_);
+      shm_unlink(name_.c_str());
+      throw std::runtime_error("Can not size the shared segment " + name_ + ": " + strerror(errno));
+    }
+  }
+  else
+  {
+    // The creator may not have sized it yet
+    struct stat info;
+    for (int it = 0; fstat(fd_, &info) == 0 && info.st_size == 0 && it < 100; ++it)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    size_ = info.st_size;
+  }
+
+  void *map = size_ > sizeof(segment) ? mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0) : MAP_FAILED;
+  if (map == MAP_FAILED)
+  {
+    close(fd_);
+    throw std::runtime_error("Can not map the shared segment " + name_ + ".");
+  }
+  segment_ = (segment *)map;
+
+  if (creator)
+  {
+    new (segment_) segment();
+    segment_->version = kSegmentVersion;
+    segment_->slots = ring;
+    segment_->arena_bytes = arena;
+    segment_->arena_offset = offset;
+    segment_->magic.store(kMagic, std::memory_order_release);
+  }
+  else
+  {
+    for (int it = 0; segment_->magic.load(std::memory_order_acquire) != kMagic && it < 100; ++it)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (segment_->magic.load(std::memory_order_acquire) != kMagic || segment_->version != kSegmentVersion)
+    {
+      munmap(segment_, size_);
+      close(fd_);
+      throw std::runtime_error("The shared segment " + name_ + " is not a pipeShmQueue.");
+    }
+  }
+  ring_ = (uint64_t *)((char *)segment_ + header);
+  arena_ = (char *)segment_ + segment_->arena_offset;
+
+  auto &own = role_ == kProducer ? segment_->producer : segment_->consumer;
+  int32_t previous = own.load();
+  if (previous != 0 && previous != getpid() && Alive(previous))
+  {
+    munmap(segment_, size_);
+    close(fd_);
+    throw std::logic_error("The shared segment " + name_ + " already has a live " +
+                           (role_ == kProducer ? "producer." : "consumer."));
+  }
+  Recover();
+  own.store(getpid());
+}
+
+/**
+ * @brief Destructor. Stops Feed and Drain and detaches from the segment
+ *
+ * @details The consumer must have released every packet it popped: they
+ * point into the segment.
+ */
+pipeShmQueue::~pipeShmQueue()
+{
+  cancel_.Cancel();
+  for (auto bridge : bridges_)
+  {
+    bridge->join();
+    delete bridge;
+  }
+
+  int32_t pid = getpid();
+  (role_ == kProducer ? segment_->producer : segment_->consumer).compare_exchange_strong(pid, 0);
+  munmap(segment_, size_);
+  close(fd_);
+}
+
+/**
+ * @brief Removes a segment
+ *
+ * @param name The name of the segment
+ *
+ * @return True if it existed
+ */
+bool pipeShmQueue::Unlink(std::string name)
+{
+  return shm_unlink((name[0] == '/' ? name : "/" + name).c_str()) == 0;
+}
+
+/**
+ * @brief Puts the segment back in order after a crash of the side attaching
+ *
+ * @details A producer that crashed between taking a block and pushing it
+ * leaves the block behind, so the producer takes the arena back to the end
+ * of the last block pushed. The blocks of the packets a consumer popped
+ * before crashing are never released, so the consumer gives back every block
+ * before the first one in the ring.
+ */
+void pipeShmQueue::Recover()
+{
+  auto &s = *segment_;
+  uint64_t head = s.head.load();
+
+  if (role_ == kProducer)
+  {
+    uint64_t end = 0;
+    if (head > 0)
+    {
+      uint64_t last = ring_[(head - 1) % s.slots];
+      end = last + ((shmBlock *)(arena_ + last % s.arena_bytes))->bytes;
+    }
+    end = std::max(end, s.reclaim.load());
+    if (s.write.load() > end)
+    {
+      s.write.store(end);
+    }
+    return;
+  }
+
+  // Up to the first block in the ring, or past the last one pushed
+  uint64_t tail = s.tail.load();
+  uint64_t stop = 0;
+  if (tail != head)
+  {
+    stop = ring_[tail % s.slots];
+  }
+  else if (head > 0)
+  {
+    uint64_t last = ring_[(head - 1) % s.slots];
+    stop = last + ((shmBlock *)(arena_ + last % s.arena_bytes))->bytes;
+  }
+  for (uint64_t pos = s.reclaim.load(); pos < stop;)
+  {
+    auto own = (shmBlock *)(arena_ + pos % s.arena_bytes);
+    if (own->state.load(std::memory_order_acquire) == kBlockUsed)
+    {
+      own->state.store(kBlockFree, std::memory_order_release);
+      s.recovered.fetch_add(1, std::memory_order_relaxed);
+    }
+    pos += own->bytes;
+  }
+  FutexWake(&s.space_seq, &s.space_waiters);
+}
+
+/**
+ * @brief True if the other side was attached and its process is gone
+ */
+bool pipeShmQueue::PeerCrashed() const
+{
+  int32_t pid = (role_ == kProducer ? segment_->consumer : segment_->producer).load();
+  return pid != 0 && !Alive(pid);
+}
+
+/**
+ * @brief Makes room in the arena for a block, reusing the oldest blocks
+ * already freed. Only the producer calls it
+ *
+ * @param need The bytes of the block
+ *
+ * @return True if there is room for the block after the last one pushed,
+ * or at the start of the arena if it does not fit before the end
+ */
+bool pipeShmQueue::Reclaim(size_t need)
+{
+  auto &s = *segment_;
+  uint64_t write = s.write.load(std::memory_order_relaxed);
+  uint64_t offset = write % s.arena_bytes;
+  uint64_t total = offset + need > s.arena_bytes ? s.arena_bytes - offset + need : need;
+  uint64_t reclaim = s.reclaim.load(std::memory_order_relaxed);
+
+  while (write + total - reclaim > s.arena_bytes)
+  {
+    auto oldest = (shmBlock *)(arena_ + reclaim % s.arena_bytes);
+    if (reclaim == write && total > s.arena_bytes)
+    {
+      // Empty, but the block only fits at the start of the arena
+      write += s.arena_bytes - offset;
+      s.write.store(write, std::memory_order_relaxed);
+      reclaim = write;
+      break;
+    }
+    if (oldest->state.load(std::memory_order_acquire) != kBlockFree)
+    {
+      s.reclaim.store(reclaim, std::memory_order_relaxed);
+      return false;
+    }
+    reclaim += oldest->bytes;
+  }
+  s.reclaim.store(reclaim, std::memory_order_relaxed);
+  return true;
+}
+
+/**
+ * @brief Writes the frame of a packet to the arena and pushes its position
+ *
+ * @param data The packet, released once written
+ * @param wait True to wait for room while the consumer is alive
+ *
+ * @throws std::logic_error if this process is not the producer
+ * @throws std::length_error if the frame is larger than the arena
+ *
+ * @return True if the packet was pushed, false if it is still the caller's
+ */
+bool pipeShmQueue::Write(pipeData *data, bool wait)
+{
+  if (role_ != kProducer)
+  {
+    throw std::logic_error("Only the producer pushes to a pipeShmQueue.");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &s = *segment_;
+
+  scratch_.clear();
+  wire_.Serialize(data, scratch_);
+  size_t need = Align(sizeof(shmBlock) + scratch_.size());
+  if (need > s.arena_bytes)
+  {
+    throw std::length_error("The packet does not fit in the shared arena.");
+  }
+
+  uint64_t head = s.head.load(std::memory_order_relaxed);
+  auto ready = [&]() { return head - s.tail.load(std::memory_order_acquire) < s.slots && Reclaim(need); };
+  while (!ready())
+  {
+    if (!wait || PeerCrashed() || cancel_.cancelled())
+    {
+      return false;
+    }
+
+    // Look again once registered, so a pop in between is not missed
+    s.space_waiters.fetch_add(1);
+    uint32_t seen = s.space_seq.load();
+    bool now = ready();
+    if (!now)
+    {
+      FutexWait(&s.space_seq, seen, kPoll);
+    }
+    s.space_waiters.fetch_sub(1);
+    if (now)
+    {
+      break;
+    }
+  }
+
+  // A block that does not fit before the end of the arena starts over
+  uint64_t pos = s.write.load(std::memory_order_relaxed);
+  uint64_t offset = pos % s.arena_bytes;
+  if (offset + need > s.arena_bytes)
+  {
+    auto pad = (shmBlock *)(arena_ + offset);
+    pad->bytes = (uint32_t)(s.arena_bytes - offset);
+    pad->back = s.arena_offset + offset;
+    pad->state.store(kBlockFree, std::memory_order_relaxed);
+    pos += s.arena_bytes - offset;
+    offset = 0;
+  }
+
+  auto own = (shmBlock *)(arena_ + offset);
+  own->bytes = (uint32_t)need;
+  own->back = s.arena_offset + offset;
+  own->state.store(kBlockUsed, std::memory_order_relaxed);
+  memcpy(reinterpret_cast<char *>(own) + sizeof(shmBlock), scratch_.data(), scratch_.size());
+
+  ring_[head % s.slots] = pos;
+  s.write.store(pos + need, std::memory_order_release);
+  s.head.store(head + 1, std::memory_order_release);
+  s.pushed.fetch_add(1, std::memory_order_relaxed);
+  FutexWake(&s.data_seq, &s.data_waiters);
+
+  data->Release();
+  return true;
+}
+
+/**
+ * @brief Pops the position of the next frame and builds its packet
+ *
+ * @param deadline The latest time to wait until
+ *
+ * @throws std::logic_error if this process is not the consumer
+ *
+ * @return The packet, nullptr on time out or if the producer crashed and
+ * the ring is empty
+ */
+pipeData *pipeShmQueue::Read(std::chrono::steady_clock::time_point deadline)
+{
+  if (role_ != kConsumer)
+  {
+    throw std::logic_error("Only the consumer pops from a pipeShmQueue.");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &s = *segment_;
+  uint64_t tail = s.tail.load(std::memory_order_relaxed);
+
+  while (s.head.load(std::memory_order_acquire) == tail)
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (PeerCrashed() || now >= deadline)
+    {
+      return nullptr;
+    }
+
+    // Look again once registered, so a push in between is not missed
+    s.data_waiters.fetch_add(1);
+    uint32_t seen = s.data_seq.load();
+    if (s.head.load() == tail)
+    {
+      FutexWait(&s.data_seq, seen, std::min<std::chrono::nanoseconds>(kPoll, deadline - now));
+    }
+    s.data_waiters.fetch_sub(1);
+  }
+
+  uint64_t pos = ring_[tail % s.slots];
+  auto own = (shmBlock *)(arena_ + pos % s.arena_bytes);
+  pipeData *data = nullptr;
+  try
+  {
+    data = wire_.Deserialize(reinterpret_cast<const char *>(own) + sizeof(shmBlock), own->bytes - sizeof(shmBlock));
+  }
+  catch (...)
+  {
+    own->state.store(kBlockFree, std::memory_order_release);
+    s.tail.store(tail + 1, std::memory_order_release);
+    throw;
+  }
+  data->release_hook(FreeBlock, own);
+
+  s.tail.store(tail + 1, std::memory_order_release);
+  FutexWake(&s.space_seq, &s.space_waiters);
+  return data;
+}
+
+/**
+ * @brief Deletes a packet popped from the segment and gives its block back
+ *
+ * @param data The packet
+ * @param arg The block of its frame
+ */
+void pipeShmQueue::FreeBlock(pipeData *data, void *arg)
+{
+  auto own = (shmBlock *)arg;
+  auto s = (segment *)((char *)own - own->back);
+
+  delete data;
+  own->state.store(kBlockFree, std::memory_order_release);
+  FutexWake(&s->space_seq, &s->space_waiters);
+}
+
+/**
+ * @brief Writes a packet and releases it, waiting for room in the ring and
+ * in the arena while the consumer is alive
+ *
+ * @param data The packet
+ *
+ * @return True if it was pushed, false if the consumer crashed with the
+ * queue full, and then the packet is still the caller's
+ */
+bool pipeShmQueue::Push(pipeData *data) { return Write(data, true); }
+
+/**
+ * @brief Writes a packet and releases it only if there is room. Never blocks
+ *
+ * @param data The packet
+ *
+ * @return True if it was pushed, false if it is still the caller's
+ */
+bool pipeShmQueue::TryPush(pipeData *data) { return Write(data, false); }
+
+/**
+ * @brief Takes the next packet, waiting for it
+ *
+ * @details The packet points into the segment until it is released, which
+ * gives its block back to the producer.
+ *
+ * @return The packet, nullptr if the producer crashed and the ring is empty
+ */
+pipeData *pipeShmQueue::Pop() { return Read(std::chrono::steady_clock::time_point::max()); }
+
+/**
+ * @brief Takes the next packet, waiting for it at most a given time
+ *
+ * @param timeout The longest time to wait
+ *
+ * @return The packet, nullptr on time out or if the producer crashed
+ */
+pipeData *pipeShmQueue::PopFor(std::chrono::nanoseconds timeout)
+{
+  return Read(std::chrono::steady_clock::now() + timeout);
+}
+
+/**
+ * @brief Pushes every packet popped from a local queue, e.g. the output
+ * queue of a Pipeline, until the destructor
+ *
+ * @details While the consumer is gone the packets wait in the local queue.
+ *
+ * @param queue The local queue
+ */
+void pipeShmQueue::Feed(pipeQueue *queue)
+{
+  if (role_ != kProducer)
+  {
+    throw std::logic_error("Only the producer feeds a pipeShmQueue.");
+  }
+
+  bridges_.push_back(new std::thread([this, queue]() {
+    while (auto data = (pipeData *)queue->PopUntil(std::chrono::steady_clock::time_point::max(), &cancel_))
+    {
+      while (!Push(data))
+      {
+        if (cancel_.cancelled())
+        {
+          data->Release();
+          return;
+        }
+        std::this_thread::sleep_for(kPoll);
+      }
+    }
+  }));
+}
+
+/**
+ * @brief Pushes every packet popped to a local queue, e.g. the input queue
+ * of the first node of a Mesh, until the destructor
+ *
+ * @param queue The local queue
+ */
+void pipeShmQueue::Drain(pipeQueue *queue)
+{
+  if (role_ != kConsumer)
+  {
+    throw std::logic_error("Only the consumer drains a pipeShmQueue.");
+  }
+
+  bridges_.push_back(new std::thread([this, queue]() {
+    while (!cancel_.cancelled())
+    {
+      auto data = PopFor(kPoll);
+      if (data == nullptr)
+      {
+        // Pop does not wait for a producer that crashed
+        if (PeerCrashed())
+        {
+          std::this_thread::sleep_for(kPoll);
+        }
+        continue;
+      }
+      if (!queue->PushUntil(data, std::chrono::steady_clock::time_point::max(), data->priority(), &cancel_))
+      {
+        data->Release();
+        return;
+      }
+    }
+  }));
+}
+
+/**
+ * @brief Gets whether the other side is attached and alive
+ *
+ * @return True if a live process is attached as the other side
+ */
+bool pipeShmQueue::peer_alive() const
+{
+  return Alive((role_ == kProducer ? segment_->consumer : segment_->producer).load());
+}
+
+/**
+ * @brief Gets the packets in the ring
+ *
+ * @return The packets pushed and not popped yet
+ */
+uint64_t pipeShmQueue::depth() const { return segment_->head.load() - segment_->tail.load(); }
+
+/**
+ * @brief Gets the arena bytes in use
+ *
+ * @details Counted from the oldest block the producer has not reused yet,
+ * so it includes the blocks freed behind one still in use.
+ *
+ * @return The bytes
+ */
+uint64_t pipeShmQueue::arena_used() const { return segment_->write.load() - segment_->reclaim.load(); }
+
+/**
+ * @brief Gets the packets pushed through the segment
+ *
+ * @return The packets pushed by every producer
+ */
+uint64_t pipeShmQueue::pushed() const { return segment_->pushed.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Gets the packets lost with the consumers that crashed
+ *
+ * @return The blocks given back when a consumer attached
+ */
+uint64_t pipeShmQueue::recovered() const { return segment_->recovered.load(std::memory_order_relaxed); }
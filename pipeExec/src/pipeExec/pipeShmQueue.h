@@ -0,0 +1,143 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeShmQueue.h
+ *
+ * @brief Declaration of the pipeShmQueue class methods
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeQueue.h"
+#include "pipeWire.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @class pipeShmQueue
+ *
+ * @brief A queue between two processes of the same host, in a POSIX shared
+ * memory segment
+ *
+ * @details The segment holds a ring of positions and a payload arena. The
+ * producer writes the pipeWire frame of every packet to the arena and pushes
+ * its position to the ring; the consumer pops it and builds a packet that
+ * points into the arena, so the values read in place are never copied. The
+ * block is given back when the packet is released. Neither side takes a lock
+ * shared with the other: the ring has one writer and one reader, and a side
+ * only sleeps on a futex of the segment when it has to wait.
+ *
+ * Each side records its pid in the segment. A side whose peer has crashed
+ * stops waiting for it: Pop returns nullptr once the ring is empty and Push
+ * gives the packet back when the ring is full. A new peer can then attach,
+ * and a new consumer gives back the blocks of the packets the old one had
+ * taken. Those packets are lost.
+ *
+ * Feed and Drain connect the queue to the queues of the topologies, e.g. the
+ * output queue of a Pipeline in one process to the first node of a Mesh in
+ * another.
+ */
+class pipeShmQueue
+{
+public:
+  /**
+   * @enum role
+   * @brief The side of the queue a process attaches as
+   */
+  enum role
+  {
+    kProducer, /**< Pushes the packets */
+    kConsumer  /**< Pops the packets */
+  };
+
+  // Constructor. Creates or attaches to the segment of the given name
+  pipeShmQueue(std::string, role, const pipeWire &, unsigned int = 1024, size_t = 64ul << 20);
+
+  // Destructor. Stops Feed and Drain and detaches from the segment
+  ~pipeShmQueue();
+
+  // Removes a segment. The processes attached keep it until they detach
+  static bool Unlink(std::string);
+
+  // Producer. Writes a packet and releases it. False if the consumer crashed
+  bool Push(pipeData *);
+
+  // Producer. Writes a packet only if there is room. Never blocks
+  bool TryPush(pipeData *);
+
+  // Consumer. Takes the next packet. nullptr if the producer crashed
+  pipeData *Pop();
+
+  // Consumer. Takes the next packet, waiting at most the time given
+  pipeData *PopFor(std::chrono::nanoseconds);
+
+  // Producer. Pushes every packet popped from a local queue
+  void Feed(pipeQueue *);
+
+  // Consumer. Pushes every packet popped to a local queue
+  void Drain(pipeQueue *);
+
+  // Getter. True if the other side is attached and its process is alive
+  bool peer_alive() const;
+
+  // Getter. Returns the packets in the ring
+  uint64_t depth() const;
+
+  // Getter. Returns the arena bytes in use, by the ring or by live packets
+  uint64_t arena_used() const;
+
+  // Getter. Returns the packets pushed through the segment
+  uint64_t pushed() const;
+
+  // Getter. Returns the packets lost with the consumers that crashed
+  uint64_t recovered() const;
+
+private:
+  struct segment;
+
+  bool Write(pipeData *, bool);
+  pipeData *Read(std::chrono::steady_clock::time_point);
+  bool Reclaim(size_t);
+  bool PeerCrashed() const;
+  void Recover();
+  static void FreeBlock(pipeData *, void *);
+
+  std::string name_;           /**< The name of the segment */
+  role role_;                  /**< The side this process is */
+  const pipeWire &wire_;       /**< Writes and reads the frames */
+  int fd_;                     /**< The segment file */
+  size_t size_;                /**< The bytes mapped */
+  segment *segment_;           /**< The mapping */
+  char *arena_;                /**< The start of the arena in the mapping */
+  uint64_t *ring_;             /**< The start of the ring in the mapping */
+  std::mutex mutex_;           /**< Serializes the threads of this side */
+  std::string scratch_;        /**< The frame being written */
+  cancelToken cancel_;         /**< Stops Feed and Drain */
+  std::vector<std::thread *> bridges_; /**< The Feed and Drain threads */
+};
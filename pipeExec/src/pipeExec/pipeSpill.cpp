@@ -0,0 +1,242 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeSpill.cpp
+ *
+ * @brief The source file for the pipeSpill class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeSpill.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * @brief Rounds a size up to keep the records 8 byte aligned
+ */
+static size_t Align(size_t bytes) { return (bytes + 7) & ~(size_t)7; }
+
+/**
+ * @brief Constructor. Creates and maps the segment file
+ *
+ * @param path The segment file, on a local disk. It is truncated if it exists
+ * @param encode Appends the bytes of a packet to a string
+ * @param decode Builds a packet from the bytes appended by encode
+ * @param maxBytes The largest the segment can grow
+ * @param initialBytes The size the segment starts with
+ *
+ * @throws std::invalid_argument if a function is missing
+ * @throws std::runtime_error if the file can not be created or mapped
+ */
+pipeSpill::pipeSpill(std::string path, encoder encode, decoder decode, size_t maxBytes, size_t initialBytes)
+    : fd_(-1), map_(nullptr), size_(0), max_bytes_(maxBytes), read_(0), write_(0), encode_(encode),
+      decode_(decode), records_(0), bytes_(0), spilled_(0), spilled_bytes_(0), refilled_(0), failed_(0), high_water_(0)
+{
+  if (!encode_ || !decode_)
+  {
+    throw std::invalid_argument("The spill needs an encoder and a decoder.");
+  }
+
+  size_t initial = Align(initialBytes < maxBytes ? initialBytes : maxBytes);
+  if (initial == 0)
+  {
+    throw std::invalid_argument("The spill segment can not be empty.");
+  }
+
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error("Can not create the spill segment " + path + ": " + strerror(errno));
+  }
+  unlink(path.c_str());
+
+  if (ftruncate(fd_, initial) != 0)
+  {
+    close(fd_);
+    throw std::runtime_error("Can not size the spill segment " + path + ": " + strerror(errno));
+  }
+
+  void *map = mmap(nullptr, initial, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED)
+  {
+    close(fd_);
+    throw std::runtime_error("Can not map the spill segment " + path + ": " + strerror(errno));
+  }
+  map_ = (char *)map;
+  size_ = initial;
+}
+
+/**
+ * @brief Destructor. Unmaps the segment, the packets still in it are lost
+ */
+pipeSpill::~pipeSpill()
+{
+  munmap(map_, size_);
+  close(fd_);
+}
+
+/**
+ * @brief Writes a packet after the newest one and releases it
+ *
+ * @details When the packet does not fit at the end, the records waiting are
+ * first moved to the start of the segment, and then the segment grows up to
+ * the budget.
+ *
+ * @param data The packet
+ *
+ * @return True if it was written, false if it does not fit in the budget and
+ * then it is still the caller's
+ */
+bool pipeSpill::Write(pipeData *data)
+{
+  scratch_.clear();
+  encode_(data, scratch_);
+
+  size_t need = Align(sizeof(record) + scratch_.size());
+  if (write_ + need > size_)
+  {
+    if (read_ > 0)
+    {
+      Compact();
+    }
+    if (write_ + need > size_ && !Grow(write_ + need))
+    {
+      return false;
+    }
+  }
+
+  record header = {(uint32_t)scratch_.size(), (int32_t)data->priority(), data->route(),
+                   data->passes(),           data->sequence(),          data->deadline()};
+  memcpy(map_ + write_, &header, sizeof(header));
+  memcpy(map_ + write_ + sizeof(header), scratch_.data(), scratch_.size());
+  write_ += need;
+
+  uint64_t waiting = bytes_.fetch_add(need, std::memory_order_relaxed) + need;
+  if (waiting > high_water_.load(std::memory_order_relaxed))
+  {
+    high_water_.store(waiting, std::memory_order_relaxed);
+  }
+  spilled_.fetch_add(1, std::memory_order_relaxed);
+  spilled_bytes_.fetch_add(need, std::memory_order_relaxed);
+
+  // Sequentially consistent: the queue relies on it to find the records
+  records_.fetch_add(1);
+
+  data->Release();
+  return true;
+}
+
+/**
+ * @brief Reads the oldest packet written
+ *
+ * @details The packet is built by the decoder and then given the routing
+ * fields it was written with. A record the decoder gives no packet for is
+ * skipped and counted in failed(). Once the segment is empty the next packet
+ * is written at its start again.
+ *
+ * @return The packet, nullptr if there is none
+ */
+pipeData *pipeSpill::Read()
+{
+  while (records_.load() > 0)
+  {
+    record header;
+    memcpy(&header, map_ + read_, sizeof(header));
+    auto data = decode_(map_ + read_ + sizeof(header), header.bytes);
+
+    size_t used = Align(sizeof(header) + header.bytes);
+    read_ += used;
+    bytes_.fetch_sub(used, std::memory_order_relaxed);
+    if (records_.fetch_sub(1) == 1)
+    {
+      read_ = write_ = 0;
+    }
+
+    if (data == nullptr)
+    {
+      failed_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    data->priority(header.priority);
+    data->route(header.route);
+    data->passes(header.passes);
+    data->sequence(header.sequence);
+    data->deadline(header.deadline);
+    refilled_.fetch_add(1, std::memory_order_relaxed);
+    return data;
+  }
+
+  return nullptr;
+}
+
+/**
+ * @brief Moves the records waiting to the start of the segment
+ */
+void pipeSpill::Compact()
+{
+  memmove(map_, map_ + read_, write_ - read_);
+  write_ -= read_;
+  read_ = 0;
+}
+
+/**
+ * @brief Grows the segment, doubling it while it stays in the budget
+ *
+ * @param needed The size the segment needs at least
+ *
+ * @return True if the segment is now that large
+ */
+bool pipeSpill::Grow(size_t needed)
+{
+  if (needed > max_bytes_)
+  {
+    return false;
+  }
+
+  size_t size = size_;
+  while (size < needed)
+  {
+    size = size * 2 < max_bytes_ ? size * 2 : max_bytes_;
+  }
+
+  if (ftruncate(fd_, size) != 0)
+  {
+    return false;
+  }
+  void *map = mremap(map_, size_, size, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+  {
+    return false;
+  }
+  map_ = (char *)map;
+  size_ = size;
+  return true;
+}
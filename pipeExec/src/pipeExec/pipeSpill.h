@@ -0,0 +1,135 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeSpill.h
+ *
+ * @brief Declaration of the pipeSpill class methods
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeData.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * @class pipeSpill
+ *
+ * @brief A memory mapped segment file holding the packets a queue has no
+ * room for
+ *
+ * @details The packets are written one after the other, each one as a fixed
+ * header with its routing fields followed by the bytes given by the encoder,
+ * and read back in the same order. The segment starts small and grows up to
+ * a budget; the space already read is reused by moving the records left to
+ * the start of the file. The file is removed as soon as it is mapped, so it
+ * never outlives the process.
+ *
+ * It is not thread safe: the queue it is given to serializes the calls. Only
+ * the getters can be called from any thread.
+ */
+class pipeSpill
+{
+public:
+  // Appends the bytes of a packet to the string
+  using encoder = std::function<void(pipeData *, std::string &)>;
+
+  // Builds a packet from the bytes appended by the encoder
+  using decoder = std::function<pipeData *(const char *, size_t)>;
+
+  // Constructor. Creates and maps the segment file
+  pipeSpill(std::string, encoder, decoder, size_t = 1ul << 30, size_t = 1ul << 20);
+
+  // Destructor. Unmaps the segment, the packets still in it are lost
+  ~pipeSpill();
+
+  // Writes a packet and releases it. False if it does not fit in the budget
+  bool Write(pipeData *);
+
+  // Reads the oldest packet written, skipping the ones the decoder fails on.
+  // nullptr if there is none
+  pipeData *Read();
+
+  // Getter. Returns the packets waiting in the segment
+  uint64_t records() const { return records_.load(); };
+
+  // Getter. Returns the bytes waiting in the segment
+  uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets written since the creation
+  uint64_t spilled() const { return spilled_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the bytes written since the creation
+  uint64_t spilled_bytes() const { return spilled_bytes_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the packets read back since the creation
+  uint64_t refilled() const { return refilled_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the records the decoder gave no packet for
+  uint64_t failed() const { return failed_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the most bytes waiting at once
+  uint64_t high_water() const { return high_water_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the current size of the segment file
+  size_t segment() const { return size_.load(std::memory_order_relaxed); };
+
+private:
+  /**
+   * @brief What is written before the bytes of every packet
+   */
+  struct record
+  {
+    uint32_t bytes;    /**< The bytes given by the encoder */
+    int32_t priority;  /**< The lane of the packet */
+    uint32_t route;    /**< The route of the next hop */
+    uint32_t passes;   /**< The laps around a closed topology */
+    uint64_t sequence; /**< The order stamped on the packet */
+    uint64_t deadline; /**< The deadline of the packet */
+  };
+
+  void Compact();
+  bool Grow(size_t);
+
+  int fd_;                 /**< The segment file */
+  char *map_;              /**< The mapping of the whole segment */
+  std::atomic<size_t> size_; /**< The size of the segment */
+  size_t max_bytes_;       /**< The largest the segment can grow */
+  size_t read_;            /**< Offset of the oldest record */
+  size_t write_;           /**< Offset past the newest record */
+  encoder encode_;         /**< Turns the packets into bytes */
+  decoder decode_;         /**< Turns the bytes back into packets */
+  std::string scratch_;    /**< The bytes of the packet being written */
+  std::atomic<uint64_t> records_;       /**< Packets waiting */
+  std::atomic<uint64_t> bytes_;         /**< Bytes waiting */
+  std::atomic<uint64_t> spilled_;       /**< Packets written */
+  std::atomic<uint64_t> spilled_bytes_; /**< Bytes written */
+  std::atomic<uint64_t> refilled_;      /**< Packets read back */
+  std::atomic<uint64_t> failed_;        /**< Records not decoded */
+  std::atomic<uint64_t> high_water_;    /**< Most bytes waiting at once */
+};
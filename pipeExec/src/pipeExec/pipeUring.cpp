@@ -0,0 +1,325 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeUring.cpp
+ *
+ * @brief The source file for the pipeUring class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeUring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param entries The entries of the submission queue, rounded up to a power
+ * of two by the kernel
+ *
+ * @throws std::runtime_error if the kernel does not provide io_uring or
+ * refuses to set it up
+ */
+pipeUring::pipeUring(unsigned int entries)
+    : fd_(-1), entries_(0), prepared_(0), sq_map_(MAP_FAILED), sq_map_size_(0), cq_map_(MAP_FAILED), cq_map_size_(0),
+      sqes_((struct io_uring_sqe *)MAP_FAILED), sqes_size_(0)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  fd_ = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error(std::string("io_uring is not available: ") + strerror(errno) + ".");
+  }
+  entries_ = params.sq_entries;
+
+  sq_map_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  cq_map_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+  {
+    sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+  }
+
+  sq_map_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  cq_map_ = single ? sq_map_
+                   : mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                          IORING_OFF_CQ_RING);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = (struct io_uring_sqe *)mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                      IORING_OFF_SQES);
+  if (sq_map_ == MAP_FAILED || cq_map_ == MAP_FAILED || sqes_ == MAP_FAILED)
+  {
+    int error = errno;
+    Unmap();
+    throw std::runtime_error(std::string("Can not map the io_uring: ") + strerror(error) + ".");
+  }
+
+  auto sq = (char *)sq_map_;
+  sq_head_ = (unsigned int *)(sq + params.sq_off.head);
+  sq_tail_ = (unsigned int *)(sq + params.sq_off.tail);
+  sq_mask_ = (unsigned int *)(sq + params.sq_off.ring_mask);
+  sq_array_ = (unsigned int *)(sq + params.sq_off.array);
+
+  auto cq = (char *)cq_map_;
+  cq_head_ = (unsigned int *)(cq + params.cq_off.head);
+  cq_tail_ = (unsigned int *)(cq + params.cq_off.tail);
+  cq_mask_ = (unsigned int *)(cq + params.cq_off.ring_mask);
+  cqes_ = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+}
+
+/**
+ * @brief Destructor. Unmaps the rings and closes the io_uring
+ */
+pipeUring::~pipeUring() { Unmap(); }
+
+/**
+ * @brief Unmaps whatever was mapped and closes the io_uring
+ */
+void pipeUring::Unmap()
+{
+  if (sqes_ != MAP_FAILED)
+  {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_)
+  {
+    munmap(cq_map_, cq_map_size_);
+  }
+  if (sq_map_ != MAP_FAILED)
+  {
+    munmap(sq_map_, sq_map_size_);
+  }
+  sqes_ = (struct io_uring_sqe *)MAP_FAILED;
+  sq_map_ = cq_map_ = MAP_FAILED;
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+/**
+ * @brief Registers buffers, so the writes from them skip mapping them
+ *
+ * @param buffers The buffers, written later by their index
+ *
+ * @return False if the kernel refused them, e.g. over the locked memory
+ * limit; the plain writes still work
+ */
+bool pipeUring::RegisterBuffers(const std::vector<struct iovec> &buffers)
+{
+  return syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers.data(), (unsigned int)buffers.size()) ==
+         0;
+}
+
+/**
+ * @brief Gets the next free submission entry, cleared
+ *
+ * @return The entry, nullptr if the submission queue is full
+ */
+struct io_uring_sqe *pipeUring::Next()
+{
+  unsigned int head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  unsigned int tail = *sq_tail_;
+
+  if (tail - head >= entries_)
+  {
+    return nullptr;
+  }
+
+  unsigned int index = tail & *sq_mask_;
+  struct io_uring_sqe *sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  return sqe;
+}
+
+/**
+ * @brief Prepares a write
+ *
+ * @param fd The file
+ * @param buffer The bytes
+ * @param size How many
+ * @param offset Where in the file
+ * @param index The index of the registered buffer the bytes are in, -1 if
+ * they are not in one
+ * @param user Given back with the result
+ *
+ * @return False if the submission queue is full
+ */
+bool pipeUring::Write(int fd, const void *buffer, size_t size, uint64_t offset, int index, uint64_t user)
+{
+  auto sqe = Next();
+  if (sqe == nullptr)
+  {
+    return false;
+  }
+
+  sqe->opcode = index < 0 ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)buffer;
+  sqe->len = (uint32_t)size;
+  sqe->off = offset;
+  sqe->buf_index = index < 0 ? 0 : (uint16_t)index;
+  sqe->user_data = user;
+
+  __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+  ++prepared_;
+  return true;
+}
+
+/**
+ * @brief Prepares a read
+ *
+ * @param fd The file
+ * @param buffer Where the bytes go
+ * @param size How many at most
+ * @param offset Where in the file
+ * @param user Given back with the result
+ *
+ * @return False if the submission queue is full
+ */
+bool pipeUring::Read(int fd, void *buffer, size_t size, uint64_t offset, uint64_t user)
+{
+  auto sqe = Next();
+  if (sqe == nullptr)
+  {
+    return false;
+  }
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)buffer;
+  sqe->len = (uint32_t)size;
+  sqe->off = offset;
+  sqe->user_data = user;
+
+  __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+  ++prepared_;
+  return true;
+}
+
+/**
+ * @brief Prepares a request that completes at once
+ *
+ * @param user Given back with the result
+ *
+ * @return False if the submission queue is full
+ */
+bool pipeUring::Nop(uint64_t user)
+{
+  auto sqe = Next();
+  if (sqe == nullptr)
+  {
+    return false;
+  }
+
+  sqe->opcode = IORING_OP_NOP;
+  sqe->user_data = user;
+
+  __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+  ++prepared_;
+  return true;
+}
+
+/**
+ * @brief Hands the requests prepared to the kernel
+ *
+ * @return The requests submitted, or -errno
+ */
+int pipeUring::Submit()
+{
+  int submitted = 0;
+
+  while (prepared_ > 0)
+  {
+    int done = (int)syscall(__NR_io_uring_enter, fd_, prepared_, 0, 0, nullptr, 0);
+    if (done < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (done < 0)
+    {
+      return -errno;
+    }
+    prepared_ -= done;
+    submitted += done;
+  }
+  return submitted;
+}
+
+/**
+ * @brief Takes a completion if there is one
+ *
+ * @param user The user value of the request
+ * @param result Its result, -errno if it failed
+ *
+ * @return False if there is no completion
+ */
+bool pipeUring::Peek(uint64_t &user, int &result)
+{
+  unsigned int head = *cq_head_;
+
+  if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+  {
+    return false;
+  }
+
+  struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+  user = cqe->user_data;
+  result = cqe->res;
+  __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * @brief Waits for a completion
+ *
+ * @param user The user value of the request
+ * @param result Its result, -errno if it failed
+ *
+ * @return False if the wait itself failed
+ */
+bool pipeUring::Wait(uint64_t &user, int &result)
+{
+  while (!Peek(user, result))
+  {
+    if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,113 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeUring.h
+ *
+ * @brief The header file for the pipeUring class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @class pipeUring
+ *
+ * @brief A minimal io_uring, set up with the raw system calls
+ *
+ * @details Only what the units doing asynchronous I/O need: reads, writes
+ * from plain or registered buffers, a no-op to wake the thread waiting for the
+ * completions, and blocking or polling for them. Every request carries a
+ * user value that comes back with its result.
+ *
+ * The submission and the completion sides are independent: one thread may
+ * prepare and submit while another one waits for completions, but each side
+ * is used by a single thread at a time.
+ */
+class pipeUring
+{
+public:
+  // Constructor. Throws std::runtime_error if io_uring is not available
+  pipeUring(unsigned int = 64);
+
+  // Destructor. Unmaps the rings, the requests still running are abandoned
+  ~pipeUring();
+
+  // Registers buffers to be written with their index. False if refused
+  bool RegisterBuffers(const std::vector<struct iovec> &);
+
+  // Prepares a write at an offset. A buffer index of -1 is not registered
+  bool Write(int, const void *, size_t, uint64_t, int, uint64_t);
+
+  // Prepares a read at an offset
+  bool Read(int, void *, size_t, uint64_t, uint64_t);
+
+  // Prepares a request that does nothing, to wake the waiting thread
+  bool Nop(uint64_t);
+
+  // Submits the requests prepared. Returns how many, or -errno
+  int Submit();
+
+  // Waits for a completion. False if the wait failed
+  bool Wait(uint64_t &, int &);
+
+  // Takes a completion if there is one
+  bool Peek(uint64_t &, int &);
+
+  // Getter. Returns the entries of the submission queue
+  unsigned int entries() const { return entries_; };
+
+  // Getter. Returns the requests prepared and not submitted yet
+  unsigned int prepared() const { return prepared_; };
+
+private:
+  struct io_uring_sqe *Next();
+  void Unmap();
+
+  int fd_;                      /**< The ring */
+  unsigned int entries_;        /**< Entries of the submission queue */
+  unsigned int prepared_;       /**< Requests not submitted yet */
+  void *sq_map_;                /**< The submission ring mapped */
+  size_t sq_map_size_;          /**< Its size */
+  void *cq_map_;                /**< The completion ring mapped, maybe the same */
+  size_t cq_map_size_;          /**< Its size */
+  struct io_uring_sqe *sqes_;   /**< The submission entries */
+  size_t sqes_size_;            /**< Their size */
+  unsigned int *sq_head_;       /**< Moved by the kernel */
+  unsigned int *sq_tail_;       /**< Moved by the submitter */
+  unsigned int *sq_mask_;       /**< The mask of the submission ring */
+  unsigned int *sq_array_;      /**< The entries submitted, by position */
+  unsigned int *cq_head_;       /**< Moved by the waiter */
+  unsigned int *cq_tail_;       /**< Moved by the kernel */
+  unsigned int *cq_mask_;       /**< The mask of the completion ring */
+  struct io_uring_cqe *cqes_;   /**< The completions */
+};
@@ -0,0 +1,431 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeWire.cpp
+ *
+ * @brief The source file for the pipeWire class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeWire.h"
+
+#include <cstring>
+#include <stdexcept>
+
+static const uint16_t kMagic = 0x5850;      /**< The first bytes after the length */
+static const uint8_t kBigEndian = 1;        /**< Flag of the frames of big endian hosts */
+static const uint16_t kPayloadKey = 0xffff; /**< The key of the payload field */
+static const uint32_t kNull = 0xffffffff;   /**< The length of a null value */
+
+/**
+ * @brief The fixed part of a frame
+ */
+struct frameHeader
+{
+  uint32_t length;   /**< The bytes of the whole frame */
+  uint16_t magic;    /**< kMagic */
+  uint8_t version;   /**< The version of the format */
+  uint8_t flags;     /**< kBigEndian if written by a big endian host */
+  uint32_t entries;  /**< The extra data entries after the payload */
+  int32_t priority;  /**< The lane of the packet */
+  uint64_t sequence; /**< The order stamped on the packet */
+  uint64_t deadline; /**< The deadline of the packet */
+  uint32_t route;    /**< The route of the next hop */
+  uint32_t passes;   /**< The laps around a closed topology */
+};
+
+static_assert(sizeof(frameHeader) == pipeWire::kHeaderSize, "The frame header must not be padded.");
+
+/**
+ * @brief What is written before every value
+ */
+struct fieldHeader
+{
+  uint32_t length; /**< The bytes of the value, kNull for a null value */
+  uint16_t key;    /**< The id of the key, kPayloadKey for the payload */
+  uint16_t type;   /**< The type tag of the value */
+};
+
+/**
+ * @brief Gets the flags of the frames written by this host
+ */
+static uint8_t HostFlags()
+{
+  const uint16_t probe = 1;
+  return *(const uint8_t *)&probe == 1 ? 0 : kBigEndian;
+}
+
+/**
+ * @brief Rounds a size up to keep the fields 8 byte aligned
+ */
+static size_t Align(size_t bytes) { return (bytes + 7) & ~(size_t)7; }
+
+/**
+ * @brief Frees a packet and the copy of the frame it points into
+ *
+ * @param data The packet
+ * @param frame The copy of the frame
+ */
+static void FreeFrame(pipeData *data, void *frame)
+{
+  delete data;
+  delete[] (char *)frame;
+}
+
+/**
+ * @brief Constructor. No keys and no codecs
+ */
+pipeWire::pipeWire() : payload_(kNoType) {}
+
+/**
+ * @brief Registers how the values of a type tag are written and read
+ *
+ * @details Without an encoder the value is copied as size bytes, without a
+ * decoder the value read points into the frame. The values decoded by a
+ * decoder belong to the user, as the values set with setDataKey.
+ *
+ * @param tag The type tag, any but kNoType
+ * @param size The bytes of every value, 0 if they have variable size
+ * @param encode Appends the bytes of a value, nullptr to copy size bytes
+ * @param decode Builds a value from its bytes, nullptr to read it in place
+ *
+ * @throws std::invalid_argument if the tag is kNoType or a variable size
+ * type has no encoder
+ */
+void pipeWire::Codec(typeTag tag, size_t size, encodeFn encode, decodeFn decode)
+{
+  if (tag == kNoType)
+  {
+    throw std::invalid_argument("kNoType can not have a codec.");
+  }
+  if (size == 0 && !encode)
+  {
+    throw std::invalid_argument("A type of variable size needs an encoder.");
+  }
+
+  if (tag >= codecs_.size())
+  {
+    codecs_.resize(tag + 1);
+  }
+  codecs_[tag].known = true;
+  codecs_[tag].size = size;
+  codecs_[tag].encode = encode;
+  codecs_[tag].decode = decode;
+}
+
+/**
+ * @brief Registers an extra data key with the type of its values
+ *
+ * @param key The key
+ * @param type The type tag of its values
+ *
+ * @throws std::logic_error if the key was registered with another type
+ * @throws std::length_error if there are no ids left
+ *
+ * @return The id the key is written with
+ */
+uint16_t pipeWire::Key(std::string key, typeTag type)
+{
+  auto found = keys_.find(key);
+  if (found != keys_.end())
+  {
+    if (found->second.type != type)
+    {
+      throw std::logic_error("The key " + key + " is registered with another type.");
+    }
+    return found->second.id;
+  }
+
+  if (names_.size() >= kPayloadKey)
+  {
+    throw std::length_error("No ids left for the key " + key + ".");
+  }
+
+  uint16_t id = (uint16_t)names_.size();
+  keys_[key] = {id, type};
+  names_.push_back(key);
+  return id;
+}
+
+/**
+ * @brief Sets the type of the payload
+ *
+ * @param type The type tag of the payload, kNoType to not send it
+ */
+void pipeWire::payload(typeTag type) { payload_ = type; }
+
+/**
+ * @brief Gets the codec of a type tag
+ *
+ * @param tag The type tag
+ *
+ * @throws std::invalid_argument if the tag has no codec
+ *
+ * @return The codec
+ */
+const pipeWire::codec &pipeWire::Find(typeTag tag) const
+{
+  if (tag >= codecs_.size() || !codecs_[tag].known)
+  {
+    throw std::invalid_argument("The type tag " + std::to_string(tag) + " has no codec.");
+  }
+  return codecs_[tag];
+}
+
+/**
+ * @brief Appends a field with its value
+ *
+ * @param type The type tag of the value
+ * @param key The id of the key
+ * @param value The value, nullptr for a null value
+ * @param out The string the frame is being written to
+ */
+void pipeWire::Write(typeTag type, uint16_t key, const void *value, std::string &out) const
+{
+  size_t at = out.size();
+  fieldHeader field = {kNull, key, type};
+
+  out.resize(at + sizeof(field));
+  if (value != nullptr && type != kNoType)
+  {
+    auto &own = Find(type);
+    if (own.encode)
+    {
+      own.encode(value, out);
+    }
+    else
+    {
+      out.append((const char *)value, own.size);
+    }
+    field.length = (uint32_t)(out.size() - at - sizeof(field));
+  }
+  memcpy(&out[at], &field, sizeof(field));
+  out.resize(Align(out.size()), '\0');
+}
+
+/**
+ * @brief Appends the frame of a packet to a string
+ *
+ * @details The frame is as long as a multiple of 8 bytes, so the frames
+ * written one after the other stay aligned.
+ *
+ * @param data The packet
+ * @param out The string to append the frame to
+ *
+ * @throws std::invalid_argument if a key of the packet is not registered or
+ * a type has no codec
+ *
+ * @return The length of the frame
+ */
+size_t pipeWire::Serialize(pipeData *data, std::string &out) const
+{
+  size_t start = out.size();
+  auto &entries = data->extra_data();
+
+  out.resize(start + sizeof(frameHeader));
+  try
+  {
+    Write(payload_, kPayloadKey, data->data(), out);
+    for (auto entry : entries)
+    {
+      auto found = keys_.find(entry->key);
+      if (found == keys_.end())
+      {
+        throw std::invalid_argument("The extra data key " + entry->key + " is not registered.");
+      }
+      Write(found->second.type, found->second.id, entry->data, out);
+    }
+  }
+  catch (...)
+  {
+    out.resize(start);
+    throw;
+  }
+
+  frameHeader header = {(uint32_t)(out.size() - start),
+                        kMagic,
+                        kVersion,
+                        HostFlags(),
+                        (uint32_t)entries.size(),
+                        (int32_t)data->priority(),
+                        data->sequence(),
+                        data->deadline(),
+                        data->route(),
+                        data->passes()};
+  memcpy(&out[start], &header, sizeof(header));
+
+  return header.length;
+}
+
+/**
+ * @brief Builds a packet from a frame
+ *
+ * @details The values without a decoder, the fixed size ones by default, are
+ * not copied: the packet points into the frame, which has to outlive it and
+ * be 8 byte aligned. With copy the frame is copied first, and the copy is
+ * freed with the packet when it is released.
+ *
+ * @param bytes The frame
+ * @param size The bytes available, at least the length of the frame
+ * @param copy True to copy the frame
+ *
+ * @throws std::invalid_argument if the frame is truncated, of an unknown
+ * version or byte order, carries an unknown key or type, a key twice or a
+ * value of the wrong size for its type
+ *
+ * @return The packet, with the routing fields it was written with
+ */
+pipeData *pipeWire::Deserialize(const char *bytes, size_t size, bool copy) const
+{
+  frameHeader header;
+
+  if (size < sizeof(header))
+  {
+    throw std::invalid_argument("The pipeWire frame is truncated.");
+  }
+  memcpy(&header, bytes, sizeof(header));
+  if (header.magic != kMagic || header.version == 0 || header.version > kVersion)
+  {
+    throw std::invalid_argument("Not a pipeWire frame of a known version.");
+  }
+  if (header.flags != HostFlags())
+  {
+    throw std::invalid_argument("The pipeWire frame has the other byte order.");
+  }
+  if (header.length > size)
+  {
+    throw std::invalid_argument("The pipeWire frame is truncated.");
+  }
+
+  // Check every field before anything is built
+  std::vector<size_t> fields;
+  std::vector<bool> seen(names_.size(), false);
+  size_t at = sizeof(header);
+  for (uint32_t it = 0; it <= header.entries; ++it)
+  {
+    fieldHeader field;
+    if (at + sizeof(field) > header.length)
+    {
+      throw std::invalid_argument("The pipeWire frame is truncated.");
+    }
+    memcpy(&field, bytes + at, sizeof(field));
+    size_t length = field.length == kNull ? 0 : field.length;
+    if (at + sizeof(field) + length > header.length)
+    {
+      throw std::invalid_argument("The pipeWire frame is truncated.");
+    }
+    if ((it == 0) != (field.key == kPayloadKey) || (it > 0 && field.key >= names_.size()))
+    {
+      throw std::invalid_argument("The pipeWire frame carries an unknown key.");
+    }
+    if (it > 0 && seen[field.key])
+    {
+      throw std::invalid_argument("The pipeWire frame carries a key twice.");
+    }
+    if (it > 0)
+    {
+      seen[field.key] = true;
+    }
+    // The values read in place must be whole
+    if (field.length != kNull)
+    {
+      auto &own = Find(field.type);
+      if (!own.decode && own.size != 0 && field.length != own.size)
+      {
+        throw std::invalid_argument("The pipeWire frame carries a value of the wrong size.");
+      }
+    }
+    fields.push_back(at);
+    at = Align(at + sizeof(field) + length);
+  }
+
+  char *block = nullptr;
+  const char *frame = bytes;
+  if (copy)
+  {
+    block = new char[header.length];
+    memcpy(block, bytes, header.length);
+    frame = block;
+  }
+
+  pipeData *data = nullptr;
+  for (auto offset : fields)
+  {
+    fieldHeader field;
+    void *value = nullptr;
+
+    memcpy(&field, frame + offset, sizeof(field));
+    if (field.length != kNull)
+    {
+      auto &own = codecs_[field.type];
+      const char *start = frame + offset + sizeof(field);
+      value = own.decode ? own.decode(start, field.length) : (void *)start;
+    }
+
+    if (data == nullptr)
+    {
+      data = new pipeData(value);
+    }
+    else
+    {
+      data->setDataKey(names_[field.key], value);
+    }
+  }
+
+  data->priority(header.priority);
+  data->sequence(header.sequence);
+  data->deadline(header.deadline);
+  data->route(header.route);
+  data->passes(header.passes);
+  if (block != nullptr)
+  {
+    data->release_hook(FreeFrame, block);
+  }
+
+  return data;
+}
+
+/**
+ * @brief Gets the length of the frame starting at some bytes
+ *
+ * @details Lets a reader of a stream know when a whole frame has arrived.
+ *
+ * @param bytes The start of the frame
+ * @param size The bytes available
+ *
+ * @return The length of the frame, 0 if its length has not arrived yet or
+ * more bytes are needed
+ */
+size_t pipeWire::FrameLength(const char *bytes, size_t size)
+{
+  uint32_t length;
+
+  if (size < sizeof(length))
+  {
+    return 0;
+  }
+  memcpy(&length, bytes, sizeof(length));
+  return length <= size ? length : 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file pipeWire.h
+ *
+ * @brief Declaration of the pipeWire class methods
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipeData.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class pipeWire
+ *
+ * @brief The binary format a pipeData is stored or sent in
+ *
+ * @details A frame starts with its length and a fixed header carrying the
+ * version and the routing fields of the packet. Then come the payload and
+ * the extra data entries, each one with its length, the interned id of its
+ * key and the type tag of its value. Everything is 8 byte aligned, so the
+ * values of fixed size are read in place: decoding does not copy them, the
+ * packet points into the frame.
+ *
+ * The payload and every key are given a type tag, and every tag a codec.
+ * Both ends of a transport must register the same keys in the same order so
+ * they get the same ids. The frames are written in the byte order of the
+ * host and a frame from a host of the other order is rejected.
+ *
+ * Registration is not thread safe and is done before use; Serialize and
+ * Deserialize can then be called from any thread.
+ */
+class pipeWire
+{
+public:
+  using typeTag = uint16_t;
+
+  // Appends the bytes of a value to the string
+  using encodeFn = std::function<void(const void *, std::string &)>;
+
+  // Builds a value from its bytes. nullptr in a codec reads it in place
+  using decodeFn = std::function<void *(const char *, size_t)>;
+
+  static const uint8_t kVersion = 1;        /**< The version of the frames written */
+  static const size_t kHeaderSize = 40;     /**< The bytes before the payload */
+  static const typeTag kNoType = 0;         /**< The tag of a payload not sent */
+
+  // Constructor. No keys and no codecs
+  pipeWire();
+
+  // Registers a codec. A size of 0 means the values have variable size
+  void Codec(typeTag, size_t, encodeFn = nullptr, decodeFn = nullptr);
+
+  // Registers a trivially copyable type, written and read in place
+  template <typename T>
+  void Pod(typeTag tag)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Pod needs a trivially copyable type.");
+    Codec(tag, sizeof(T));
+  }
+
+  // Registers an extra data key with the type of its values. Returns its id
+  uint16_t Key(std::string, typeTag);
+
+  // Sets the type of the payload, kNoType to not send it
+  void payload(typeTag);
+
+  // Getter. Returns the type of the payload
+  typeTag payload() const { return payload_; };
+
+  // Appends the frame of a packet to the string. Returns the frame length
+  size_t Serialize(pipeData *, std::string &) const;
+
+  // Builds a packet from a frame. With copy the packet owns a copy of it
+  pipeData *Deserialize(const char *, size_t, bool = false) const;
+
+  // Length of the frame starting at the bytes, 0 if it is not all there yet
+  static size_t FrameLength(const char *, size_t);
+
+private:
+  /**
+   * @brief How the values of a type tag are written and read
+   */
+  struct codec
+  {
+    bool known = false; /**< The tag has been registered */
+    size_t size = 0;    /**< Bytes of every value, 0 if variable */
+    encodeFn encode;    /**< Writes a value, a copy of size bytes if none */
+    decodeFn decode;    /**< Reads a value, in place if none */
+  };
+
+  /**
+   * @brief An extra data key registered
+   */
+  struct keyInfo
+  {
+    uint16_t id;  /**< The id written in the frames */
+    typeTag type; /**< The type of its values */
+  };
+
+  void Write(typeTag, uint16_t, const void *, std::string &) const;
+  const codec &Find(typeTag) const;
+
+  std::vector<codec> codecs_;                       /**< The codecs by type tag */
+  std::unordered_map<std::string, keyInfo> keys_;   /**< The keys by name */
+  std::vector<std::string> names_;                  /**< The keys by id */
+  typeTag payload_;                                 /**< The type of the payload */
+};
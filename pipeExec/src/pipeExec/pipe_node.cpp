@@ -117,6 +117,223 @@ pipeMapper::nodeId PipeNode::getNodeAddress() const { return node_address_; };
  */
 int PipeNode::node_id() { return node_id_; }
 
+/**
+ * @brief Gets the execution counters of the current node
+ *
+ * @return A reference to the counters kept by the node instances
+ */
+PipeNode::nodeStats &PipeNode::stats() { return stats_; }
+
+/**
+ * @brief Prints the execution counters of the current node
+ *
+ * @details Along with the raw hardware counters it prints the ratios that tell
+ * if the unit is bound by the caches (LLC misses per thousand instructions) or
+ * by the branches (branch misses per thousand instructions).
+ */
+void PipeNode::PrintStats()
+{
+  uint64_t packets = stats_.packets.load(std::memory_order_relaxed);
+  uint64_t samples = stats_.hw_samples.load(std::memory_order_relaxed);
+  uint64_t hw[perfCounters::kCounters];
+
+  printf("NODE %d [%u:%u:%u]\t INSTANCES %d\n    Packets: %lu\n    Time running: %.3fms\n",
+         node_id_, node_address_.x, node_address_.y, node_address_.z, number_of_instances_,
+         (unsigned long)packets, stats_.busy_ns.load(std::memory_order_relaxed) / 1e6);
+
+  uint64_t shed = stats_.shed.load(std::memory_order_relaxed);
+  if (shed != 0)
+    printf("    Late packets shed: %lu\n", (unsigned long)shed);
+
+  if (!hw_counters_)
+    return;
+
+  if (samples == 0)
+  {
+    printf("    Hardware counters unavailable\n");
+    return;
+  }
+
+  unsigned int available = stats_.hw_available.load(std::memory_order_relaxed);
+  for (int it = 0; it < perfCounters::kCounters; ++it)
+  {
+    hw[it] = stats_.hw[it].load(std::memory_order_relaxed);
+    if (available & (1u << it))
+      printf("    %s: %lu\n", perfCounters::name((perfCounters::counter)it), (unsigned long)hw[it]);
+    else
+      printf("    %s: n/a\n", perfCounters::name((perfCounters::counter)it));
+  }
+
+  if (hw[perfCounters::kInstructions] != 0)
+  {
+    double kinstr = hw[perfCounters::kInstructions] / 1000.0;
+    printf("    IPC: %.2f\n    LLC misses per 1k instructions: %.3f\n"
+           "    Branch misses per 1k instructions: %.3f\n",
+           hw[perfCounters::kCycles] ? (double)hw[perfCounters::kInstructions] / hw[perfCounters::kCycles] : 0.0,
+           hw[perfCounters::kLlcMisses] / kinstr, hw[perfCounters::kBranchMisses] / kinstr);
+  }
+}
+
+/**
+ * @brief Gets whether the instances open the hardware counters
+ *
+ * @return True if the counters are measured around Run
+ */
+bool PipeNode::hw_counters() const { return hw_counters_; }
+
+/**
+ * @brief Sets whether the instances open the hardware counters
+ *
+ * @param enable True to measure the counters around Run
+ */
+void PipeNode::hw_counters(bool enable) { hw_counters_ = enable; }
+
+/**
+ * @brief Sets what the node does with the packets past their deadline
+ *
+ * @details Installed by the topology before the node runs.
+ *
+ * @param policy What is done with the late packets
+ * @param queue Where kDivertLate and kOutputLate push them
+ *
+ * @throws std::invalid_argument if the policy needs a queue and has none
+ */
+void PipeNode::late(latePolicy policy, pipeQueue *queue)
+{
+  if ((policy == kDivertLate || policy == kOutputLate) && queue == nullptr)
+  {
+    throw std::invalid_argument("The late policy needs a queue.");
+  }
+  late_policy_ = policy;
+  late_queue_ = queue;
+}
+
+/**
+ * @brief Gets what the node does with the packets past their deadline
+ *
+ * @return The late policy
+ */
+PipeNode::latePolicy PipeNode::late() const { return late_policy_; }
+
+/**
+ * @brief Takes a packet past its deadline away from the node
+ *
+ * @details Called by the instances before Run. The packets without deadline
+ * or on time are left alone, the late ones are dropped or pushed elsewhere
+ * according to the policy and counted in the stats of the node. A packet
+ * pushed elsewhere loses its deadline, so the nodes after the late node run
+ * it instead of sending it back.
+ *
+ * @param data The packet about to run
+ *
+ * @return True if the packet was taken and must not run
+ */
+bool PipeNode::Shed(pipeData *data)
+{
+  if (late_policy_ == kRunLate || !data->expired())
+  {
+    return false;
+  }
+
+  stats_.shed.fetch_add(1, std::memory_order_relaxed);
+  if (late_policy_ == kDropLate)
+  {
+    data->Release();
+  }
+  else
+  {
+    data->deadline(0);
+    late_queue_->Push(data, data->priority());
+  }
+  return true;
+}
+
+/**
+ * @brief Waits for the next packet of the node
+ *
+ * @details Without housekeeping the instance sleeps until a packet comes.
+ * With it, it wakes up after that long without packets so the unit can Tick.
+ * Cancelling the node wakes it up at once.
+ *
+ * @return The packet, nullptr on housekeeping time or cancellation
+ */
+void *PipeNode::Take()
+{
+  if (housekeeping_.count() == 0)
+  {
+    return in_data_queue_->PopUntil(std::chrono::steady_clock::time_point::max(), &cancel_);
+  }
+  return in_data_queue_->PopFor(housekeeping_, &cancel_);
+}
+
+/**
+ * @brief Sets how often an idle instance wakes up to call Tick
+ *
+ * @details The period counts from the last packet taken, so a busy node
+ * never Ticks. It lets the units flush, expire or report without a packet.
+ *
+ * @param period The idle time before a Tick, 0 to never Tick
+ */
+void PipeNode::housekeeping(std::chrono::microseconds period) { housekeeping_ = period; }
+
+/**
+ * @brief Gets how often an idle instance wakes up to call Tick
+ *
+ * @return The idle time before a Tick, 0 if it never Ticks
+ */
+std::chrono::microseconds PipeNode::housekeeping() const { return housekeeping_; }
+
+/**
+ * @brief Wakes every waiting instance of the node and makes them end
+ *
+ * @details The instances busy in Run end once they come back for the next
+ * packet. The packets still queued are left in the input queue.
+ */
+void PipeNode::Cancel() { cancel_.Cancel(); }
+
+/**
+ * @brief Gets whether the node has been cancelled
+ *
+ * @return True once Cancel has been called
+ */
+bool PipeNode::cancelled() const { return cancel_.cancelled(); }
+
+/**
+ * @brief Sends a packet to where the node routes the packets it runs
+ *
+ * @details Used by the processing units that hold packets and release them
+ * later, so the packet follows the same routing as if it had been released
+ * at the end of its own Run.
+ *
+ * @param data The packet
+ */
+void PipeNode::Forward(pipeData *data)
+{
+  if (!forward_)
+  {
+    throw std::logic_error("The node is not running in a topology.");
+  }
+  forward_(data);
+}
+
+/**
+ * @brief Sets how the node routes its packets
+ *
+ * @param route The routing of the topology the node runs in
+ */
+void PipeNode::forward(std::function<void(pipeData *)> route) { forward_ = route; }
+
+/**
+ * @brief Routes a packet held by the unit as if its own Run had just finished
+ *
+ * @param data The packet, it goes on from the node that ran it
+ */
+void ProcessingUnitInterface::Emit(pipeData::dataPacket data)
+{
+  auto pData = (pipeData *)data;
+  pData->getNodeData()->Forward(pData);
+}
+
 /**
  * @brief Gets a vector of running threads for the current node
  *
@@ -33,7 +33,10 @@
 #include "processing_unit_interface.h"
 #include "pipeMapper.h"
 #include <thread>
+#include <chrono>
+#include <functional>
 #include "profiling.h"
+#include "perfCounters.h"
 
 /**
  * @class PipeNode
@@ -64,6 +67,68 @@ public:
     EMPTY
   };
 
+  /**
+   * @enum latePolicy
+   * @brief What a node does with a packet whose deadline has passed
+   */
+  enum latePolicy
+  {
+    kRunLate,    /**< Runs it as any other packet */
+    kDropLate,   /**< Releases it */
+    kDivertLate, /**< Pushes it to the input queue of a late node */
+    kOutputLate  /**< Pushes it to the output queue of the topology */
+  };
+
+  /**
+   * @brief Counters updated by the running instances of the node
+   *
+   * @details They are only touched with relaxed atomic operations so the
+   * worker threads never wait on each other to keep them.
+   */
+  struct nodeStats
+  {
+    /**
+     * @brief Upper bounds in ns of the Run latency histogram buckets. The
+     * last bucket holds everything above the last bound.
+     */
+    static constexpr uint64_t kLatencyBounds[] = {1000, 10000, 100000, 1000000,
+                                                  10000000, 100000000, 1000000000};
+    static constexpr int kLatencyBuckets = sizeof(kLatencyBounds) / sizeof(uint64_t) + 1;
+
+    std::atomic<uint64_t> packets{0}; /**< Packets processed by the unit */
+    std::atomic<uint64_t> busy_ns{0}; /**< Time spent inside Run in ns */
+    std::atomic<uint64_t> latency[kLatencyBuckets]{}; /**< Run latency histogram */
+    std::atomic<uint64_t> scale_up{0};   /**< ADD_THR commands executed */
+    std::atomic<uint64_t> scale_down{0}; /**< END_THR commands executed */
+    std::atomic<uint64_t> shed{0};       /**< Late packets not run */
+    std::atomic<uint64_t> hw_samples{0}; /**< Runs measured with counters */
+    std::atomic<uint64_t> hw[perfCounters::kCounters]{}; /**< Counters */
+    std::atomic<unsigned int> hw_available{0}; /**< Counters ever read */
+
+    // Accounts one call to Run that lasted the given time
+    void Record(std::chrono::nanoseconds busy)
+    {
+      packets.fetch_add(1, std::memory_order_relaxed);
+      busy_ns.fetch_add(busy.count(), std::memory_order_relaxed);
+
+      int bucket = 0;
+      while (bucket < kLatencyBuckets - 1 && (uint64_t)busy.count() > kLatencyBounds[bucket])
+        ++bucket;
+      latency[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Accounts the hardware counters read around one call to Run
+    void Record(const perfCounters::values &before, const perfCounters::values &after)
+    {
+      hw_samples.fetch_add(1, std::memory_order_relaxed);
+      hw_available.fetch_or(after.available, std::memory_order_relaxed);
+      for (int it = 0; it < perfCounters::kCounters; ++it)
+      {
+        hw[it].fetch_add(after.value[it] - before.value[it], std::memory_order_relaxed);
+      }
+    }
+  };
+
   // Default constructor for PipeNode
   PipeNode(){};
   //PipeNode();
@@ -116,6 +181,49 @@ pipeMapper::nodeId getNodeAddress() const;
   // Gets the ID of the current node
   int node_id();
 
+  // Gets the execution counters of the current node
+  nodeStats &stats();
+
+  // Prints the execution counters of the current node
+  void PrintStats();
+
+  // Gets whether the instances open the hardware counters
+  bool hw_counters() const;
+
+  // Sets whether the instances open the hardware counters
+  void hw_counters(bool);
+
+  // Sets what the node does with the packets past their deadline
+  void late(latePolicy, pipeQueue * = nullptr);
+
+  // Gets what the node does with the packets past their deadline
+  latePolicy late() const;
+
+  // Takes a packet past its deadline away from the node. True if taken
+  bool Shed(pipeData *);
+
+  // Waits for the next packet. nullptr when it is time for housekeeping or
+  // the node has been cancelled
+  void *Take();
+
+  // Sets how often an idle instance wakes up to call Tick. 0 never
+  void housekeeping(std::chrono::microseconds);
+
+  // Gets how often an idle instance wakes up to call Tick
+  std::chrono::microseconds housekeeping() const;
+
+  // Wakes every waiting instance and makes them end
+  void Cancel();
+
+  // Gets whether the node has been cancelled
+  bool cancelled() const;
+
+  // Sends a packet to where the node routes the packets it runs
+  void Forward(pipeData *);
+
+  // Sets how the node routes its packets. Installed by the topology
+  void forward(std::function<void(pipeData *)>);
+
   // Gets a vector of running threads for the current node
   std::vector<std::thread *> &running_threads();
 
@@ -184,4 +292,11 @@ private:
   std::vector<nodeCmd> cmd_;
   pipeMapper::nodeId prev_address_;
   pipeMapper::nodeId node_address_;
+  nodeStats stats_; /**< The execution counters of the node */
+  bool hw_counters_ = false; /**< Open the hardware counters per instance */
+  latePolicy late_policy_ = kRunLate; /**< What is done with the late packets */
+  pipeQueue *late_queue_ = nullptr;   /**< Where the late packets are pushed */
+  std::function<void(pipeData *)> forward_; /**< Routes a packet of the node */
+  std::chrono::microseconds housekeeping_{0}; /**< Idle time before a Tick */
+  cancelToken cancel_;                        /**< Interrupts the waiting instances */
 };
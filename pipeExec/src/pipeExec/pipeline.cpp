@@ -1,8 +1,8 @@
 #include "pipeline.h"
+#include "pipeLogger.h"
 
 #include <cstdio>
 #include <string>
-#include <iostream>
 
 /**
  * @brief Constructor for the Pipeline class
@@ -17,7 +17,7 @@
  *
  */
 Pipeline::Pipeline(ProcessingUnitInterface *procUnit, pipeQueue *data_in, pipeQueue *data_out, int instances, pipeData::dataPacket initData, bool debug, bool profiling)
-    : debug_(debug), show_profiling_(profiling), node_number_(0)
+    : debug_(debug), show_profiling_(profiling), node_number_(0), hw_counters_(false)
 {
 
   PipeNode *first_node = new PipeNode;
@@ -58,11 +58,19 @@ Pipeline::~Pipeline() {}
  * @param queueSize the size of the output queue
  * @param maxInstances the maximun number of instances that can be reached when dinamicaly increased.
  * @param minInstances the minimum number of instances that can be left when dinamicaly decreasing.
+ * @param name the name the node is found with, e.g. by deadlines and pipeMapper::Route, besides "[x:0:0]"
  *
  * @returns a pointer to the node.
+ *
+ * @throws std::invalid_argument if the name is in use
  */
-PipeNode *Pipeline::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, pipeData::dataPacket initData, int queueSize, int maxInstances, int minInstances)
+PipeNode *Pipeline::AddProcessingUnit(ProcessingUnitInterface *procUnit, int instances, pipeData::dataPacket initData, int queueSize, int maxInstances, int minInstances,
+                                      std::string name)
 {
+  if (name != "" && oneDimPipe->nodeExists(name))
+  {
+    throw std::invalid_argument("[" + name + "] - is in use.");
+  }
 
   PipeNode *new_node = new PipeNode;
 
@@ -83,6 +91,10 @@ PipeNode *Pipeline::AddProcessingUnit(ProcessingUnitInterface *procUnit, int ins
   lastNode_ = new_node;
   ++node_number_;
   new_node->setNodeAddress(oneDimPipe->addNode(new_node));
+  if (name != "")
+  {
+    oneDimPipe->nameNode(new_node->getNodeAddress(), name);
+  }
   //  std::cout << __func__ << ":" << __LINE__ << std::endl;
   new_node->setPrevAddress(prev_address_);
 
@@ -114,6 +126,75 @@ PipeNode *Pipeline::InsertProcessingUnit(PipeNode *pNode, ProcessingUnitInterfac
   return nullptr;
 }
 
+/**
+ * @brief Sends a packet to the node that follows the one that ran it
+ *
+ * @details Used when Run returns and by the units that hold packets and
+ * release them later through PipeNode::Forward.
+ *
+ * @param node The node that ran the packet
+ * @param pData The packet
+ * @param map The map of the nodes
+ */
+static void RouteData(PipeNode *node, pipeData *pData, pipeMapper *map)
+{
+  // A route handle set by the unit takes the packet one hop
+  auto route = pData->route();
+  if (route != pipeMapper::kNoRoute)
+  {
+    pData->route(pipeMapper::kNoRoute);
+    if (route == pipeMapper::kWriteOut)
+    {
+      ((PipeNode *)map->getPipeNode(pipeMapper::nodeId(0, 0, 0)))->out_data_queue()->Push(pData, pData->priority());
+    }
+    else
+    {
+      ((PipeNode *)map->getRouteNode(route))->in_data_queue()->Push(pData, pData->priority());
+    }
+    return;
+  }
+
+  // Check if the proccesing unit wants to write to a named address
+  // If the address is NEXT_ADDRESS, you get a nodeId else you get nullptr
+  auto nextNode = (pipeMapper::nodeId *)pData->GetExtraData("_#NEXT_ADDRESS#_");
+
+  if (nextNode != nullptr)
+  {
+    // Check that the node exists
+    if (map->nodeExists(*nextNode))
+    {
+      // Get the node assiated with the address
+      auto next_node = (PipeNode *)map->getPipeNode((pipeMapper::nodeId)*nextNode);
+      if (next_node->last_node())
+      {
+        next_node->out_data_queue()->Push(pData, pData->priority());
+      }
+      else
+      {
+        next_node->in_data_queue()->Push(pData, pData->priority());
+      }
+    }
+  }
+  else
+  {
+    // If not address given, just go to the next node
+    auto id = node->getNodeAddress();
+    if (node->last_node())
+    {
+      id.x = id.y = id.z = 0;
+      auto next_node = (PipeNode *)map->getPipeNode(id);
+      next_node->out_data_queue()->Push(pData, pData->priority());
+    }
+    else
+    {
+      id.x += 1;
+      // std::cout << "NODE id.x = " << id.x << " id.y = " << id.y << std::endl;
+      auto next_node = (PipeNode *)map->getPipeNode(id);
+      next_node->in_data_queue()->Push(pData, pData->priority());
+    }
+  }
+}
+
 /**
  * @brief The function that all threads execute to run their processing unit.
  * @details This function gets the data from the input MemoryManager, executes
@@ -132,6 +213,7 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
 {
 
   ProcessingUnitInterface *processing_unit = node->processing_unit();
+  ProcessingUnitInterface *node_unit = processing_unit; // What the instance was made from
 
   //  std::cout << __func__ << " : " << __LINE__ << std::endl;
   if (n_id != 0)
@@ -146,6 +228,10 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
 
   mtx.unlock();
 
+  // Opens the hardware counters of this instance when asked for
+  perfCounters counters(node->hw_counters());
+  perfCounters::values before, after;
+
   // TIMESTAMP
   if (profiling)
   {
@@ -157,7 +243,9 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
                                      .time_start = STOPWATCH_NOW,
                                      .time_end = STOPWATCH_NOW,
                                      .sys_time_start = clock(),
-                                     .sys_time_end = 0});
+                                     .sys_time_end = 0,
+                                     .hw_available = counters.available(),
+                                     .hw = {}});
     prof.unlock();
   }
 
@@ -170,7 +258,7 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
     do
     {
       //      std::cout << "NODE " << node->node_id() << " RUNNING INST " << n_id << " OF " << node->number_of_instances() << std::endl;
-      auto data = node->in_data_queue()->Pop();
+      auto data = node->Take();
       auto pnode = (PipeNode *)map->getPipeNode(node->getPrevAddress());
       if (pnode != node)
       {
@@ -182,32 +270,34 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
           switch (cmd)
           {
           case PipeNode::nodeCmd::NO_OP:
-            std::cout << "Null command received nothing done - cmd = " << cmd << std::endl;
+            PIPE_DEBUG("Null command received nothing done - cmd = %d", cmd);
             break;
           case PipeNode::nodeCmd::ADD_THR:
-            std::cout << "Increment processing unit instances - cmd = " << cmd << std::endl;
+            PIPE_DEBUG("Increment processing unit instances - cmd = %d", cmd);
             if (node->max_instances() == 0 || node->max_instances() > node->number_of_instances())
             {
               mtx.lock();
-              std::cout << "NODE " << node->node_id() << " LAUNCH NEW INSTANCE " << std::endl;
+              PIPE_INFO("NODE %d LAUNCH NEW INSTANCE", node->node_id());
               node->PushThread(new std::thread(RunNode, node, node->number_of_instances(), std::ref(mtx), std::ref(prof), std::ref(profiling_information), std::ref(map), debug, profiling));
               node->number_of_instances(node->number_of_instances() + 1);
+              node->stats().scale_up.fetch_add(1, std::memory_order_relaxed);
             }
             break;
           case PipeNode::nodeCmd::END_THR:
-            std::cout << "Decrement processing unit instances - cmd = " << cmd << std::endl;
+            PIPE_DEBUG("Decrement processing unit instances - cmd = %d", cmd);
             if (node->min_instances() == 0 || node->min_instances() < node->number_of_instances())
             {
               if (node->number_of_instances() > 1)
               {
-                std::cout << "NODE " << node->node_id() << " REMOVING INSTANCE " << std::endl;
+                PIPE_INFO("NODE %d REMOVING INSTANCE", node->node_id());
                 terminate = true;
                 node->number_of_instances(node->number_of_instances() - 1);
+                node->stats().scale_down.fetch_add(1, std::memory_order_relaxed);
               }
             }
             break;
           default:
-            std::cout << "Command id " << cmd << "not implemented." << std::endl;
+            PIPE_WARNING("Command id %d not implemented.", cmd);
           }
           cmd = pnode->getCmd();
         }
@@ -217,19 +307,55 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
 
       //     std::cout << "NODE " << node->node_id() << " RUNNING INST " << n_id << " OF " << node->number_of_instances() << std::endl;
 
-      if (node->processing_unit() != processing_unit)
+      // The unit of the node was replaced, the clones run copies of the new one
+      if (node->processing_unit() != node_unit)
       {
         processing_unit->End(data);
-        processing_unit = node->processing_unit();
+        if (processing_unit != node_unit)
+          delete processing_unit;
+        node_unit = node->processing_unit();
+        processing_unit = n_id != 0 ? node_unit->Clone() : node_unit;
+        // A unit that can not be cloned is shared as it was before
+        if (processing_unit == nullptr)
+          processing_unit = node_unit;
         processing_unit->Init(node->extra_args());
       }
 
+      // Woken up without a packet, to end or to do the housekeeping
+      if (data == nullptr)
+      {
+        if (node->cancelled())
+          terminate = true;
+        else
+          processing_unit->Tick();
+        if (terminate)
+          processing_unit->End(data);
+        continue;
+      }
+
       auto pData = (pipeData *)data;
       pData->setNodeData(node);
 
+      // Packets past their deadline are shed before wasting a Run
+      if (node->Shed(pData))
+      {
+        if (terminate)
+          processing_unit->End(data);
+        continue;
+      }
+
       //      std::cout << "NODE " << node->node_id() << " START RUN " << std::endl;
       // Runs the processing_unit
+      if (counters.available())
+        counters.Read(before);
+      auto run_start = std::chrono::steady_clock::now();
       processing_unit->Run(data);
+      node->stats().Record(std::chrono::steady_clock::now() - run_start);
+      if (counters.available())
+      {
+        counters.Read(after);
+        node->stats().Record(before, after);
+      }
       //      std::cout << "NODE " << node->node_id() << " END   RUN " << std::endl;
 
       /* auto id = node->getNodeAddress();
@@ -247,45 +373,12 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
        }*/
       //      std::cout << "NODE " << node->node_id() << " DATA PUSHED " << std::endl;
 
-      // Check if the proccesing unit wants to write to a named address
-      // If the address is NEXT_ADDRESS, you get a nodeId else you get nullptr
-      auto nextNode = (pipeMapper::nodeId *)pData->GetExtraData("_#NEXT_ADDRESS#_");
-
-      if (nextNode != nullptr)
+      // Units that hold their packet release it later through the node
+      if (!processing_unit->Held())
       {
-        // Check that the node exists
-        if (map->nodeExists(*nextNode))
-        {
-          // Get the node assiated with the address
-          auto next_node = (PipeNode *)map->getPipeNode((pipeMapper::nodeId)*nextNode);
-          if (next_node->last_node())
-          {
-            next_node->out_data_queue()->Push(data);
-          }
-          else
-          {
-            next_node->in_data_queue()->Push(data);
-          }
-        }
-      }
-      else
-      {
-        // If not address given, just go to the next node
-        auto id = node->getNodeAddress();
-        if (node->last_node())
-        {
-          id.x = id.y = id.z = 0;
-          auto next_node = (PipeNode *)map->getPipeNode(id);
-          next_node->out_data_queue()->Push(data);
-        }
-        else
-        {
-          id.y += 1;
-          // std::cout << "NODE id.x = " << id.x << " id.y = " << id.y << std::endl;
-          auto next_node = (PipeNode *)map->getPipeNode(id);
-          next_node->in_data_queue()->Push(data);
-        }
+        RouteData(node, pData, map);
       }
+
       if (terminate)
         processing_unit->End(data);
 
@@ -299,6 +392,10 @@ void RunNode(PipeNode *node, int n_id, std::mutex &mtx, std::mutex &prof, std::v
             info.cycles_end = rdtsc();
             info.time_end = STOPWATCH_NOW;
             info.sys_time_end = clock();
+            for (int it = 0; counters.available() && it < perfCounters::kCounters; ++it)
+            {
+              info.hw[it] += after.value[it] - before.value[it];
+            }
           }
         }
         prof.unlock();
@@ -326,9 +423,29 @@ int Pipeline::RunPipe()
   PipeNode *node;
   bool done = false;
 
+  // The output queue is the one of the first node
+  node = (PipeNode *)oneDimPipe->getPipeNode(id);
+  if (node->out_data_queue()->lanes() != lanes_)
+  {
+    node->out_data_queue()->lanes(lanes_, lane_weight_);
+  }
+
+  // The late packets go to the late node or to the output queue
+  auto late_queue = late_policy_ == PipeNode::kDivertLate
+                        ? ((PipeNode *)oneDimPipe->getPipeNode(late_node_))->in_data_queue()
+                        : node->out_data_queue();
+
   do
   {
     node = (PipeNode *)oneDimPipe->getPipeNode(id);
+    node->hw_counters(hw_counters_);
+    node->late(node->in_data_queue() == late_queue ? PipeNode::kRunLate : late_policy_, late_queue);
+    admission_.Watch(node->in_data_queue());
+    if (node->in_data_queue()->lanes() != lanes_)
+    {
+      node->in_data_queue()->lanes(lanes_, lane_weight_);
+    }
+    node->forward([node, this](pipeData *data) { RouteData(node, data, oneDimPipe); });
     auto numberOfInstances = node->number_of_instances();
     for (auto instanceIt = 0; instanceIt < numberOfInstances; ++instanceIt)
     {
@@ -352,12 +469,26 @@ int Pipeline::RunPipe()
   return nodes_executed;
 }
 
+/**
+ * @brief Pushes a packet to the first node through the admission control
+ *
+ * @details Used instead of pushing to the input queue, so the producer never
+ * blocks unless the full policy of admission() is kBlockFull. The early drop
+ * looks at the input queues of every node once the pipe runs.
+ *
+ * @param data The packet
+ *
+ * @return True if it was pushed, false if it was shed and is still the
+ * caller's
+ */
+bool Pipeline::Admit(pipeData *data) { return admission_.Admit(firstNode_->in_data_queue(), data); }
+
 void Pipeline::Profile()
 {
   std::sort(profiling_list_.begin(), profiling_list_.end(),
             [](const Pipeline::Profiling &a, const Pipeline::Profiling &b)
             {
-              return a.node_id <= b.node_id && a.thread_id <= b.thread_id;
+              return a.node_id < b.node_id || (a.node_id == b.node_id && a.thread_id < b.thread_id);
             });
 
   for (Profiling profile : profiling_list_)
@@ -371,5 +502,81 @@ void Pipeline::Profile()
         ((double)(profile.sys_time_end - profile.sys_time_start) /
          CLOCKS_PER_SEC) *
             1000);
+    if (hw_counters_)
+    {
+      if (!profile.hw_available)
+      {
+        printf("   Hardware counters unavailable\n ");
+        continue;
+      }
+      for (int it = 0; it < perfCounters::kCounters; ++it)
+      {
+        printf("   %s: %lu\n ", perfCounters::name((perfCounters::counter)it), (unsigned long)profile.hw[it]);
+      }
+    }
+  }
+  printf("\n");
+
+  // The totals of every node, all the instances together
+  for (uint x = 0; oneDimPipe->nodeExists(pipeMapper::nodeId(x, 0, 0)); ++x)
+  {
+    ((PipeNode *)oneDimPipe->getPipeNode(pipeMapper::nodeId(x, 0, 0)))->PrintStats();
+  }
+}
+
+/**
+ * @brief Sets whether the instances read the hardware counters around Run
+ *
+ * @details It has to be called before RunPipe. When the counters can not be
+ * opened the pipe runs as usual and Profile reports them as unavailable.
+ *
+ * @param enable True to open the counters for every instance
+ */
+void Pipeline::hwCounters(bool enable) { hw_counters_ = enable; }
+
+/**
+ * @brief Sets what the nodes do with the packets past their deadline
+ *
+ * @details Every node checks pipeData::deadline before Run and sheds the late
+ * packets: kDropLate releases them, kDivertLate pushes them to the late node
+ * and kOutputLate to the output queue. The late node runs every packet it
+ * gets. It has to be called before RunPipe.
+ *
+ * @param policy What is done with the late packets
+ * @param lateNode The name of the late node, only for kDivertLate. The one
+ * given to AddProcessingUnit or the address of the node, like "[1:0:0]"
+ *
+ * @throws std::invalid_argument if kDivertLate is given without a node
+ */
+void Pipeline::deadlines(PipeNode::latePolicy policy, std::string lateNode)
+{
+  if (policy == PipeNode::kDivertLate && lateNode.empty())
+  {
+    throw std::invalid_argument("kDivertLate needs a late node.");
+  }
+  late_policy_ = policy;
+  late_node_ = lateNode;
+}
+
+/**
+ * @brief Splits every queue of the Pipeline in priority lanes
+ *
+ * @details The lanes are set on the input queue of every node and on the
+ * output queue when RunPipe starts, so it has to be called before and the
+ * queues must be empty by then. The packets are pushed to the lane of
+ * pipeData::priority at every hop. See pipeQueue::lanes.
+ *
+ * @param count The number of lanes, from 1 to pipeQueue::kMaxLanes
+ * @param weight The pops a waiting lane lets go by, 0 for strict priority
+ *
+ * @throws std::invalid_argument if the number of lanes is out of range
+ */
+void Pipeline::lanes(int count, unsigned int weight)
+{
+  if (count < 1 || count > pipeQueue::kMaxLanes)
+  {
+    throw std::invalid_argument("lanes has to be between 1 and " + std::to_string(pipeQueue::kMaxLanes) + ".");
   }
+  lanes_ = count;
+  lane_weight_ = weight;
 }
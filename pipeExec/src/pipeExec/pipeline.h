@@ -31,6 +31,7 @@
 #pragma once
 
 #include "pipe_node.h"
+#include "pipeAdmission.h"
 #include "pipeData.h"
 #include "pipeMapper.h"
 #include <algorithm>
@@ -75,6 +76,8 @@ public:
     int64_t sys_time_start; /**< The system time at the start of the RunNode
                               function */
     int64_t sys_time_end;   /**< The system time at the end of the RunNode function */
+    bool hw_available;      /**< True if the hardware counters could be opened */
+    uint64_t hw[perfCounters::kCounters]; /**< The hardware counters of the instance */
   };
   // Constructor for the Pipeline class
   Pipeline(ProcessingUnitInterface *, pipeQueue *, pipeQueue *, int, pipeData::dataPacket, bool = false,
@@ -84,15 +87,31 @@ public:
   ~Pipeline();
 
   // Adds a new processing unit to the Pipeline
-  PipeNode *AddProcessingUnit(ProcessingUnitInterface *, int, pipeData::dataPacket = nullptr, int = 2, int = 0, int = 0);
+  PipeNode *AddProcessingUnit(ProcessingUnitInterface *, int, pipeData::dataPacket = nullptr, int = 2, int = 0, int = 0,
+                              std::string = "");
 
   PipeNode *InsertProcessingUnit(PipeNode *, ProcessingUnitInterface *, int, pipeData::dataPacket = nullptr, int = 2, int = 0, int = 0);
 
   // Runs the pipe making all the threads wait for an input
   int RunPipe();
 
+  // Pushes a packet to the first node through the admission control
+  bool Admit(pipeData *);
+
+  // Gets the admission control of the entry queue
+  pipeAdmission &admission() { return admission_; };
+
   void Profile();
 
+  // Reads the hardware counters of every instance around Run
+  void hwCounters(bool);
+
+  // Splits every queue of the Pipeline in priority lanes
+  void lanes(int, unsigned int = 4);
+
+  // Sets what the nodes do with the packets past their deadline
+  void deadlines(PipeNode::latePolicy, std::string = "");
+
   PipeNode *getHead() { return firstNode_; };
   PipeNode *getTail() { return lastNode_; };
 
@@ -105,6 +124,12 @@ private:
   int node_number_;                        /**< The number of nodes that are active */
   bool debug_;                             /**< The flag to show debug information */
   bool show_profiling_;                    /**< The flag to show profiling information */
+  bool hw_counters_;                       /**< The flag to read the hardware counters */
+  int lanes_ = 1;                          /**< The priority lanes of the queues */
+  unsigned int lane_weight_ = 4;           /**< The pops a waiting lane lets go by */
+  PipeNode::latePolicy late_policy_ = PipeNode::kRunLate; /**< What is done with the late packets */
+  std::string late_node_;                  /**< The node the late packets are diverted to */
+  pipeAdmission admission_;                /**< Decides which packets enter */
   std::vector<Profiling> profiling_list_;  /**< The list of profiling information */
   PipeNode *firstNode_;
   PipeNode *lastNode_;
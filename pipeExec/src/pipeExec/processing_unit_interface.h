@@ -42,6 +42,11 @@ class ProcessingUnitInterface
 {
 public:
 
+  /**
+   * @brief Destructor. Virtual, the clones are deleted through the interface
+   */
+  virtual ~ProcessingUnitInterface() {}
+
   /**
    * @brief Use this function to allocate memory for the variables that need
    * it and initialize some of them
@@ -58,6 +63,12 @@ public:
    */
   virtual void Run(pipeData::dataPacket) = 0;
 
+  /**
+   * @brief Called when an instance has waited the housekeeping period of its
+   * node without a packet. Use it to flush, expire or report
+   */
+  virtual void Tick() { return; };
+
   /**
    * @brief Use this function to free all the memory allocated in the Start
    * method
@@ -103,8 +114,30 @@ public:
     }
   }
 
+  /// @brief Tells the node the last call to Run kept its packet, and clears it
+  /// @return True if the packet must not be routed when Run returns
+  bool Held()
+  {
+    bool held = holding_;
+    holding_ = false;
+    return held;
+  }
+
 protected:
 
+  /// @brief Keeps the packet being run. The node does not route it when Run
+  /// returns, the unit has to Emit it later
+  /// @param data - A pointer to the pipeData object
+  void Hold(pipeData::dataPacket /* data */) { holding_ = true; }
+
+  /// @brief Routes a packet held before as if its own Run had just finished
+  /// @param data - A pointer to the pipeData object
+  void Emit(pipeData::dataPacket data);
+
   std::string extraDataKey;
 
+private:
+
+  bool holding_ = false; /**< The packet of the current Run is kept */
+
 };
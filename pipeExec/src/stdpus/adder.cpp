@@ -26,7 +26,7 @@ void Adder::Run(void *data) {
 
     if (incVal == nullptr )
     {
-      std::cout << "from init - increment = " << incValue_ << std::endl;
+      PIPE_DEBUG("from init - increment = %d", incValue_);
       *val += incValue_;
     }
     else
@@ -0,0 +1,443 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file async_file_sink.cpp
+ *
+ * @brief The source file for the AsyncFileSink processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "async_file_sink.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+static const uint64_t kStop = ~0ull; /**< The user value that stops the completer */
+
+/**
+ * @brief A buffer and the packets whose bytes end in it
+ */
+struct sinkBatch {
+  char *bytes;                  /**< The buffer */
+  size_t used = 0;              /**< Bytes copied to it */
+  size_t written = 0;           /**< Bytes already written */
+  uint64_t offset = 0;          /**< Where it goes in the file */
+  bool done = false;            /**< Its write has completed */
+  bool failed = false;          /**< Its write failed */
+  bool spans = false;           /**< It starts with the rest of a packet begun before */
+  std::vector<pipeData *> packets; /**< Go on when it is written */
+};
+
+/**
+ * @brief The file shared by the instances, its buffers and its writes
+ */
+struct AsyncFileSink::sinkFile {
+  sinkFile(std::string, size_t, unsigned int, bool, std::string);
+  ~sinkFile();
+
+  void Append(pipeData *);
+  void Submit(int);
+  void Complete(int, int);
+  void Completer();
+  void Writer();
+  void Flush();
+
+  int fd;                             /**< The file */
+  std::string length_key;             /**< The key of the payload length */
+  size_t buffer_size;                 /**< Bytes of every buffer */
+  pipeUring *ring = nullptr;          /**< The io_uring, nullptr for the writer thread */
+  bool registered = false;            /**< The buffers are registered with it */
+  std::vector<sinkBatch> batches;     /**< Every buffer */
+  std::deque<int> free;               /**< The buffers not in use */
+  std::deque<int> in_flight;          /**< The buffers submitted, in order */
+  std::deque<int> queued;             /**< The ones the writer thread has to write */
+  int filling = -1;                   /**< The buffer being filled, -1 if none */
+  uint64_t offset;                    /**< Where the next buffer goes */
+  bool stopping = false;              /**< The writer thread has to end */
+  bool span_failed = false;           /**< The bytes of the packet spanning the buffers were lost */
+  std::function<void(pipeData *)> drop; /**< Takes the packets whose write failed */
+  std::mutex mutex;                   /**< Guards all the above */
+  std::condition_variable room;       /**< Signaled when a buffer is free */
+  std::condition_variable changed;    /**< Signaled when a write is queued or done */
+  std::thread *completer = nullptr;   /**< Reaps the completions or writes */
+  std::chrono::steady_clock::time_point first; /**< When the first write was submitted */
+  std::chrono::steady_clock::time_point last;  /**< When the last one completed */
+  std::atomic<uint64_t> bytes{0};     /**< Bytes written */
+  std::atomic<uint64_t> errors{0};    /**< Writes failed */
+  std::atomic<unsigned int> depth{0};     /**< Writes in flight */
+  std::atomic<unsigned int> max_depth{0}; /**< The most writes in flight */
+};
+
+/**
+ * @brief Opens the file and sets up the buffers and the writes
+ *
+ * @throws std::runtime_error if the file can not be opened
+ */
+AsyncFileSink::sinkFile::sinkFile(std::string path, size_t bufferSize, unsigned int buffers, bool useUring,
+                                  std::string lengthKey)
+    : length_key(lengthKey), buffer_size(bufferSize), batches(buffers) {
+  drop = [](pipeData *data) { data->Release(); };
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Can not open " + path + ".");
+  }
+  offset = lseek(fd, 0, SEEK_END);
+
+  std::vector<struct iovec> iovecs;
+  for (unsigned int it = 0; it < buffers; ++it) {
+    batches[it].bytes = (char *)aligned_alloc(4096, (buffer_size + 4095) & ~(size_t)4095);
+    iovecs.push_back({batches[it].bytes, buffer_size});
+    free.push_back(it);
+  }
+
+  if (useUring) {
+    try {
+      // One more entry for the no-op that stops the completer
+      ring = new pipeUring(buffers + 1);
+      registered = ring->RegisterBuffers(iovecs);
+    } catch (const std::runtime_error &) {
+      ring = nullptr;
+    }
+  }
+  completer = ring != nullptr ? new std::thread(&sinkFile::Completer, this) : new std::thread(&sinkFile::Writer, this);
+}
+
+/**
+ * @brief Writes what is left, stops the completer and closes the file
+ */
+AsyncFileSink::sinkFile::~sinkFile() {
+  Flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    if (ring != nullptr) {
+      ring->Nop(kStop);
+      ring->Submit();
+    }
+  }
+  changed.notify_all();
+  completer->join();
+  delete completer;
+  delete ring;
+  for (auto &batch : batches) {
+    ::free(batch.bytes);
+  }
+  close(fd);
+}
+
+/**
+ * @brief Copies the payload of a packet and keeps the packet with the buffer
+ * its last byte is in
+ *
+ * @param data The packet
+ */
+void AsyncFileSink::sinkFile::Append(pipeData *data) {
+  auto length = (uint64_t *)data->GetExtraData(length_key);
+  auto from = (const char *)data->data();
+  size_t left = from == nullptr ? 0 : (length != nullptr ? *length : strlen(from));
+  bool started = false;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  do {
+    // Another instance may have taken a buffer while this one waited
+    room.wait(lock, [this]() { return filling >= 0 || !free.empty(); });
+    if (filling < 0) {
+      filling = free.front();
+      free.pop_front();
+    }
+
+    auto &batch = batches[filling];
+    if (started && batch.used == 0) {
+      batch.spans = true;
+    }
+    size_t copied = std::min(left, buffer_size - batch.used);
+    memcpy(batch.bytes + batch.used, from, copied);
+    started = started || copied > 0;
+    batch.used += copied;
+    from += copied;
+    left -= copied;
+    if (left == 0) {
+      batch.packets.push_back(data);
+    }
+    if (batch.used == buffer_size) {
+      Submit(filling);
+    }
+  } while (left > 0);
+
+  // Nothing is being written, no reason to wait for a full buffer
+  if (filling >= 0 && in_flight.empty()) {
+    Submit(filling);
+  }
+}
+
+/**
+ * @brief Writes a buffer at the end of the file. Called with the lock held
+ *
+ * @param index The buffer
+ */
+void AsyncFileSink::sinkFile::Submit(int index) {
+  auto &batch = batches[index];
+
+  if (in_flight.empty() && bytes == 0 && errors == 0) {
+    first = std::chrono::steady_clock::now();
+  }
+  batch.offset = offset;
+  batch.written = 0;
+  batch.done = false;
+  offset += batch.used;
+  in_flight.push_back(index);
+  filling = -1;
+
+  unsigned int now = ++depth;
+  if (now > max_depth) {
+    max_depth = now;
+  }
+
+  if (ring != nullptr) {
+    ring->Write(fd, batch.bytes, batch.used, batch.offset, registered ? index : -1, index);
+    ring->Submit();
+  } else {
+    queued.push_back(index);
+    changed.notify_all();
+  }
+}
+
+/**
+ * @brief Takes the result of a write and lets the packets of the buffers
+ * written in order go on
+ *
+ * @details The packets with bytes in a buffer whose write failed are dropped
+ * instead.
+ *
+ * @param index The buffer
+ * @param result The bytes written, -errno if it failed
+ */
+void AsyncFileSink::sinkFile::Complete(int index, int result) {
+  std::vector<pipeData *> done, failed;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &batch = batches[index];
+
+    // A short write goes on with the rest
+    if (result > 0 && batch.written + result < batch.used) {
+      batch.written += result;
+      ring->Write(fd, batch.bytes + batch.written, batch.used - batch.written, batch.offset + batch.written,
+                  registered ? index : -1, index);
+      ring->Submit();
+      return;
+    }
+    batch.failed = result < 0 || (result == 0 && batch.written < batch.used);
+    if (batch.failed) {
+      errors++;
+    } else {
+      bytes += batch.used;
+    }
+    batch.done = true;
+    last = std::chrono::steady_clock::now();
+
+    while (!in_flight.empty() && batches[in_flight.front()].done) {
+      auto &front = batches[in_flight.front()];
+
+      // The packet begun in the buffers before is lost if any of them failed
+      bool lost = front.failed || (front.spans && span_failed);
+      for (size_t it = 0; it < front.packets.size(); ++it) {
+        if (it == 0 && front.spans ? lost : front.failed) {
+          failed.push_back(front.packets[it]);
+        } else {
+          done.push_back(front.packets[it]);
+        }
+      }
+      span_failed = front.packets.empty() ? lost : front.failed;
+
+      front.packets.clear();
+      front.used = 0;
+      front.spans = false;
+      free.push_back(in_flight.front());
+      in_flight.pop_front();
+      --depth;
+    }
+    if (filling >= 0 && in_flight.empty()) {
+      Submit(filling);
+    }
+  }
+  room.notify_all();
+  changed.notify_all();
+
+  // Same as Emit, the packets go on from the node that ran them
+  for (auto data : done) {
+    data->getNodeData()->Forward(data);
+  }
+  for (auto data : failed) {
+    drop(data);
+  }
+}
+
+/**
+ * @brief Reaps the completions of the io_uring
+ */
+void AsyncFileSink::sinkFile::Completer() {
+  uint64_t user;
+  int result;
+
+  while (ring->Wait(user, result) && user != kStop) {
+    Complete((int)user, result);
+  }
+}
+
+/**
+ * @brief Writes the buffers queued when there is no io_uring
+ */
+void AsyncFileSink::sinkFile::Writer() {
+  while (true) {
+    int index;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this]() { return !queued.empty() || stopping; });
+      if (queued.empty()) {
+        return;
+      }
+      index = queued.front();
+      queued.pop_front();
+    }
+
+    auto &batch = batches[index];
+    size_t written = 0;
+    int result = 0;
+    while (written < batch.used) {
+      ssize_t done = pwrite(fd, batch.bytes + written, batch.used - written, batch.offset + written);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      if (done <= 0) {
+        result = done < 0 ? -errno : 0;
+        break;
+      }
+      written += done;
+      result = (int)written;
+    }
+    Complete(index, result);
+  }
+}
+
+/**
+ * @brief Writes the buffer being filled and waits for every write
+ */
+void AsyncFileSink::sinkFile::Flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (filling >= 0 && in_flight.empty()) {
+    Submit(filling);
+  }
+  changed.wait(lock, [this]() { return in_flight.empty() && filling < 0; });
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param path The file, created if it does not exist and appended to
+ * @param bufferSize The bytes of every buffer
+ * @param buffers How many buffers, the most writes there can be in flight
+ * @param useUring False to use the writer thread even if there is io_uring
+ * @param lengthKey The extra data key of the payload length, a uint64_t
+ *
+ * @throws std::invalid_argument if there are no buffers or they are empty
+ * @throws std::runtime_error if the file can not be opened
+ */
+AsyncFileSink::AsyncFileSink(std::string path, size_t bufferSize, unsigned int buffers, bool useUring,
+                             std::string lengthKey) {
+  if (bufferSize == 0 || buffers == 0) {
+    throw std::invalid_argument("The sink needs buffers to write from.");
+  }
+  file_ = std::make_shared<sinkFile>(path, bufferSize, buffers, useUring, lengthKey);
+}
+
+/**
+ * @brief Constructor of the clones
+ *
+ * @param file The file of the instance cloned
+ */
+AsyncFileSink::AsyncFileSink(std::shared_ptr<sinkFile> file) : file_(file) {}
+
+/**
+ * @brief Destructor. The last instance writes what is left and closes the file
+ */
+AsyncFileSink::~AsyncFileSink() {}
+
+/**
+ * @brief Copies the payload to be written and holds the packet until it is
+ *
+ * @param data The packet
+ */
+void AsyncFileSink::Run(void *data) {
+  Hold(data);
+  file_->Append((pipeData *)data);
+}
+
+/**
+ * @brief Clones the unit, sharing the file
+ *
+ * @return The new instance
+ */
+ProcessingUnitInterface *AsyncFileSink::Clone() { return new AsyncFileSink(file_); }
+
+/**
+ * @brief Writes the buffer being filled and waits for every write to complete
+ */
+void AsyncFileSink::Flush() { file_->Flush(); }
+
+/**
+ * @brief Sets what is done with the packets whose write failed
+ *
+ * @details Shared by the instances. Set it before the sink runs.
+ *
+ * @param dropper Takes the ownership of every packet dropped
+ */
+void AsyncFileSink::drop(std::function<void(pipeData *)> dropper) { file_->drop = dropper; }
+
+bool AsyncFileSink::uring() const { return file_->ring != nullptr; }
+
+uint64_t AsyncFileSink::bytes() const { return file_->bytes.load(); }
+
+/**
+ * @brief Gets the rate of the writes
+ *
+ * @return The bytes written per second between the first write submitted
+ * and the last one completed, 0 before any completes
+ */
+double AsyncFileSink::bytes_per_second() const {
+  std::lock_guard<std::mutex> lock(file_->mutex);
+  auto seconds = std::chrono::duration<double>(file_->last - file_->first).count();
+  return seconds > 0 ? file_->bytes.load() / seconds : 0;
+}
+
+unsigned int AsyncFileSink::in_flight() const { return file_->depth.load(); }
+
+unsigned int AsyncFileSink::max_in_flight() const { return file_->max_depth.load(); }
+
+uint64_t AsyncFileSink::errors() const { return file_->errors.load(); }
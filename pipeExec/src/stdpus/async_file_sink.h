@@ -0,0 +1,112 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file async_file_sink.h
+ *
+ * @brief The header file for the AsyncFileSink processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#ifndef ASYNC_FILE_SINK_H
+#define ASYNC_FILE_SINK_H
+
+#include "pipeExec.h"
+#include "pipeUring.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class AsyncFileSink
+ *
+ * @brief Appends the payloads of the packets to a file without blocking on
+ * the disk
+ *
+ * @details The payload is copied to one of a few buffers, registered with an
+ * io_uring, and the packet is held. A buffer is written when it is full, or
+ * at once when no write is running, so the batches grow with the load. The
+ * packets go on to the next node, in the order they ran, only once the write
+ * of their bytes has completed, and are dropped if it failed. When io_uring
+ * is not available, or not wanted, a writer thread does the writes instead.
+ *
+ * The length of a payload is the uint64_t under an extra data key, as set by
+ * MmapFileSource; without it the payload is taken as a C string. A packet
+ * without a payload writes nothing. The instances share the file, so it can
+ * run with several.
+ */
+class AsyncFileSink : public ProcessingUnitInterface {
+ public:
+  // Constructor. Opens the file to append to, throws if it can not
+  AsyncFileSink(std::string, size_t = 1 << 20, unsigned int = 8, bool = true, std::string = "length");
+
+  ~AsyncFileSink();
+
+  // Copies the payload to the buffer being filled and holds the packet
+  void Run(void *) override;
+
+  ProcessingUnitInterface *Clone() override;
+
+  // Writes what is buffered and waits for every write to complete
+  void Flush();
+
+  // Sets what is done with the packets whose write failed. They are released
+  // by default
+  void drop(std::function<void(pipeData *)>);
+
+  // Getter. Returns true if the writes go through io_uring
+  bool uring() const;
+
+  // Getter. Returns the bytes written
+  uint64_t bytes() const;
+
+  // Getter. Returns the bytes written per second since the first write
+  double bytes_per_second() const;
+
+  // Getter. Returns the writes submitted and not completed
+  unsigned int in_flight() const;
+
+  // Getter. Returns the most writes there have been in flight
+  unsigned int max_in_flight() const;
+
+  // Getter. Returns the writes that failed
+  uint64_t errors() const;
+
+ private:
+  struct sinkFile;
+
+  // Constructor of the clones, sharing the file
+  AsyncFileSink(std::shared_ptr<sinkFile>);
+
+  std::shared_ptr<sinkFile> file_; /**< The file and its buffers */
+};
+
+#endif
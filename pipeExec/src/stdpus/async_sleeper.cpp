@@ -0,0 +1,118 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file async_sleeper.cpp
+ *
+ * @brief The source file for the AsyncSleeper processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "async_sleeper.h"
+
+/**
+ * @brief Constructor. Starts the timer. The key is the one of the Sleeper
+ *
+ * @param tick The length of one unit of sleep
+ * @param maxInFlight The most packets sleeping at once
+ */
+AsyncSleeper::AsyncSleeper(std::chrono::microseconds tick, unsigned int maxInFlight)
+    : AsyncProcessingUnit(maxInFlight), ticks_to_sleep_(0), tick_(tick), stopping_(false),
+      timer_(&AsyncSleeper::Timer, this) {
+  setKey("_#std#sleeper#time#_");
+}
+
+/**
+ * @brief Destructor. Stops the timer, the packets still sleeping are not
+ * completed
+ */
+AsyncSleeper::~AsyncSleeper() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  changed_.notify_all();
+  timer_.join();
+}
+
+/**
+ * @brief Sets the sleep of the packets that do not carry one
+ *
+ * @param initData A pointer to an int with the ticks, nullptr for 0
+ */
+void AsyncSleeper::Init(void *initData) {
+  ticks_to_sleep_ = initData != nullptr ? *static_cast<int *>(initData) : 0;
+}
+
+/**
+ * @brief Puts the packet on the timer
+ *
+ * @param data The packet
+ */
+void AsyncSleeper::Start(pipeData *data) {
+  auto ticks = static_cast<int *>(getExtraData(data, getKey()));
+  auto due = std::chrono::steady_clock::now() + (ticks != nullptr ? *ticks : ticks_to_sleep_) * tick_;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sleeping_.push({due, data});
+  }
+  changed_.notify_one();
+}
+
+/**
+ * @brief Completes the packets whose time has come
+ */
+void AsyncSleeper::Timer() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (!stopping_) {
+    if (sleeping_.empty()) {
+      changed_.wait(lock);
+      continue;
+    }
+
+    auto next = sleeping_.top();
+    if (std::chrono::steady_clock::now() < next.first) {
+      changed_.wait_until(lock, next.first);
+      continue;
+    }
+
+    sleeping_.pop();
+    lock.unlock();
+    Complete(next.second);
+    lock.lock();
+  }
+}
+
+/**
+ * @brief Clones the unit with the same tick and limit
+ *
+ * @return The new instance
+ */
+ProcessingUnitInterface *AsyncSleeper::Clone() {
+  auto clone = new AsyncSleeper(tick_, max_in_flight());
+  clone->setKey(getKey());
+  return clone;
+}
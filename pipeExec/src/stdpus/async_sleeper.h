@@ -0,0 +1,86 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file async_sleeper.h
+ *
+ * @brief The header file for the AsyncSleeper processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#ifndef ASYNC_SLEEPER_H
+#define ASYNC_SLEEPER_H
+
+#include "pipeExec.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @class AsyncSleeper
+ *
+ * @brief The Sleeper as an async unit: the packets wait on a timer instead of
+ * a thread each
+ *
+ * @details It stands in for the units that wait on a remote call. The sleep
+ * is taken as the Sleeper does, from the int under the key or the one given to
+ * Init, in ticks. Every instance has a timer thread that completes the
+ * packets when their time comes, so one instance keeps as many packets
+ * sleeping as its limit of packets in flight.
+ */
+class AsyncSleeper : public AsyncProcessingUnit {
+ public:
+  // Constructor. The sleeps are counted in ticks of the given length
+  AsyncSleeper(std::chrono::microseconds = std::chrono::microseconds(1000000), unsigned int = 256);
+
+  // Destructor. Stops the timer
+  ~AsyncSleeper();
+
+  // Sets the sleep of the packets without one, in ticks
+  void Init(void * = nullptr) override;
+
+  ProcessingUnitInterface *Clone() override;
+
+ protected:
+  // Puts the packet on the timer
+  void Start(pipeData *) override;
+
+ private:
+  using wake = std::pair<std::chrono::steady_clock::time_point, pipeData *>;
+
+  void Timer();
+
+  int ticks_to_sleep_;             /**< The sleep of the packets without one */
+  std::chrono::microseconds tick_; /**< The length of one unit of sleep */
+  std::mutex mutex_;               /**< Guards the timer */
+  std::condition_variable changed_; /**< Signaled when a packet is put on it */
+  std::priority_queue<wake, std::vector<wake>, std::greater<wake>> sleeping_; /**< Soonest first */
+  bool stopping_;                  /**< The timer has to end */
+  std::thread timer_;              /**< Completes the packets */
+};
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file dispatcher.cpp
+ *
+ * @brief The source file for the dispatcher class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "dispatcher.h"
+
+#include <algorithm>
+
+/**
+ * @brief Mixes the bits of a value (splitmix64 finalizer)
+ */
+static uint64_t Mix(uint64_t value)
+{
+  value += 0x9e3779b97f4a7c15ULL;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param dispatchPolicy How the entry of every packet is chosen
+ */
+dispatcher::dispatcher(policy dispatchPolicy)
+    : policy_(dispatchPolicy), current_(0), sends_(0), random_(std::random_device{}())
+{
+}
+
+/**
+ * @brief Constructor for key affinity
+ *
+ * @details The packets without the key are sent round robin.
+ *
+ * @param key The extra data key whose value chooses the entry
+ * @param hash Hashes the value of the key. By default the value is taken as a
+ * pointer to an int32_t, like the "id" of the Indexer
+ */
+dispatcher::dispatcher(std::string key, keyHash hash)
+    : policy_(kKeyAffinity), current_(0), sends_(0), random_(std::random_device{}()), key_(key), hash_(hash)
+{
+  if (!hash_)
+    hash_ = [](pipeData::dataPacket value) { return Mix((uint32_t) * (int32_t *)value); };
+}
+
+/**
+ * @brief Adds a row the packets can be sent to
+ *
+ * @param queue The input queue of the first node of the row
+ * @param row The nodes of the row, used to measure its service time
+ */
+void dispatcher::AddEntry(pipeQueue *queue, std::vector<PipeNode *> row)
+{
+  entry add;
+
+  add.queue = queue;
+  add.row = row;
+  add.last_packets.assign(row.size(), 0);
+  add.last_busy_ns.assign(row.size(), 0);
+  add.service_ns = 0;
+  add.sent = 0;
+
+  // The address of the row keeps its place on the ring when others come and go
+  if (!row.empty())
+  {
+    auto id = row.front()->getNodeAddress();
+    add.identity = ((uint64_t)id.x << 42) | ((uint64_t)id.y << 21) | id.z;
+  }
+  else
+  {
+    add.identity = (uint64_t)(uintptr_t)queue;
+  }
+
+  entries_.push_back(add);
+  BuildRing();
+}
+
+/**
+ * @brief Removes a row, e.g. when it is scaled in
+ *
+ * @details Only the keys that were sent to the row move, to the rows that
+ * follow its points on the ring.
+ *
+ * @param queue The input queue of the row
+ *
+ * @return True if the row was found
+ */
+bool dispatcher::RemoveEntry(pipeQueue *queue)
+{
+  for (auto it = entries_.begin(); it != entries_.end(); ++it)
+  {
+    if (it->queue == queue)
+    {
+      entries_.erase(it);
+      current_ = 0;
+      BuildRing();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Places kRingPoints points of every entry on the hash ring
+ */
+void dispatcher::BuildRing()
+{
+  ring_.clear();
+  for (unsigned int e = 0; e < entries_.size(); ++e)
+  {
+    for (unsigned int p = 0; p < kRingPoints; ++p)
+      ring_.push_back({Mix(Mix(entries_[e].identity) + p), e});
+  }
+  std::sort(ring_.begin(), ring_.end());
+}
+
+/**
+ * @brief Gets the packets sent to an entry
+ *
+ * @param index The position of the entry
+ *
+ * @return The packets sent
+ */
+uint64_t dispatcher::sent(unsigned int index) const { return entries_.at(index).sent; }
+
+/**
+ * @brief Measures the time every row needs per packet
+ *
+ * @details The service time of a node is its busy time over the packets it
+ * ran since the last refresh, divided by its instances. A row goes as fast as
+ * its slowest node. A node that ran nothing since the last refresh uses its
+ * whole history, so a stalled row is not taken for a fast one.
+ */
+void dispatcher::RefreshWeights()
+{
+  for (auto &e : entries_)
+  {
+    double service = 0;
+
+    for (size_t n = 0; n < e.row.size(); ++n)
+    {
+      auto &stats = e.row[n]->stats();
+      uint64_t packets = stats.packets.load(std::memory_order_relaxed);
+      uint64_t busy = stats.busy_ns.load(std::memory_order_relaxed);
+      uint64_t delta_packets = packets - e.last_packets[n];
+      uint64_t delta_busy = busy - e.last_busy_ns[n];
+      double node_service = 0;
+
+      if (delta_packets > 0)
+        node_service = (double)delta_busy / delta_packets;
+      else if (packets > 0)
+        node_service = (double)busy / packets;
+
+      int instances = e.row[n]->number_of_instances();
+      node_service /= (instances > 0 ? instances : 1);
+      if (node_service > service)
+        service = node_service;
+
+      e.last_packets[n] = packets;
+      e.last_busy_ns[n] = busy;
+    }
+
+    if (service > 0)
+      e.service_ns = service;
+  }
+}
+
+/**
+ * @brief Chooses the entry of the next packet
+ *
+ * @details The scans start at the round robin position, which moves on every
+ * send, so the ties are spread among the entries.
+ *
+ * @param data The packet
+ *
+ * @return The position of the entry
+ */
+unsigned int dispatcher::Pick(pipeData::dataPacket data)
+{
+  unsigned int n = entries_.size();
+  unsigned int start = current_;
+  unsigned int best = start;
+
+  current_ = (current_ + 1) % n;
+
+  switch (policy_)
+  {
+  case kLeastLoaded:
+    for (unsigned int i = 1; i < n; ++i)
+    {
+      unsigned int idx = (start + i) % n;
+      if (entries_[idx].queue->queue_count() < entries_[best].queue->queue_count())
+        best = idx;
+    }
+    break;
+
+  case kPowerOfTwo:
+    if (n > 1)
+    {
+      unsigned int a = random_() % n;
+      unsigned int b = random_() % (n - 1);
+      if (b >= a)
+        ++b;
+      best = entries_[b].queue->queue_count() < entries_[a].queue->queue_count() ? b : a;
+    }
+    break;
+
+  case kWeighted:
+  {
+    if (sends_ % kRefreshInterval == 0)
+      RefreshWeights();
+
+    // Rows not measured yet are taken as average ones
+    double known = 0;
+    unsigned int measured = 0;
+    for (auto &e : entries_)
+    {
+      if (e.service_ns > 0)
+      {
+        known += e.service_ns;
+        ++measured;
+      }
+    }
+    double average = measured ? known / measured : 1;
+
+    double best_cost = 0;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      unsigned int idx = (start + i) % n;
+      auto &e = entries_[idx];
+      double cost = (e.queue->queue_count() + 1) * (e.service_ns > 0 ? e.service_ns : average);
+      if (i == 0 || cost < best_cost)
+      {
+        best = idx;
+        best_cost = cost;
+      }
+    }
+    break;
+  }
+
+  case kKeyAffinity:
+  {
+    auto value = ((pipeData *)data)->GetExtraData(key_);
+    if (value == nullptr)
+      break;
+
+    // The first point clockwise from the hash owns the key
+    auto point = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(hash_(value), 0u));
+    best = (point == ring_.end() ? ring_.front() : *point).second;
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  return best;
+}
+
+/**
+ * @brief Sends a packet to the entry chosen by the policy
+ *
+ * @details With kTryNext the entries are tried in round robin order without
+ * blocking, and only when all of them are full the caller waits on the first
+ * one tried. The other policies wait on the entry chosen if it is full.
+ * With an admission control the entry chosen is pushed through its full
+ * policy instead of waiting.
+ *
+ * @param data The packet
+ * @param admission The admission control of the entry, nullptr for none
+ *
+ * @return True if the packet was pushed, false if the admission rejected it
+ */
+bool dispatcher::Send(pipeData::dataPacket data, pipeAdmission *admission)
+{
+  unsigned int n = entries_.size();
+
+  if (n == 0)
+    throw std::out_of_range("dispatcher without entries");
+
+  ++sends_;
+
+  int priority = ((pipeData *)data)->priority();
+  auto push = [&](entry &e) {
+    if (admission != nullptr && !admission->Push(e.queue, (pipeData *)data))
+      return false;
+    if (admission == nullptr)
+      e.queue->Push(data, priority);
+    ++e.sent;
+    return true;
+  };
+
+  if (policy_ == kTryNext)
+  {
+    unsigned int start = current_;
+    current_ = (current_ + 1) % n;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      auto &e = entries_[(start + i) % n];
+      if (admission != nullptr ? admission->TryPush(e.queue, (pipeData *)data) : e.queue->TryPush(data, priority))
+      {
+        ++e.sent;
+        return true;
+      }
+    }
+    return push(entries_[start]);
+  }
+
+  return push(entries_[Pick(data)]);
+}
@@ -0,0 +1,134 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file dispatcher.h
+ *
+ * @brief The header file for the dispatcher class
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include "pipe_node.h"
+#include "pipeAdmission.h"
+#include "pipeQueue.h"
+#include "pipeData.h"
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @class dispatcher
+ *
+ * @brief Chooses the entry queue of a Mesh row or a Cube column for every
+ * packet sent by a distributer
+ *
+ * @details Every entry is the input queue of the first node of a row together
+ * with all the nodes of the row, so the load aware policies can look at the
+ * queue depth and at the service time measured by the nodes.
+ *
+ * With kKeyAffinity the packets carrying the same value of an extra data key
+ * always go to the same entry, so a stateful unit sees all the packets of a
+ * key. The entries are placed on a consistent hash ring by the address of
+ * their first node, so adding or removing an entry only moves the keys of the
+ * arcs it takes or gives back.
+ */
+class dispatcher
+{
+public:
+  /**
+   * @enum policy
+   * @brief How the entry of a packet is chosen
+   */
+  enum policy
+  {
+    kRoundRobin,  /**< One entry after the other, blocking on a full one */
+    kLeastLoaded, /**< The entry with the fewest packets queued */
+    kPowerOfTwo,  /**< The less loaded of two entries taken at random */
+    kWeighted,    /**< The lowest queued packets times measured service time */
+    kTryNext,     /**< Round robin skipping full entries without blocking */
+    kKeyAffinity  /**< The entry owning the hash of an extra data value */
+  };
+
+  // Hashes the extra data value of the affinity key
+  using keyHash = std::function<uint64_t(pipeData::dataPacket)>;
+
+  // Constructor
+  dispatcher(policy = kRoundRobin);
+
+  // Constructor for kKeyAffinity. The value is an int32_t unless a hash is given
+  dispatcher(std::string, keyHash = nullptr);
+
+  // Adds an entry: its input queue and the nodes of its row
+  void AddEntry(pipeQueue *, std::vector<PipeNode *>);
+
+  // Removes the entry with the given input queue
+  bool RemoveEntry(pipeQueue *);
+
+  // Sends a packet to the entry chosen by the policy, through the admission if given
+  bool Send(pipeData::dataPacket, pipeAdmission * = nullptr);
+
+  // Getter. Returns the policy
+  policy dispatch_policy() const { return policy_; };
+
+  // Getter. Returns the number of entries
+  unsigned int entries() const { return entries_.size(); };
+
+  // Getter. Returns the packets sent to an entry
+  uint64_t sent(unsigned int) const;
+
+private:
+  /**
+   * @brief A Mesh row or a Cube column the packets can be sent to
+   */
+  struct entry
+  {
+    pipeQueue *queue;                     /**< The input queue of the row */
+    std::vector<PipeNode *> row;          /**< The nodes of the row */
+    std::vector<uint64_t> last_packets;   /**< Packets of every node at the last refresh */
+    std::vector<uint64_t> last_busy_ns;   /**< Busy time of every node at the last refresh */
+    double service_ns;                    /**< Time the row needs per packet, 0 if unknown */
+    uint64_t sent;                        /**< Packets sent to the entry */
+    uint64_t identity;                    /**< Places the entry on the hash ring */
+  };
+
+  unsigned int Pick(pipeData::dataPacket);
+  void RefreshWeights();
+  void BuildRing();
+
+  static const unsigned int kRefreshInterval = 64; /**< Sends between weight refreshes */
+  static const unsigned int kRingPoints = 64;      /**< Points of every entry on the ring */
+
+  policy policy_;               /**< The dispatch policy */
+  std::vector<entry> entries_;  /**< The rows the packets go to */
+  unsigned int current_;        /**< Next entry for round robin and ties */
+  uint64_t sends_;              /**< Packets sent so far */
+  std::minstd_rand random_;     /**< The source of the random choices */
+  std::string key_;             /**< The extra data key of kKeyAffinity */
+  keyHash hash_;                /**< Hashes the value of the key */
+  std::vector<std::pair<uint64_t, unsigned int>> ring_; /**< Sorted points and their entries */
+};
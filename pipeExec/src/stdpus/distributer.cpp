@@ -1,26 +1,56 @@
 #include "distributer.h"
 
-distributer::distributer(Mesh *mesh, pipeQueue *queue, const std::vector<unsigned int>pipeLocs) {
+distributer::distributer(Mesh *mesh, pipeQueue *queue, const std::vector<unsigned int>pipeLocs,
+                         dispatcher::policy dispatchPolicy) : dispatcher_(dispatchPolicy), mesh_(mesh) {
 
-    unsigned int i = 0;
-    unsigned int x;
+    addPipes(pipeLocs);
+    in_data_queue(queue);
+}
 
-    PipeNode *node;
+distributer::distributer(Mesh *mesh, pipeQueue *queue, const std::vector<unsigned int>pipeLocs,
+                         std::string affinityKey, dispatcher::keyHash hash) : dispatcher_(affinityKey, hash), mesh_(mesh) {
+
+    addPipes(pipeLocs);
+    in_data_queue(queue);
+}
+
+void distributer::addPipes(const std::vector<unsigned int> &pipeLocs) {
+
+    unsigned int i = 0;
 
     while (i < pipeLocs.size()) {
-        x = pipeLocs.at(i);
-        node = (PipeNode*)mesh->twoDimPipe->getPipeNode(pipeMapper::nodeId(x,0,0));
-        meshPipes_.push_back(node->in_data_queue());
+        addPipe(pipeLocs.at(i));
         ++i;
     }
+}
 
-    in_data_queue(queue);
-    current_pipe_ = 0;
+void distributer::addPipe(unsigned int x) {
+
+    PipeNode *node = (PipeNode*)mesh_->twoDimPipe->getPipeNode(pipeMapper::nodeId(x,0,0));
+
+    // The whole row, so the dispatcher can measure it
+    std::vector<PipeNode*> row;
+    for (unsigned int y = 0; mesh_->twoDimPipe->nodeExists(pipeMapper::nodeId(x,y,0)); ++y) {
+        row.push_back((PipeNode*)mesh_->twoDimPipe->getPipeNode(pipeMapper::nodeId(x,y,0)));
+    }
+
+    for (auto rowNode : row) {
+        admission_.Watch(rowNode->in_data_queue());
+    }
+    dispatcher_.AddEntry(node->in_data_queue(), row);
 }
 
-void distributer::send(pipeData::dataPacket data) {
+bool distributer::removePipe(unsigned int x) {
+
+    PipeNode *node = (PipeNode*)mesh_->twoDimPipe->getPipeNode(pipeMapper::nodeId(x,0,0));
 
-        auto queue = meshPipes_.at(current_pipe_);
-        queue->Push(data);
-        current_pipe_ = (++current_pipe_ % meshPipes_.size());
-}
\ No newline at end of file
+    for (unsigned int y = 0; mesh_->twoDimPipe->nodeExists(pipeMapper::nodeId(x,y,0)); ++y) {
+        admission_.Unwatch(((PipeNode*)mesh_->twoDimPipe->getPipeNode(pipeMapper::nodeId(x,y,0)))->in_data_queue());
+    }
+    return dispatcher_.RemoveEntry(node->in_data_queue());
+}
+
+bool distributer::send(pipeData::dataPacket data) {
+
+    return admission_.Gate() && dispatcher_.Send(data, &admission_);
+}
@@ -2,6 +2,7 @@
 #include "pipeQueue.h"
 #include "mesh.h"
 #include "pipeData.h"
+#include "dispatcher.h"
 
 #pragma once
 
@@ -9,14 +10,32 @@ class distributer {
 
 public:
 
-    distributer(Mesh *mesh, pipeQueue *queue,  const std::vector<unsigned int>pipesLocations);
+    distributer(Mesh *mesh, pipeQueue *queue,  const std::vector<unsigned int>pipesLocations,
+                dispatcher::policy dispatchPolicy = dispatcher::kRoundRobin);
+
+    // Sends the packets with the same value of the key to the same row
+    distributer(Mesh *mesh, pipeQueue *queue,  const std::vector<unsigned int>pipesLocations,
+                std::string affinityKey, dispatcher::keyHash hash = nullptr);
 
     pipeQueue *in_data_queue() const { return in_queue_; };
     void in_data_queue(pipeQueue *queue) { in_queue_ = queue; };
-    void send(pipeData::dataPacket data);
+    // Sends a packet through the admission control. False if it was shed
+    bool send(pipeData::dataPacket data);
+
+    // The admission control of the rows, the early drop looks at their nodes
+    pipeAdmission &admission() { return admission_; };
+
+    // Adds or removes a row. Call them from the thread that sends
+    void addPipe(unsigned int pipeLocation);
+    bool removePipe(unsigned int pipeLocation);
+
+    const dispatcher &dispatch() const { return dispatcher_; };
 
 private:
-    std::vector<pipeQueue*> meshPipes_;
-    unsigned int current_pipe_;
+    void addPipes(const std::vector<unsigned int> &pipeLocs);
+
+    dispatcher dispatcher_;
+    pipeAdmission admission_;
+    Mesh *mesh_;
     pipeQueue *in_queue_;
-};
\ No newline at end of file
+};
@@ -11,36 +11,94 @@
  * @param cube pointer to the Cube object
  * @param queue pointer to the pipeQueue object
  * @param pipeLocs vector of inputMesh objects containing the locations of the pipes
+ * @param dispatchPolicy how the column of every packet is chosen
  * 
  */
-distributerCube::distributerCube(Cube *cube, pipeQueue *queue, const std::vector<inputMesh>& pipeLocs) {
+distributerCube::distributerCube(Cube *cube, pipeQueue *queue, const std::vector<inputMesh>& pipeLocs,
+                                 dispatcher::policy dispatchPolicy) : dispatcher_(dispatchPolicy), cube_(cube) {
 
+    for (const auto& l : pipeLocs) {
+        addPipe(l);
+    }
+
+    in_data_queue(queue);
+}
+
+/**
+ * @brief Construct a new distributer Cube object with key affinity
+ * 
+ * The packets carrying the same value of the extra data key always go to the
+ * same column, so the stateful units of a column see all the packets of a key.
+ * The packets without the key are sent round robin.
+ * 
+ * @param cube pointer to the Cube object
+ * @param queue pointer to the pipeQueue object
+ * @param pipeLocs vector of inputMesh objects containing the locations of the pipes
+ * @param affinityKey the extra data key whose value chooses the column
+ * @param hash hashes the value of the key, by default it is taken as an int32_t
+ * 
+ */
+distributerCube::distributerCube(Cube *cube, pipeQueue *queue, const std::vector<inputMesh>& pipeLocs,
+                                 std::string affinityKey, dispatcher::keyHash hash)
+    : dispatcher_(affinityKey, hash), cube_(cube) {
 
     for (const auto& l : pipeLocs) {
-        PipeNode* node = (PipeNode*) cube->threeDimPipe->getPipeNode(pipeMapper::nodeId(l.x, l.y, 0));
-//        if (node != nullptr) {
-            cubePipes_.push_back(node->in_data_queue());
-//        }
+        addPipe(l);
     }
 
-//    if (queue != nullptr) {
-        in_data_queue(queue);
-//    }
-    current_pipe_ = 0;
+    in_data_queue(queue);
 }
 
 /**
- * @brief Sends a data packet to the next pipe in the distribution cube.
+ * @brief Adds a column to the ones the packets are sent to
  * 
- * This function sends the provided data packet to the next pipe in the distribution cube.
- * The current pipe is determined by the 'current_pipe_' variable, which is incremented
- * after each send operation. If the 'current_pipe_' reaches the end of the 'cubePipes_'
- * vector, it wraps around to the beginning.
+ * With key affinity only the keys of the ring arcs taken by the new column
+ * move. It has to be called from the thread that sends the packets.
+ * 
+ * @param l the location of the first node of the column
+ */
+void distributerCube::addPipe(const inputMesh& l) {
+    PipeNode* node = (PipeNode*) cube_->threeDimPipe->getPipeNode(pipeMapper::nodeId(l.x, l.y, 0));
+
+    std::vector<PipeNode*> column;
+    for (unsigned int z = 0; cube_->threeDimPipe->nodeExists(pipeMapper::nodeId(l.x, l.y, z)); ++z) {
+        column.push_back((PipeNode*) cube_->threeDimPipe->getPipeNode(pipeMapper::nodeId(l.x, l.y, z)));
+    }
+    for (auto columnNode : column) {
+        admission_.Watch(columnNode->in_data_queue());
+    }
+    dispatcher_.AddEntry(node->in_data_queue(), column);
+}
+
+/**
+ * @brief Stops sending packets to a column
+ * 
+ * @param l the location of the first node of the column
+ * 
+ * @return true if the column was being used
+ */
+bool distributerCube::removePipe(const inputMesh& l) {
+    PipeNode* node = (PipeNode*) cube_->threeDimPipe->getPipeNode(pipeMapper::nodeId(l.x, l.y, 0));
+
+    for (unsigned int z = 0; cube_->threeDimPipe->nodeExists(pipeMapper::nodeId(l.x, l.y, z)); ++z) {
+        admission_.Unwatch(((PipeNode*) cube_->threeDimPipe->getPipeNode(pipeMapper::nodeId(l.x, l.y, z)))->in_data_queue());
+    }
+    return dispatcher_.RemoveEntry(node->in_data_queue());
+}
+
+/**
+ * @brief Sends a data packet to a pipe of the distribution cube.
+ * 
+ * This function sends the provided data packet to the pipe chosen by the
+ * dispatch policy given at construction. The default policy is round robin.
+ * The packet goes through the admission control first, which by default
+ * lets everything in and waits when the column is full.
  * 
  * @param data The data packet to be sent.
+ * 
+ * @return true if the packet was pushed, false if it was shed and is still
+ * the caller's
  */
-void distributerCube::send(pipeData::dataPacket data) {
-    auto& queue = cubePipes_.at(current_pipe_);
-    queue->Push(data);
-    current_pipe_ = (current_pipe_ + 1) % cubePipes_.size();
+bool distributerCube::send(pipeData::dataPacket data) {
+    return admission_.Gate() && dispatcher_.Send(data, &admission_);
 }
@@ -2,6 +2,7 @@
 #include "pipeQueue.h"
 #include "cube.h"
 #include "pipeData.h"
+#include "dispatcher.h"
 #include <iostream>
 
 #pragma once
@@ -15,7 +16,11 @@ public:
         unsigned int y;
     } ;
 
-    distributerCube(Cube *cube, pipeQueue *queue,  const std::vector<inputMesh>& pipesLocations);
+    distributerCube(Cube *cube, pipeQueue *queue,  const std::vector<inputMesh>& pipesLocations,
+                    dispatcher::policy dispatchPolicy = dispatcher::kRoundRobin);
+
+    distributerCube(Cube *cube, pipeQueue *queue,  const std::vector<inputMesh>& pipesLocations,
+                    std::string affinityKey, dispatcher::keyHash hash = nullptr);
 
     /**
      * @brief Getter function that returns the value of the in_queue_ member variable.
@@ -33,10 +38,32 @@ public:
     void in_data_queue(pipeQueue* queue) {
         in_queue_ = queue;
     }
-    void send(pipeData::dataPacket data);
+    bool send(pipeData::dataPacket data);
+
+    void addPipe(const inputMesh& pipeLocation);
+    bool removePipe(const inputMesh& pipeLocation);
+
+    /**
+     * @brief Getter function that returns the dispatcher of the packets.
+     *
+     * @return The dispatcher, with the packets sent to every column.
+     */
+    const dispatcher &dispatch() const {
+        return dispatcher_;
+    }
+
+    /**
+     * @brief Getter function that returns the admission control of the columns.
+     *
+     * @return The admission control. Its early drop looks at every node of the columns.
+     */
+    pipeAdmission &admission() {
+        return admission_;
+    }
 
 private:
-    std::vector<pipeQueue*> cubePipes_;
-    unsigned int current_pipe_;
+    dispatcher dispatcher_;
+    pipeAdmission admission_;
+    Cube *cube_;
     pipeQueue *in_queue_;
 };
\ No newline at end of file
@@ -47,7 +47,6 @@ void Drano::Run(pipeData::dataPacket data)
 //  auto maxSize = outQueue->max_size();
   auto cmd = PipeNode::nodeCmd::NO_OP;
 
- std::cout << " node id = " << node->node_id() <<" IN = " << inCount;
 
   if ( inCount ) cmd = PipeNode::nodeCmd::ADD_THR;
 /*  else if ( adaptable_ ) {
@@ -56,7 +55,7 @@ void Drano::Run(pipeData::dataPacket data)
 
   if ( cmd != PipeNode::nodeCmd::NO_OP ) node->setCmd(cmd);
 
-  std::cout << " cmd = " << cmd << std::endl;
+  PIPE_DEBUG("node id = %d IN = %d cmd = %d", node->node_id(), inCount, cmd);
 
   lastCount_ = inCount;
 }
@@ -58,7 +58,7 @@ void Indexer::Run(void *data) {
   pipeData *handler = (pipeData *)data;
   int32_t *id = (int32_t *)handler->GetExtraData("id");
   if (id == nullptr) {
-    fprintf(stderr, "(Indexer) The pipeData has no identifier");
+    PIPE_ERROR("(Indexer) The pipeData has no identifier");
     return;
   }
   TableIndexer *index = FindTableEntry(*id);
@@ -67,15 +67,12 @@ void Indexer::Run(void *data) {
     index->count++;
   } else {
     // The data is not indexed
-    // Allocates the memory for the new block
-    index = (TableIndexer *)malloc(sizeof(TableIndexer));
-    // Reallocates the array
-    lookup_table_ = (TableIndexer *)realloc(lookup_table_, table_size_ + 1);
-    // Assigns the new data to the index
+    // Reallocates the array with room for the new entry
+    lookup_table_ = (TableIndexer *)realloc(lookup_table_, (table_size_ + 1) * sizeof(TableIndexer));
+    // The new entry is the last position of the array
+    index = &lookup_table_[table_size_];
     index->id = *id;
     index->count = 0;
-    // Sets the index in the last position of the array
-    lookup_table_[table_size_] = *index;
     // Adds one to the array size
     table_size_++;
   }
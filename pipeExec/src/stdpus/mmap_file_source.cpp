@@ -0,0 +1,184 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file mmap_file_source.cpp
+ *
+ * @brief The source file for the MmapFileSource processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "mmap_file_source.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param recordFraming How the records are found in the files
+ * @param recordSize The size of every record with kFixedSize
+ * @param lengthKey The extra data key of the length of a record, a uint64_t
+ *
+ * @throws std::invalid_argument if kFixedSize is given a size of 0
+ */
+MmapFileSource::MmapFileSource(framing recordFraming, size_t recordSize, std::string lengthKey)
+    : framing_(recordFraming), record_size_(recordSize), length_key_(lengthKey), files_(0), records_(0), failed_(0),
+      truncated_(0) {
+  if (framing_ == kFixedSize && record_size_ == 0) {
+    throw std::invalid_argument("Fixed size records need a size.");
+  }
+}
+
+MmapFileSource::~MmapFileSource() {}
+
+/**
+ * @brief Drops a reference to a mapping, unmapping it with the last one
+ *
+ * @param map The mapping
+ */
+void MmapFileSource::Unref(mapping *map) {
+  if (map->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    munmap(map->base, map->size);
+    delete map;
+  }
+}
+
+/**
+ * @brief The release hook of the record packets
+ *
+ * @param data The packet released
+ * @param map The mapping it points into
+ */
+void MmapFileSource::ReleaseRecord(pipeData *data, void *map) {
+  delete data;
+  Unref((mapping *)map);
+}
+
+/**
+ * @brief Emits a packet for a record
+ *
+ * @param from The file packet, whose node and priority the record takes
+ * @param map The mapping of the file
+ * @param record The first byte of the record
+ * @param length The bytes of the record
+ */
+void MmapFileSource::EmitRecord(pipeData *from, mapping *map, const char *record, uint64_t length) {
+  // Only the unit adds lengths, the packets read them
+  map->lengths.push_back(length);
+  map->references.fetch_add(1, std::memory_order_relaxed);
+
+  auto data = new pipeData((void *)record);
+  data->setDataKey(length_key_, &map->lengths.back());
+  data->priority(from->priority());
+  data->setNodeData(from->getNodeData());
+  data->release_hook(ReleaseRecord, map);
+
+  records_.fetch_add(1, std::memory_order_relaxed);
+  Emit(data);
+}
+
+/**
+ * @brief Maps the file and emits a packet for every record
+ *
+ * @param data The packet carrying the path of the file
+ */
+void MmapFileSource::Run(void *data) {
+  auto pData = (pipeData *)data;
+
+  Hold(data);
+
+  int fd = open((const char *)pData->data(), O_RDONLY);
+  struct stat status;
+  void *base = MAP_FAILED;
+  if (fd >= 0 && fstat(fd, &status) == 0 && status.st_size > 0) {
+    base = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (base == MAP_FAILED) {
+    failed_.fetch_add(1, std::memory_order_relaxed);
+    pData->Release();
+    return;
+  }
+
+  madvise(base, status.st_size, MADV_SEQUENTIAL);
+  files_.fetch_add(1, std::memory_order_relaxed);
+
+  // The unit keeps the mapping until every record is emitted
+  auto map = new mapping{(char *)base, (size_t)status.st_size, {1}, {}};
+  const char *at = map->base;
+  const char *end = map->base + map->size;
+
+  while (at < end) {
+    uint64_t left = end - at;
+
+    if (framing_ == kNewline) {
+      auto newline = (const char *)memchr(at, '\n', left);
+      uint64_t length = newline != nullptr ? newline - at : left;
+      if (newline == nullptr) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+      }
+      EmitRecord(pData, map, at, length);
+      at += length + 1;
+    } else if (framing_ == kFixedSize) {
+      if (left < record_size_) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+      EmitRecord(pData, map, at, record_size_);
+      at += record_size_;
+    } else {
+      uint32_t length;
+      if (left < sizeof(length)) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+      memcpy(&length, at, sizeof(length));
+      if (left - sizeof(length) < length) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+      EmitRecord(pData, map, at + sizeof(length), length);
+      at += sizeof(length) + length;
+    }
+  }
+
+  Unref(map);
+  pData->Release();
+}
+
+/**
+ * @brief Clones the unit with the same framing
+ *
+ * @return The new instance
+ */
+ProcessingUnitInterface *MmapFileSource::Clone() {
+  return new MmapFileSource(framing_, record_size_, length_key_);
+}
@@ -0,0 +1,116 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file mmap_file_source.h
+ *
+ * @brief The header file for the MmapFileSource processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#ifndef MMAP_FILE_SOURCE_H
+#define MMAP_FILE_SOURCE_H
+
+#include "pipeExec.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/**
+ * @class MmapFileSource
+ *
+ * @brief Slices the files it is given into records without copying them
+ *
+ * @details Every packet it runs carries the path of a file as a C string.
+ * The file is mapped and read ahead sequentially, and a packet is emitted
+ * for every record, its payload pointing at the first byte of the record in
+ * the mapping and its length under an extra data key. The file packet is
+ * released. The mapping stays until the last record packet is released, so
+ * the records have to be released, not deleted.
+ *
+ * The records are split at every newline, which is not part of them, or have
+ * a fixed size, or start with a uint32_t in host order giving the bytes that
+ * follow. A last record left short is emitted with newlines, and counted in
+ * truncated() and dropped with the other framings.
+ */
+class MmapFileSource : public ProcessingUnitInterface {
+ public:
+  /**
+   * @enum framing
+   * @brief How the records are found in the file
+   */
+  enum framing {
+    kNewline,       /**< Split at every '\n' */
+    kFixedSize,     /**< Every record has the same size */
+    kLengthPrefixed /**< A uint32_t length goes before every record */
+  };
+
+  // Constructor. The record size is only used by kFixedSize
+  MmapFileSource(framing = kNewline, size_t = 0, std::string = "length");
+
+  ~MmapFileSource();
+
+  // Emits the records of the file
+  void Run(void *) override;
+
+  ProcessingUnitInterface *Clone() override;
+
+  // Getter. Returns the files mapped
+  uint64_t files() const { return files_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the records emitted
+  uint64_t records() const { return records_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the files that could not be mapped
+  uint64_t failed() const { return failed_.load(std::memory_order_relaxed); };
+
+  // Getter. Returns the short records at the end of the files
+  uint64_t truncated() const { return truncated_.load(std::memory_order_relaxed); };
+
+ private:
+  /**
+   * @brief A file mapped, shared by the packets of its records
+   */
+  struct mapping {
+    char *base;                      /**< The first byte of the file */
+    size_t size;                     /**< The bytes of the file */
+    std::atomic<uint64_t> references; /**< The packets, and the unit while emitting */
+    std::deque<uint64_t> lengths;    /**< The lengths the packets point to */
+  };
+
+  static void Unref(mapping *);
+  static void ReleaseRecord(pipeData *, void *);
+  void EmitRecord(pipeData *, mapping *, const char *, uint64_t);
+
+  framing framing_;         /**< How the records are found */
+  size_t record_size_;      /**< The size of the records for kFixedSize */
+  std::string length_key_;  /**< The key of the record length */
+  std::atomic<uint64_t> files_;     /**< Files mapped */
+  std::atomic<uint64_t> records_;   /**< Records emitted */
+  std::atomic<uint64_t> failed_;    /**< Files not mapped */
+  std::atomic<uint64_t> truncated_; /**< Short records at the end */
+};
+
+#endif
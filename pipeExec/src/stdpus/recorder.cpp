@@ -0,0 +1,55 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file recorder.cpp
+ *
+ * @brief The source file for the Recorder processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "recorder.h"
+
+/**
+ * @brief Constructor
+ *
+ * @param recorder Where the packets are recorded
+ */
+Recorder::Recorder(pipeRecorder *recorder) : recorder_(recorder) {}
+
+Recorder::~Recorder() {}
+
+/**
+ * @brief Records the packet, which then goes on to the next node
+ *
+ * @param data The packet
+ */
+void Recorder::Run(void *data) { recorder_->Record((pipeData *)data); }
+
+/**
+ * @brief Clones the unit, sharing the recorder
+ *
+ * @return The new instance
+ */
+ProcessingUnitInterface *Recorder::Clone() { return new Recorder(recorder_); }
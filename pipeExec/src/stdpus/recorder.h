@@ -0,0 +1,66 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file recorder.h
+ *
+ * @brief The header file for the Recorder processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "pipeExec.h"
+#include "pipeRecord.h"
+
+/**
+ * @class Recorder
+ *
+ * @brief Records every packet that goes through it and passes it on
+ *
+ * @details Placed as the first node it records the traffic entering the
+ * topology, to be played back later with pipeReplay. With several instances
+ * the packets are recorded in the order they run, not the order they were
+ * pushed in; record before pushing when that matters.
+ *
+ * All the instances share the recorder, which has to outlive the topology.
+ */
+class Recorder : public ProcessingUnitInterface {
+ public:
+  // Constructor
+  Recorder(pipeRecorder *);
+
+  ~Recorder();
+
+  // Records the packet
+  void Run(void *) override;
+
+  ProcessingUnitInterface *Clone() override;
+
+ private:
+  pipeRecorder *recorder_; /**< Where the packets are recorded */
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file remote_node.cpp
+ *
+ * @brief The source file for the RemoteNode processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "remote_node.h"
+
+/**
+ * @brief Constructor
+ *
+ * @param link The link to the process running the rest of the topology
+ */
+RemoteNode::RemoteNode(pipeLink *link) : link_(link) {}
+
+RemoteNode::~RemoteNode() {}
+
+/**
+ * @brief Sends the packet through the link, which releases it
+ *
+ * @param data The packet
+ */
+void RemoteNode::Run(void *data) {
+  auto pData = (pipeData *)data;
+
+  Hold(data);
+  if (link_->Send(pData)) {
+    return;
+  }
+  if (link_->Connect() && link_->Send(pData)) {
+    return;
+  }
+  pData->Release();
+}
+
+/**
+ * @brief Clones the unit, sharing the link
+ *
+ * @return The new instance
+ */
+ProcessingUnitInterface *RemoteNode::Clone() { return new RemoteNode(link_); }
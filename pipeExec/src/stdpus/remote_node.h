@@ -0,0 +1,70 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file remote_node.h
+ *
+ * @brief The header file for the RemoteNode processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#ifndef REMOTE_NODE_H
+#define REMOTE_NODE_H
+
+#include "pipeExec.h"
+#include "pipeLink.h"
+
+/**
+ * @class RemoteNode
+ *
+ * @brief Forwards the packets to the same place of a topology running in
+ * another process
+ *
+ * @details It is added to a pipeMapper address of the local topology, and the
+ * other process listens with a pipeLink on the in queue of the node at that
+ * address. The packets leave through the link and are not routed locally. The
+ * link batches them and waits for credits, so a slow remote node holds the
+ * local one back as a full queue would. When the link is down it is
+ * reconnected once; if that fails the packet is dropped and counted in
+ * refused() of the link.
+ *
+ * All the instances share the link, which has to outlive the topology.
+ */
+class RemoteNode : public ProcessingUnitInterface {
+ public:
+  // Constructor. The link may be connected later
+  RemoteNode(pipeLink *);
+
+  ~RemoteNode();
+
+  // Sends the packet to the remote node
+  void Run(void *) override;
+
+  ProcessingUnitInterface *Clone() override;
+
+ private:
+  pipeLink *link_; /**< The link to the other process */
+};
+
+#endif
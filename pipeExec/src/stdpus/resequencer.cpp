@@ -0,0 +1,227 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file resequencer.cpp
+ *
+ * @brief The source file for the Resequencer processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "resequencer.h"
+
+/**
+ * @brief Constructor
+ *
+ * @param window The most packets that can wait for a gap
+ * @param timeout How long a gap is waited for, 0 to wait until the window is full
+ * @param late What is done with the packets that arrive after their gap was skipped
+ */
+Resequencer::Resequencer(unsigned int window, std::chrono::microseconds timeout, latePolicy late)
+    : window_(window > 0 ? window : 1, nullptr), next_(1), waiting_(0), blocked_since_ns_(0),
+      timeout_(timeout), late_policy_(late), stamped_(0), reordered_(0), skipped_(0), late_(0), high_water_(0) {
+  drop_ = [](pipeData *data) { data->Release(); };
+}
+
+/**
+ * @brief Default destructor: does nothing
+ */
+Resequencer::~Resequencer() {}
+
+/**
+ * @brief Current time of the monotonic clock in ns
+ */
+uint64_t Resequencer::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Stamps the next sequence on a packet entering the topology
+ *
+ * @details It can be called from several threads: the order restored is the
+ * order of the calls.
+ *
+ * @param data The packet
+ */
+void Resequencer::Stamp(pipeData *data) { data->sequence(stamped_.fetch_add(1, std::memory_order_relaxed) + 1); }
+
+/**
+ * @brief Lets the packets through in the order of their sequence
+ *
+ * @details Every packet is held and then emitted, so the node routes the
+ * packets that were waiting behind it in order and after it.
+ *
+ * @param data The packet
+ */
+void Resequencer::Run(void *data) {
+  auto pData = (pipeData *)data;
+  uint64_t sequence = pData->sequence();
+
+  Hold(data);
+
+  // Not stamped, nothing to keep the order of
+  if (sequence == 0) {
+    Emit(data);
+    return;
+  }
+
+  // Its gap was skipped already
+  if (sequence < next_) {
+    Late(pData);
+    return;
+  }
+
+  // No room in the window until the oldest gaps are given up on
+  while (sequence >= next_ + window_.size()) {
+    if (waiting_ == 0) {
+      skipped_.fetch_add(sequence - window_.size() + 1 - next_, std::memory_order_relaxed);
+      next_ = sequence - window_.size() + 1;
+      break;
+    }
+    SkipGap();
+  }
+
+  if (sequence == next_) {
+    Emit(data);
+    ++next_;
+    ReleaseReady();
+  } else if (window_[sequence % window_.size()] != nullptr) {
+    // The sequence is waiting already, e.g. a view of a broadcast upstream
+    Late(pData);
+    return;
+  } else {
+    window_[sequence % window_.size()] = pData;
+    if (waiting_++ == 0) {
+      blocked_since_ns_ = NowNs();
+    }
+    reordered_.fetch_add(1, std::memory_order_relaxed);
+    if (waiting_ > high_water_.load(std::memory_order_relaxed)) {
+      high_water_.store(waiting_, std::memory_order_relaxed);
+    }
+  }
+
+  // Give up on the gap if it has been waited for too long
+  if (waiting_ > 0 && timeout_.count() > 0 && NowNs() - blocked_since_ns_ > (uint64_t)timeout_.count()) {
+    SkipGap();
+  }
+}
+
+/**
+ * @brief Passes on or drops a packet whose sequence has been seen already
+ *
+ * @param data The packet, held
+ */
+void Resequencer::Late(pipeData *data) {
+  late_.fetch_add(1, std::memory_order_relaxed);
+  if (late_policy_ == kPassLate) {
+    Emit(data);
+  } else {
+    drop_(data);
+  }
+}
+
+/**
+ * @brief Gives up on a gap waited for too long while no packet comes
+ *
+ * @details Without it an expired gap is only skipped when the next packet
+ * arrives. It needs the housekeeping of the node to be set.
+ */
+void Resequencer::Tick() {
+  if (waiting_ > 0 && timeout_.count() > 0 && NowNs() - blocked_since_ns_ > (uint64_t)timeout_.count()) {
+    SkipGap();
+  }
+}
+
+/**
+ * @brief Emits the packets that follow the last one let through
+ */
+void Resequencer::ReleaseReady() {
+  bool advanced = false;
+
+  while (waiting_ > 0) {
+    auto &place = window_[next_ % window_.size()];
+    if (place == nullptr) {
+      break;
+    }
+    Emit(place);
+    place = nullptr;
+    --waiting_;
+    ++next_;
+    advanced = true;
+  }
+
+  // A new gap starts to be waited for
+  if (advanced && waiting_ > 0) {
+    blocked_since_ns_ = NowNs();
+  }
+}
+
+/**
+ * @brief Gives up on the missing sequences before the first packet waiting
+ */
+void Resequencer::SkipGap() {
+  while (window_[next_ % window_.size()] == nullptr) {
+    skipped_.fetch_add(1, std::memory_order_relaxed);
+    ++next_;
+  }
+  ReleaseReady();
+}
+
+/**
+ * @brief The window can not be shared, so the unit is not cloned
+ *
+ * @return nullptr
+ */
+ProcessingUnitInterface *Resequencer::Clone() { return nullptr; }
+
+/**
+ * @brief Sets what is done with the dropped packets
+ *
+ * @param dropper Takes the ownership of every packet dropped
+ */
+void Resequencer::drop(std::function<void(pipeData *)> dropper) { drop_ = dropper; }
+
+/**
+ * @brief Getter. Packets that arrived early and had to wait
+ */
+uint64_t Resequencer::reordered() const { return reordered_.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Getter. Sequences given up on when a gap was skipped
+ */
+uint64_t Resequencer::skipped() const { return skipped_.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Getter. Packets that arrived after their gap was skipped, or that
+ * repeated a sequence already waiting
+ */
+uint64_t Resequencer::late() const { return late_.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Getter. Highest number of packets waiting at once
+ */
+unsigned int Resequencer::high_water() const { return high_water_.load(std::memory_order_relaxed); }
+
+/* vim:set softtabstop=2 shiftwidth=2 tabstop=2 expandtab: */
@@ -0,0 +1,119 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+/**
+ * @file resequencer.h
+ *
+ * @brief The header file for the Resequencer processing unit.
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#ifndef RESEQUENCER_H
+#define RESEQUENCER_H
+
+#include "pipeExec.h"
+#include <chrono>
+#include <functional>
+#include <vector>
+
+/**
+ * @class Resequencer
+ *
+ * @brief Restores the order the packets had when they entered the topology
+ *
+ * @details The packets are stamped with Stamp() where they enter. The
+ * Resequencer goes after the nodes that run with several instances and lets
+ * the packets through in the order of their sequence, keeping the ones that
+ * arrive early in a window of a fixed size. When the window is full, or when
+ * a missing packet has been waited for longer than the timeout, the gap is
+ * skipped. The packets of a skipped gap that arrive later are passed on or
+ * dropped, and so are the ones repeating a sequence already waiting, e.g.
+ * views of a broadcast. Packets without a sequence go straight through.
+ *
+ * It has to run with a single instance: it is the point where the order is
+ * restored, so the window needs no lock. Do not clone it.
+ */
+class Resequencer : public ProcessingUnitInterface {
+ public:
+  /**
+   * @enum latePolicy
+   * @brief What is done with a packet whose gap was already skipped
+   */
+  enum latePolicy {
+    kPassLate, /**< It is sent on out of order */
+    kDropLate  /**< It is handed to the drop function */
+  };
+
+  // Constructor. A timeout of 0 waits for the gaps until the window is full
+  Resequencer(unsigned int = 1024, std::chrono::microseconds = std::chrono::microseconds(0),
+              latePolicy = kPassLate);
+
+  ~Resequencer();
+
+  // Stamps the next sequence on a packet entering the topology
+  void Stamp(pipeData *);
+
+  void Run(void *) override;
+
+  // Skips the gap waited for longer than the timeout while no packet comes
+  void Tick() override;
+
+  ProcessingUnitInterface *Clone() override;
+
+  // Sets what is done with the dropped packets. They are released by default
+  void drop(std::function<void(pipeData *)>);
+
+  // Getter. Packets that arrived early and had to wait
+  uint64_t reordered() const;
+
+  // Getter. Sequences given up on when a gap was skipped
+  uint64_t skipped() const;
+
+  // Getter. Packets that arrived after their gap was skipped or repeated one
+  uint64_t late() const;
+
+  // Getter. Highest number of packets waiting at once
+  unsigned int high_water() const;
+
+ private:
+  void Late(pipeData *);
+  void ReleaseReady();
+  void SkipGap();
+  static uint64_t NowNs();
+
+  std::vector<pipeData *> window_;      /**< The packets waiting, by sequence */
+  uint64_t next_;                       /**< The sequence to let through next */
+  unsigned int waiting_;                /**< The packets in the window */
+  uint64_t blocked_since_ns_;           /**< When the next sequence started to be waited for */
+  std::chrono::nanoseconds timeout_;    /**< Longest wait for a gap, 0 for none */
+  latePolicy late_policy_;              /**< What is done with the late packets */
+  std::function<void(pipeData *)> drop_; /**< Takes the dropped packets */
+  std::atomic<uint64_t> stamped_;       /**< The last sequence stamped */
+  std::atomic<uint64_t> reordered_;     /**< Packets that had to wait */
+  std::atomic<uint64_t> skipped_;       /**< Sequences given up on */
+  std::atomic<uint64_t> late_;          /**< Packets behind a skipped gap or repeated */
+  std::atomic<unsigned int> high_water_; /**< Most packets waiting at once */
+};
+
+#endif  // RESEQUENCER_H
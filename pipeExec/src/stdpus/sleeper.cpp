@@ -6,7 +6,14 @@
 /**
  * @brief Default constructor: does nothing
  */
-Sleeper::Sleeper() { setKey("_#std#sleeper#time#_"); }
+Sleeper::Sleeper() : tick_(std::chrono::seconds(1)) { setKey("_#std#sleeper#time#_"); }
+
+/**
+ * @brief Constructor: the sleep times are counted in ticks instead of seconds
+ *
+ * @param tick The length of one unit of sleep
+ */
+Sleeper::Sleeper(std::chrono::microseconds tick) : tick_(tick) { setKey("_#std#sleeper#time#_"); }
 
 /**
  * @brief Default destructor: does nothing
@@ -45,12 +52,12 @@ void Sleeper::Run(void *sleepTime)
     if (time == nullptr)
     {
 //      std::cout << "from init - sleeping " << seconds_to_sleep_ << "s" << std::endl;
-      std::this_thread::sleep_for(std::chrono::seconds(seconds_to_sleep_));
+      std::this_thread::sleep_for(seconds_to_sleep_ * tick_);
     }
     else
     {
 //      std::cout << "from data - sleeping " << *time << "s" << std::endl;
-      std::this_thread::sleep_for(std::chrono::seconds(*time));
+      std::this_thread::sleep_for(*time * tick_);
     }
   }
   else
@@ -33,6 +33,7 @@
 #define SLEEPER_H
 
 #include "pipeExec.h"
+#include <chrono>
 #include <thread>
 
 /**
@@ -47,6 +48,9 @@ class Sleeper : public ProcessingUnitInterface {
   // Default constructor
   Sleeper();
 
+  // Constructor. The sleep times are counted in ticks of the given length
+  Sleeper(std::chrono::microseconds);
+
   // Default destructor
   ~Sleeper();
 
@@ -75,10 +79,11 @@ class Sleeper : public ProcessingUnitInterface {
   void Run(void *sleepTime) override;
 
   // This function clones the instance of the sleeper procesing unit
-  ProcessingUnitInterface *Clone() override { return new Sleeper(); };
+  ProcessingUnitInterface *Clone() override { return new Sleeper(tick_); };
 
  private:
   int seconds_to_sleep_;
+  std::chrono::microseconds tick_; /**< The length of one unit of sleep */
 };
 
 #endif  // SLEEPER_H
@@ -0,0 +1,64 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test.h
+ *
+ * @brief The checks shared by the pipeExec tests
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#pragma once
+
+#include <cstdio>
+
+// Counts the failed checks of the test program
+inline int &testFailures()
+{
+  static int failures = 0;
+  return failures;
+}
+
+// Prints a failed check and counts it
+inline bool testCheck(bool passed, const char *condition, const char *file, int line)
+{
+  if (!passed)
+  {
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+    ++testFailures();
+  }
+  return passed;
+}
+
+// Prints the result of the test program. Returns its exit code
+inline int testReport(const char *name)
+{
+  fprintf(stderr, "%s: %d failed checks\n", name, testFailures());
+  fflush(stderr);
+  return testFailures() == 0 ? 0 : 1;
+}
+
+// Checks that the condition holds, going on with the test if it does not
+#define CHECK(condition) testCheck((condition), #condition, __FILE__, __LINE__)
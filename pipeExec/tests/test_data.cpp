@@ -0,0 +1,204 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test_data.cpp
+ *
+ * @brief Tests of the pipeData references, views and release hooks
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "mmap_file_source.h"
+#include "pipeDataPool.h"
+#include "pipeShmQueue.h"
+#include "pipeWire.h"
+#include "pipeline.h"
+#include "test.h"
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+/**
+ * @brief Counts the mappings of a file in the process
+ */
+static int Mappings(const std::string &path)
+{
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  int found = 0;
+
+  while (std::getline(maps, line))
+    if (line.find(path) != std::string::npos)
+      ++found;
+  return found;
+}
+
+/**
+ * @brief Shares a packet whose frame is freed by its release hook
+ */
+static void ShareDeserialized(bool viewFirst)
+{
+  pipeWire wire;
+  wire.Pod<long>(1);
+  wire.Pod<double>(2);
+  wire.payload(1);
+  wire.Key("x", 2);
+
+  long value = 42;
+  double x = 0.5;
+  pipeData packet(&value);
+  packet.setDataKey("x", &x);
+  std::string frame;
+  wire.Serialize(&packet, frame);
+
+  auto data = wire.Deserialize(frame.data(), frame.size(), true);
+  auto view = data->Share();
+  auto first = viewFirst ? view : data;
+  auto last = viewFirst ? data : view;
+
+  first->Release();
+  CHECK(*(long *)last->data() == 42);
+  CHECK(*(double *)last->GetExtraData("x") == 0.5);
+  last->Release();
+}
+
+/**
+ * @brief Shares a packet living in the arena of a shared-memory queue
+ */
+static void ShareShm(bool viewFirst)
+{
+  pipeWire wire;
+  wire.Pod<long>(1);
+  wire.payload(1);
+
+  pipeShmQueue::Unlink("pipeExec_test_data");
+  {
+    pipeShmQueue producer("pipeExec_test_data", pipeShmQueue::kProducer, wire, 16, 4096);
+    pipeShmQueue consumer("pipeExec_test_data", pipeShmQueue::kConsumer, wire, 16, 4096);
+    long value = 7;
+
+    CHECK(producer.Push(new pipeData(&value)));
+    auto data = consumer.Pop();
+    auto view = data->Share();
+    auto first = viewFirst ? view : data;
+    auto last = viewFirst ? data : view;
+
+    first->Release();
+    CHECK(*(long *)last->data() == 7);
+
+    // Go round the arena until the block still in use stops the producer
+    long other = 8;
+    bool stopped = false;
+    for (int it = 0; it < 1000 && !stopped; ++it)
+    {
+      auto packet = new pipeData(&other);
+      stopped = !producer.TryPush(packet);
+      if (stopped)
+        delete packet;
+      else
+        consumer.Pop()->Release();
+    }
+    CHECK(stopped);
+    CHECK(*(long *)last->data() == 7);
+
+    last->Release();
+    CHECK(producer.TryPush(new pipeData(&other)));
+    consumer.Pop()->Release();
+  }
+  pipeShmQueue::Unlink("pipeExec_test_data");
+}
+
+/**
+ * @brief Shares the records of a mapped file, which stays mapped until the
+ * last of them is released
+ */
+static void ShareMmap()
+{
+  char path[] = "/tmp/pipeExec_test_data_XXXXXX";
+  int fd = mkstemp(path);
+  std::string lines = "first\nsecond\n";
+  CHECK(fd >= 0 && write(fd, lines.data(), lines.size()) == (ssize_t)lines.size());
+  close(fd);
+
+  auto in = new pipeQueue(4);
+  auto out = new pipeQueue(4);
+  auto source = new MmapFileSource();
+  auto pipe = new Pipeline(source, in, out, 1, nullptr);
+  pipe->RunPipe();
+  in->Push(new pipeData(path));
+
+  // The unit has let the mapping go once it fails the next file
+  in->Push(new pipeData((void *)"/nonexistent/pipeExec_test_data"));
+  while (source->failed() == 0)
+    usleep(1000);
+
+  pipeData *records[2], *views[2];
+  for (int it = 0; it < 2; ++it)
+  {
+    records[it] = (pipeData *)out->Pop();
+    views[it] = records[it]->Share();
+  }
+  CHECK(std::string((char *)views[1]->data(), *(uint64_t *)views[1]->GetExtraData("length")) == "second");
+
+  // The first record goes before its view, the second after it
+  records[0]->Release();
+  views[1]->Release();
+  views[0]->Release();
+  CHECK(Mappings(path) == 1);
+  CHECK(std::string((char *)records[1]->data(), *(uint64_t *)records[1]->GetExtraData("length")) == "second");
+  records[1]->Release();
+  CHECK(Mappings(path) == 0);
+  unlink(path);
+}
+
+/**
+ * @brief Destroys a pool while some of its packets and views are in use
+ */
+static void PoolOutlived()
+{
+  auto pool = new pipeDataPool(4);
+  auto kept = pool->Acquire(nullptr);
+  auto view = kept->Share();
+  pool->Acquire(nullptr)->Release();
+  CHECK(pool->available() == 1);
+
+  delete pool;
+  kept->Release();
+  view->Release();
+}
+
+int main()
+{
+  ShareDeserialized(false);
+  ShareDeserialized(true);
+  ShareShm(false);
+  ShareShm(true);
+  PoolOutlived();
+  ShareMmap();
+
+  // The threads of the pipeline never end
+  _exit(testReport("test_data"));
+}
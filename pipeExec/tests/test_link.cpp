@@ -0,0 +1,135 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test_link.cpp
+ *
+ * @brief Tests of the credits of pipeLink
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeLink.h"
+#include "test.h"
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief The packets of a sender arrive in order
+ */
+static void Order(const pipeWire &wire)
+{
+  const long packets = 10000;
+  pipeQueue queue(16);
+  pipeLink receiver(wire);
+  CHECK(receiver.Listen("tcp:127.0.0.1:0", &queue));
+
+  std::thread sending([&]() {
+    pipeLink sender(wire);
+    CHECK(sender.Connect(receiver.address()));
+    for (long it = 0; it < packets; ++it)
+      sender.Send(new pipeData(&it));
+    sender.Close();
+  });
+
+  long wrong = 0;
+  for (long it = 0; it < packets; ++it)
+  {
+    auto data = (pipeData *)queue.Pop();
+    wrong += *(long *)data->data() != it;
+    data->Release();
+  }
+  sending.join();
+  CHECK(wrong == 0);
+  CHECK(receiver.received() == (uint64_t)packets);
+  receiver.Close();
+}
+
+/**
+ * @brief Two senders share the credits of the queue, and a credit only
+ * comes back when its packet is released
+ */
+static void SharedCredits(const pipeWire &wire)
+{
+  const int size = 8;
+  const int packets = 20;
+  pipeQueue queue(size);
+  pipeLink receiver(wire);
+  std::string address = "unix:/tmp/pipeExec_test_link_" + std::to_string(getpid());
+  CHECK(receiver.Listen(address, &queue));
+
+  long value = 1;
+  pipeLink senders[2] = {pipeLink(wire), pipeLink(wire)};
+  std::vector<std::thread> sending;
+  for (auto &sender : senders)
+  {
+    CHECK(sender.Connect(address));
+    sending.emplace_back([&]() {
+      for (int it = 0; it < packets; ++it)
+        sender.Send(new pipeData(&value));
+    });
+  }
+
+  // Popped but not released, the packets keep their credits
+  std::vector<pipeData *> popped;
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  while (auto data = (pipeData *)queue.TryPop())
+    popped.push_back(data);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  CHECK(senders[0].sent() + senders[1].sent() <= (uint64_t)size);
+  CHECK(queue.queue_count() == 0);
+
+  for (auto data : popped)
+    data->Release();
+  int received = popped.size();
+  while (received < 2 * packets)
+  {
+    auto data = (pipeData *)queue.PopFor(std::chrono::seconds(5));
+    if (data == nullptr)
+      break;
+    data->Release();
+    ++received;
+  }
+  CHECK(received == 2 * packets);
+
+  for (auto &thread : sending)
+    thread.join();
+  for (auto &sender : senders)
+    sender.Close();
+  receiver.Close();
+}
+
+int main()
+{
+  pipeWire wire;
+  wire.Pod<long>(1);
+  wire.payload(1);
+
+  Order(wire);
+  SharedCredits(wire);
+
+  return testReport("test_link");
+}
@@ -0,0 +1,192 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test_queue.cpp
+ *
+ * @brief Tests of the waits of pipeQueue that time out, are cancelled or
+ * never block
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeQueue.h"
+#include "test.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+/**
+ * @brief The pops of an empty queue give up at their deadline
+ */
+static void PopTimesOut()
+{
+  pipeQueue queue(2);
+
+  auto start = steady_clock::now();
+  CHECK(queue.PopFor(milliseconds(20)) == nullptr);
+  CHECK(steady_clock::now() - start >= milliseconds(20));
+
+  // A deadline already gone does not wait
+  start = steady_clock::now();
+  CHECK(queue.PopUntil(steady_clock::now() - milliseconds(1)) == nullptr);
+  CHECK(steady_clock::now() - start < seconds(1));
+
+  CHECK(queue.TryPop() == nullptr);
+  CHECK(queue.queue_count() == 0);
+}
+
+/**
+ * @brief The pushes to a full queue give up at their deadline and the caller
+ * keeps the buffer
+ */
+static void PushTimesOut()
+{
+  int first, second;
+  pipeQueue queue(1);
+  CHECK(queue.TryPush(&first));
+
+  auto start = steady_clock::now();
+  CHECK(!queue.PushFor(&second, milliseconds(20)));
+  CHECK(steady_clock::now() - start >= milliseconds(20));
+  CHECK(!queue.TryPush(&second));
+  CHECK(queue.queue_count() == 1);
+  CHECK(queue.full_waits() == 2);
+
+  // The slot made by a pop is taken again
+  CHECK(queue.TryPop() == &first);
+  CHECK(queue.PushFor(&second, milliseconds(20)));
+  CHECK(queue.TryPop() == &second);
+}
+
+/**
+ * @brief Cancel wakes the waits blocked with the token, and the later ones
+ * return at once until it is reset
+ */
+static void CancelWakesWaits()
+{
+  int value;
+  pipeQueue empty(1), full(1);
+  CHECK(full.TryPush(&value));
+  cancelToken token;
+
+  std::atomic<int> woken{0};
+  void *popped = &value;
+  bool pushed = true;
+  std::thread popper([&]() {
+    popped = empty.PopUntil(steady_clock::time_point::max(), &token);
+    woken.fetch_add(1);
+  });
+  std::thread pusher([&]() {
+    pushed = full.PushUntil(&value, steady_clock::time_point::max(), 0, &token);
+    woken.fetch_add(1);
+  });
+
+  std::this_thread::sleep_for(milliseconds(20));
+  CHECK(woken == 0);
+  token.Cancel();
+
+  auto deadline = steady_clock::now() + seconds(5);
+  while (woken < 2 && steady_clock::now() < deadline)
+    std::this_thread::sleep_for(milliseconds(1));
+  CHECK(woken == 2);
+  if (woken != 2)
+  {
+    popper.detach();
+    pusher.detach();
+    return;
+  }
+  popper.join();
+  pusher.join();
+  CHECK(popped == nullptr);
+  CHECK(!pushed);
+  CHECK(full.queue_count() == 1);
+
+  // Cancelled, the waits do not block; reset, they take what there is
+  CHECK(empty.PopFor(seconds(5), &token) == nullptr);
+  token.Reset();
+  CHECK(full.PopFor(seconds(5), &token) == &value);
+}
+
+/**
+ * @brief Consumers racing with TryPop never block and take every buffer once
+ */
+static void TryPopRace()
+{
+  const int buffers = 20000, consumers = 4;
+  pipeQueue queue(8);
+  std::vector<int> values(buffers);
+  std::vector<std::atomic<int>> taken(buffers);
+  std::atomic<int> total{0};
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> threads;
+  for (int it = 0; it < consumers; ++it)
+  {
+    threads.emplace_back([&]() {
+      while (!done)
+      {
+        auto data = (int *)queue.TryPop();
+        if (data != nullptr)
+        {
+          taken[data - values.data()].fetch_add(1);
+          total.fetch_add(1);
+        }
+      }
+    });
+  }
+
+  for (int it = 0; it < buffers; ++it)
+    queue.Push(&values[it]);
+
+  auto deadline = steady_clock::now() + seconds(10);
+  while (total < buffers && steady_clock::now() < deadline)
+    std::this_thread::sleep_for(milliseconds(1));
+
+  // The consumers are spinning on an empty queue: if a TryPop blocked, they
+  // would never see the flag
+  done = true;
+  for (auto &thread : threads)
+    thread.join();
+
+  CHECK(total == buffers);
+  int wrong = 0;
+  for (auto &count : taken)
+    wrong += count != 1;
+  CHECK(wrong == 0);
+  CHECK(queue.queue_count() == 0);
+}
+
+int main()
+{
+  PopTimesOut();
+  PushTimesOut();
+  CancelWakesWaits();
+  TryPopRace();
+
+  return testReport("test_queue");
+}
@@ -0,0 +1,178 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test_resequencer.cpp
+ *
+ * @brief Tests of the order restored by the Resequencer and of the gaps it
+ * skips
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipe_node.h"
+#include "resequencer.h"
+#include "test.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Runs the Resequencer on stamped packets and keeps what it emits
+ */
+class resequenced
+{
+public:
+  resequenced(Resequencer *unit) : unit_(unit)
+  {
+    node_.forward([this](pipeData *data) {
+      out.push_back(data->sequence());
+      data->Release();
+    });
+  }
+
+  // Runs a packet with the given sequence
+  void Run(uint64_t sequence)
+  {
+    auto data = new pipeData(nullptr);
+    data->sequence(sequence);
+    data->setNodeData(&node_);
+    unit_->Run(data);
+  }
+
+  std::vector<uint64_t> out; /**< The sequences emitted, in order */
+
+private:
+  Resequencer *unit_;
+  PipeNode node_;
+};
+
+/**
+ * @brief The packets arriving early wait for the ones before them
+ */
+static void Order()
+{
+  Resequencer unit(8);
+  resequenced run(&unit);
+
+  for (uint64_t sequence : {3, 1, 2, 5, 4, 6})
+    run.Run(sequence);
+
+  CHECK((run.out == std::vector<uint64_t>{1, 2, 3, 4, 5, 6}));
+  CHECK(unit.reordered() == 2);
+  CHECK(unit.skipped() == 0);
+  CHECK(unit.high_water() == 1);
+}
+
+/**
+ * @brief A full window skips the gap, and the packet of the gap arriving
+ * later is passed on
+ */
+static void WindowFull()
+{
+  Resequencer unit(4, std::chrono::microseconds(0), Resequencer::kPassLate);
+  resequenced run(&unit);
+
+  for (uint64_t sequence : {2, 3, 4})
+    run.Run(sequence);
+  CHECK(run.out.empty());
+
+  // 5 does not fit in the window while 1 is waited for
+  run.Run(5);
+  CHECK((run.out == std::vector<uint64_t>{2, 3, 4, 5}));
+  CHECK(unit.skipped() == 1);
+
+  run.Run(1);
+  CHECK((run.out == std::vector<uint64_t>{2, 3, 4, 5, 1}));
+  CHECK(unit.late() == 1);
+}
+
+/**
+ * @brief Tick skips a gap waited for longer than the timeout, and the packet
+ * of the gap arriving later is dropped
+ */
+static void Timeout()
+{
+  Resequencer unit(8, std::chrono::microseconds(10000), Resequencer::kDropLate);
+  resequenced run(&unit);
+  int dropped = 0;
+  unit.drop([&dropped](pipeData *data) {
+    ++dropped;
+    data->Release();
+  });
+
+  run.Run(2);
+  run.Run(3);
+  unit.Tick();
+  CHECK(run.out.empty());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  unit.Tick();
+  CHECK((run.out == std::vector<uint64_t>{2, 3}));
+  CHECK(unit.skipped() == 1);
+
+  run.Run(1);
+  CHECK((run.out == std::vector<uint64_t>{2, 3}));
+  CHECK(unit.late() == 1);
+  CHECK(dropped == 1);
+
+  // Nothing waits any more, so a new gap is waited for again
+  run.Run(5);
+  CHECK((run.out == std::vector<uint64_t>{2, 3}));
+  run.Run(4);
+  CHECK((run.out == std::vector<uint64_t>{2, 3, 4, 5}));
+}
+
+/**
+ * @brief A sequence already waiting, e.g. from a broadcast upstream, is
+ * late and does not take the place of the packet waiting
+ */
+static void Repeated()
+{
+  Resequencer unit(8, std::chrono::microseconds(0), Resequencer::kPassLate);
+  resequenced run(&unit);
+
+  run.Run(2);
+  run.Run(2);
+  CHECK((run.out == std::vector<uint64_t>{2}));
+  CHECK(unit.late() == 1);
+
+  run.Run(1);
+  CHECK((run.out == std::vector<uint64_t>{2, 1, 2}));
+
+  // The window is empty again, so the next gap is waited for from scratch
+  run.Run(4);
+  run.Run(3);
+  CHECK((run.out == std::vector<uint64_t>{2, 1, 2, 3, 4}));
+}
+
+int main()
+{
+  Order();
+  WindowFull();
+  Timeout();
+  Repeated();
+
+  return testReport("test_resequencer");
+}
@@ -0,0 +1,371 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test_topology.cpp
+ *
+ * @brief Tests of the routing of Pipeline, Mesh and Cube
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "cube.h"
+#include "dag.h"
+#include "mesh.h"
+#include "null_unit.h"
+#include "pipeline.h"
+#include "test.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @brief The payload of the test packets, the runs of every unit on it
+ */
+struct visits
+{
+  std::atomic<int> late{0};
+  std::atomic<int> work{0};
+};
+
+/**
+ * @brief Sleeps on every packet, so the ones with a short deadline expire
+ */
+class SlowUnit : public ProcessingUnitInterface
+{
+public:
+  void Run(pipeData::dataPacket) override { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }
+};
+
+/**
+ * @brief Counts the runs of the late node or of a working node on a packet
+ */
+class CountUnit : public ProcessingUnitInterface
+{
+public:
+  CountUnit(bool late) : late_(late) {}
+
+  void Run(pipeData::dataPacket data) override
+  {
+    auto runs = (visits *)((pipeData *)data)->data();
+    (late_ ? runs->late : runs->work).fetch_add(1);
+  }
+
+private:
+  bool late_;
+};
+
+/**
+ * @brief Sends every packet it runs along a route handle
+ */
+class RouteUnit : public ProcessingUnitInterface
+{
+public:
+  RouteUnit(pipeMapper::route route) : route_(route) {}
+
+  void Run(pipeData::dataPacket data) override { ((pipeData *)data)->route(route_); }
+
+private:
+  pipeMapper::route route_;
+};
+
+/**
+ * @brief Sends a packet through, expiring it in the first node if asked
+ *
+ * @return The packet that came out, nullptr if none did
+ */
+static pipeData *SendThrough(pipeQueue *in, pipeQueue *out, visits *runs, bool expire)
+{
+  auto data = new pipeData(runs);
+  if (expire)
+    data->expires_in(std::chrono::milliseconds(5));
+  in->Push(data);
+  return (pipeData *)out->PopFor(std::chrono::seconds(5));
+}
+
+/**
+ * @brief A packet expires in the first node of a Pipeline and is diverted by
+ * the last one to the late node, named when it was added. The late node comes
+ * before, so the packet would go round forever if it kept its deadline
+ */
+static void PipelineDivert()
+{
+  auto in = new pipeQueue(8);
+  auto out = new pipeQueue(8);
+  auto pipe = new Pipeline(new SlowUnit, in, out, 1, nullptr);
+  pipe->AddProcessingUnit(new CountUnit(true), 1, nullptr, 8, 0, 0, "late");
+  auto work = pipe->AddProcessingUnit(new CountUnit(false), 1, nullptr, 8);
+  pipe->deadlines(PipeNode::kDivertLate, "late");
+  CHECK(pipe->oneDimPipe->getPipeNode("late") != nullptr);
+  pipe->RunPipe();
+
+  visits onTime, late;
+  auto data = SendThrough(in, out, &onTime, false);
+  CHECK(data != nullptr && onTime.late == 1 && onTime.work == 1);
+  if (data != nullptr)
+    data->Release();
+
+  // Shed once by the working node, then run by it once back from the late node
+  data = SendThrough(in, out, &late, true);
+  CHECK(data != nullptr && late.late == 2 && late.work == 1);
+  CHECK(work->stats().shed.load() == 1);
+  if (data != nullptr)
+    data->Release();
+}
+
+/**
+ * @brief The same on a Mesh, the late node given by its name
+ */
+static void MeshDivert()
+{
+  auto mesh = new Mesh(1, 3, 8);
+  mesh->AddProcessingUnit(new SlowUnit, 1, 0, 0);
+  mesh->AddProcessingUnit(new CountUnit(true), 1, 0, 1, nullptr, 0, 0, 0, "late");
+  mesh->AddProcessingUnit(new CountUnit(false), 1, 0, 2);
+  mesh->deadlines(PipeNode::kDivertLate, "late");
+
+  auto first = (PipeNode *)mesh->twoDimPipe->getPipeNode(pipeMapper::nodeId(0, 0, 0));
+  mesh->RunMesh();
+
+  visits late;
+  auto data = SendThrough(first->in_data_queue(), mesh->out_queue(), &late, true);
+  CHECK(data != nullptr && late.late == 2 && late.work == 1);
+  if (data != nullptr)
+    data->Release();
+}
+
+/**
+ * @brief Route handles resolved from the names of the nodes of a Pipeline
+ * skip the nodes in between or leave at once
+ */
+static void PipelineRoute()
+{
+  auto in = new pipeQueue(8);
+  auto out = new pipeQueue(8);
+  auto pipe = new Pipeline(new CountUnit(true), in, out, 1, nullptr);
+  auto jump = pipe->AddProcessingUnit(new NullUnit, 1, nullptr, 8, 0, 0, "jump");
+  pipe->AddProcessingUnit(new CountUnit(false), 1, nullptr, 8, 0, 0, "skipped");
+  pipe->AddProcessingUnit(new CountUnit(true), 1, nullptr, 8, 0, 0, "target");
+
+  auto target = pipe->oneDimPipe->Route("target");
+  CHECK(pipe->oneDimPipe->getRouteNode(target) == pipe->getTail());
+  CHECK(pipe->oneDimPipe->getRouteNode(pipe->oneDimPipe->Route("[3:0:0]")) == pipe->getTail());
+  jump->processing_unit(new RouteUnit(target));
+  pipe->RunPipe();
+
+  visits runs;
+  auto data = SendThrough(in, out, &runs, false);
+  CHECK(data != nullptr && runs.late == 2 && runs.work == 0);
+  if (data != nullptr)
+    data->Release();
+
+  // Out from the unit that routes, before the target
+  jump->processing_unit(new RouteUnit(pipe->oneDimPipe->Route("_#WRITE_OUT#_")));
+  visits out_runs;
+  data = SendThrough(in, out, &out_runs, false);
+  CHECK(data != nullptr && out_runs.late == 1 && out_runs.work == 0);
+  if (data != nullptr)
+    data->Release();
+
+  bool rejected = false;
+  try
+  {
+    pipe->AddProcessingUnit(new NullUnit, 1, nullptr, 8, 0, 0, "target");
+  }
+  catch (const std::invalid_argument &)
+  {
+    rejected = true;
+  }
+  CHECK(rejected);
+}
+
+/**
+ * @brief Packets go round a closed Mesh and a closed Cube while the input
+ * queue of their first node is kept full by the producer
+ */
+static void Recirculation()
+{
+  const int packets = 500;
+  auto mesh = new Mesh(1, 2, 2, true);
+  auto cube = new Cube(1, 1, 2, 2, true);
+  mesh->AddProcessingUnit(new NullUnit, 1, 0, 0);
+  mesh->AddProcessingUnit(new NullUnit, 1, 0, 1);
+  cube->AddProcessingUnit(new NullUnit, 1, 0, 0, 0);
+  cube->AddProcessingUnit(new NullUnit, 1, 0, 0, 1);
+  mesh->loop(8u);
+  cube->loop(8u);
+  mesh->RunMesh();
+  cube->RunCube();
+
+  pipeQueue *inputs[] = {((PipeNode *)mesh->twoDimPipe->getPipeNode(pipeMapper::nodeId(0, 0, 0)))->in_data_queue(),
+                         ((PipeNode *)cube->threeDimPipe->getPipeNode(pipeMapper::nodeId(0, 0, 0)))->in_data_queue()};
+  pipeQueue *outputs[] = {mesh->out_queue(), cube->out_queue()};
+  for (int it = 0; it < 2; ++it)
+  {
+    std::thread producer([&]() {
+      for (int sent = 0; sent < packets; ++sent)
+        inputs[it]->Push(new pipeData(nullptr));
+    });
+
+    int received = 0;
+    pipeData *data;
+    while (received < packets && (data = (pipeData *)outputs[it]->PopFor(std::chrono::seconds(5))) != nullptr)
+    {
+      CHECK(data->passes() == 8);
+      data->Release();
+      ++received;
+    }
+    CHECK(received == packets);
+    if (received == packets)
+      producer.join();
+    else
+      producer.detach();
+  }
+}
+
+/**
+ * @brief Sets a key of its own on every packet
+ */
+class KeyUnit : public ProcessingUnitInterface
+{
+public:
+  KeyUnit(std::string key) : key_(key) {}
+
+  void Run(pipeData::dataPacket data) override { ((pipeData *)data)->setDataKey(key_, nullptr); }
+
+private:
+  std::string key_;
+};
+
+/**
+ * @brief Counts the packets given back by the Dag once every view is gone
+ */
+static void CountRelease(pipeData *data, void *released)
+{
+  delete data;
+  ((std::atomic<int> *)released)->fetch_add(1);
+}
+
+/**
+ * @brief A branch of a broadcast broadcasts again and all the leaves are
+ * joined: the packets come out once with the keys of every node
+ */
+static void DagNestedJoin()
+{
+  const int packets = 20;
+  std::atomic<int> released{0};
+  auto dag = new Dag(4);
+  for (auto name : {"a", "b", "c", "d", "e"})
+    dag->AddProcessingUnit(new KeyUnit(name), 1, name);
+  dag->AddProcessingUnit(new NullUnit, 1, "f", nullptr, true);
+  dag->AddEdge("a", "b");
+  dag->AddEdge("a", "c");
+  dag->AddEdge("b", "d");
+  dag->AddEdge("b", "e");
+  dag->AddEdge("c", "f");
+  dag->AddEdge("d", "f");
+  dag->AddEdge("e", "f");
+  dag->RunDag();
+
+  std::thread producer([&]() {
+    for (int sent = 0; sent < packets; ++sent)
+    {
+      auto data = new pipeData(nullptr);
+      data->release_hook(CountRelease, &released);
+      dag->send(data);
+    }
+  });
+  int received = 0;
+  pipeData *data;
+  while (received < packets && (data = (pipeData *)dag->out_queue()->PopFor(std::chrono::seconds(5))) != nullptr)
+  {
+    CHECK(data->parent() == nullptr);
+    for (auto key : {"a", "b", "c", "d", "e"})
+      CHECK(data->isKey(key));
+    data->Release();
+    ++received;
+  }
+  CHECK(received == packets);
+  CHECK(released == received);
+  if (received != packets)
+  {
+    producer.detach();
+    return;
+  }
+  producer.join();
+
+  delete dag;
+}
+
+/**
+ * @brief A Dag whose unit can not be cloned runs on the instance that does not
+ * need a clone, and is destroyed once the packets are out
+ */
+static void DagDestroy()
+{
+  const int packets = 10;
+  visits runs[packets];
+  auto dag = new Dag(4);
+  dag->AddProcessingUnit(new CountUnit(false), 2, "work");
+  dag->AddProcessingUnit(new NullUnit, 1, "out");
+  dag->AddEdge("work", "out");
+  dag->RunDag();
+
+  std::thread producer([&]() {
+    for (int sent = 0; sent < packets; ++sent)
+      dag->send(new pipeData(&runs[sent]));
+  });
+  int received = 0;
+  pipeData *data;
+  while (received < packets && (data = (pipeData *)dag->out_queue()->PopFor(std::chrono::seconds(5))) != nullptr)
+  {
+    CHECK(((visits *)data->data())->work == 1);
+    data->Release();
+    ++received;
+  }
+  CHECK(received == packets);
+  if (received != packets)
+  {
+    producer.detach();
+    return;
+  }
+  producer.join();
+
+  delete dag;
+}
+
+int main()
+{
+  PipelineDivert();
+  MeshDivert();
+  PipelineRoute();
+  Recirculation();
+  DagDestroy();
+  DagNestedJoin();
+
+  // The threads of the topologies never end
+  _exit(testReport("test_topology"));
+}
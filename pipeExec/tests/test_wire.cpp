@@ -0,0 +1,89 @@
+/*
+ * pipeExec is a library for creating concurrent proccesing pipes
+ *
+ * Copyright (C) 2023 Lucas Hernández Abreu and Pablo López Ramos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:  Lucas Hernández Abreu and Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+
+/**
+ * @file test_wire.cpp
+ *
+ * @brief Tests of the frames pipeWire rejects
+ *
+ * @author Pablo López Ramos
+ * Contact: lopez.ramos.pablo@gmail.com
+ */
+
+#include "pipeWire.h"
+#include "test.h"
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * @brief True if the frame is rejected
+ */
+static bool Rejected(const pipeWire &wire, const std::string &frame)
+{
+  try
+  {
+    wire.Deserialize(frame.data(), frame.size(), true)->Release();
+  }
+  catch (const std::invalid_argument &)
+  {
+    return true;
+  }
+  return false;
+}
+
+int main()
+{
+  pipeWire wire;
+  wire.Pod<long>(1);
+  wire.Pod<double>(2);
+  wire.payload(1);
+  uint16_t x = wire.Key("x", 2);
+  wire.Key("y", 2);
+
+  long value = 3;
+  double first = 0.5, second = 1.5;
+  pipeData packet(&value);
+  packet.setDataKey("x", &first);
+  packet.setDataKey("y", &second);
+  std::string frame;
+  wire.Serialize(&packet, frame);
+
+  // The header, then the payload, x and y, each one a field header of 8
+  // bytes and 8 bytes of value
+  const size_t payload = pipeWire::kHeaderSize, keyY = payload + 32;
+  CHECK(frame.size() == keyY + 16);
+  CHECK(!Rejected(wire, frame));
+
+  // A payload shorter than a long would be read past its end
+  std::string shortField = frame;
+  uint32_t length = 4;
+  memcpy(&shortField[payload], &length, sizeof(length));
+  CHECK(Rejected(wire, shortField));
+
+  // y written as x, the first value would be lost
+  std::string duplicate = frame;
+  memcpy(&duplicate[keyY + sizeof(uint32_t)], &x, sizeof(x));
+  CHECK(Rejected(wire, duplicate));
+
+  return testReport("test_wire");
+}